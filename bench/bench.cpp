@@ -0,0 +1,362 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "mgt.h"
+#include "pool.h"
+
+/**
+ * Микробенчмарки этапов расчёта mgt-single: разбор, построение связей
+ * по номерам узлов с перенумерацией (и сжатием), поиск компонент,
+ * поиск точек сочленения с расчётом оценок (последовательный обход
+ * и параллельная схема), полный process() и пересчёт сохранённой модели
+ * после изменения весов и после удаления и обратного добавления связей,
+ * оценка пачки сценариев весов на подготовленной топологии.
+ * Каждый этап запускается на заранее подготовленной копии состояния,
+ * подготовка в замер не входит. Результат - строки JSON,
+ * по одной на пару (файл, этап), чтобы прогоны можно было сравнивать diff'ом.
+ */
+
+/**
+ * Состояние графа между этапами
+ */
+struct State {
+    Graph graph;
+    Values values;
+    Links links;
+    PackedLinks packed;
+    Components comps;
+};
+
+/**
+ * Статистика замеров одного этапа
+ *   double median_ms - медиана, мс
+ *   double mad_ms - медиана абсолютных отклонений от медианы, мс
+ *   double min_ms - минимум, мс
+ */
+struct Stats {
+    double median_ms{};
+    double mad_ms{};
+    double min_ms{};
+};
+
+//Медиана выборки (выборка переупорядочивается)
+double median(std::vector<double> &x) {
+    size_t mid = x.size() / 2;
+    std::nth_element(x.begin(), x.begin() + mid, x.end());
+    double m = x[mid];
+    if(x.size() % 2 == 0) {
+        m = (m + *std::max_element(x.begin(), x.begin() + mid)) / 2;
+    }
+    return m;
+}
+
+Stats stats(std::vector<double> x) {
+    Stats s;
+    s.min_ms = *std::min_element(x.begin(), x.end());
+    s.median_ms = median(x);
+    for(auto &v : x) {
+        v = v > s.median_ms ? v - s.median_ms : s.median_ms - v;
+    }
+    s.mad_ms = median(x);
+    return s;
+}
+
+/**
+ * Замер этапа
+ * Параметры:
+ *   int warmup - количество прогревочных запусков (не учитываются)
+ *   int reps - количество учитываемых запусков
+ *   setup - подготовка состояния перед каждым запуском, не замеряется
+ *   body - замеряемый этап
+ * Возвращаемое значение:
+ *   время каждого учитываемого запуска, мс
+ */
+std::vector<double>
+measure(
+    int warmup,
+    int reps,
+    const std::function<void()> &setup,
+    const std::function<void()> &body
+) {
+    std::vector<double> times;
+    for(int i = 0; i < warmup + reps; ++i) {
+        setup();
+        Stage s;
+        StageMark mark = stage_start();
+        body();
+        stage_stop(mark, s);
+        if(i >= warmup) {
+            times.push_back(s.wall_ms);
+        }
+    }
+    return times;
+}
+
+//Вывод строки в формате JSON (с экранированием)
+void print_json_str(std::ostream &out, const std::string &s) {
+    out << '"';
+    for(char c : s) {
+        if(c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if(static_cast<unsigned char>(c) < 0x20) {
+            out << ' ';
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void print_result(const std::string &file, const char *stage, size_t nodes, size_t edges,
+        int reps, const Stats &s) {
+    std::cout << "{\"file\":";
+    print_json_str(std::cout, file);
+    std::cout << ",\"stage\":\"" << stage << "\""
+              << ",\"nodes\":" << nodes
+              << ",\"edges\":" << edges
+              << ",\"reps\":" << reps
+              << ",\"median_ms\":" << s.median_ms
+              << ",\"mad_ms\":" << s.mad_ms
+              << ",\"min_ms\":" << s.min_ms
+              << ",\"edges_per_sec\":" << (s.median_ms > 0 ? edges / (s.median_ms / 1e3) : 0)
+              << "}" << std::endl;
+}
+
+/**
+ * Параметры:
+ *   -r reps - количество учитываемых запусков каждого этапа (5)
+ *   -w warmup - количество прогревочных запусков (1)
+ *   -s stages - список этапов через запятую
+ *               (ser_in,links,make_components,analyze,bicon,process,update_weights,edges,what_if)
+ *   -o order - перенумерация узлов для этапов после links
+ *              и для process: none (по умолчанию), bfs, rcm, degree
+ *   -p - сжимать связи на этапе links (PackedLinks) и обходить сжатые
+ *        связи на следующих этапах и в process
+ *   -u count - количество узлов с новыми весами для update_weights,
+ *              изменяемых связей для edges и сценариев для what_if (16)
+ *   -j threads - обрабатывать компоненты на пуле из threads потоков
+ *                (0 - по числу процессоров; по умолчанию без пула)
+ *   argv[...] - файлы с исходными данными
+ */
+int main(int argc, char *argv[]) {
+    int reps = 5;
+    int warmup = 1;
+    int threads = -1;
+    size_t updates = 16;
+    std::string only = "ser_in,links,make_components,analyze,bicon,process,update_weights,edges,what_if";
+    Options opts;
+    int opt;
+    while((opt = ::getopt(argc, argv, "r:w:s:j:u:o:p")) != -1) {
+        switch(opt) {
+            case 'p': opts.packed = true; break;
+            case 'o':
+                if(parse_order(optarg, opts.order) != 0) {
+                    std::cerr << "unknown order " << optarg << std::endl;
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'u': updates = std::max(1, std::atoi(optarg)); break;
+            case 'j': threads = std::max(0, std::atoi(optarg)); break;
+            case 'r': reps = std::max(1, std::atoi(optarg)); break;
+            case 'w': warmup = std::max(0, std::atoi(optarg)); break;
+            case 's': only = optarg; break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if(optind >= argc) {
+        std::cerr << "Usage: bench [-r reps] [-w warmup] [-s stage,...] [-u count] [-j threads] [-o order] [-p]"
+                     " file1 [file2 [...]]"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    Pool pool;
+    if(threads >= 0) {
+        pool_start(pool, threads);
+        set_engine_pool(&pool);
+    }
+    auto enabled = [&](const char *stage) {
+        return ("," + only + ",").find("," + std::string(stage) + ",") != std::string::npos;
+    };
+
+    for(int i = optind; i < argc; ++i) {
+        std::ifstream file(argv[i]);
+        if(!file.is_open()) {
+            std::cerr << argv[i] << ": can't open file" << std::endl;
+            continue;
+        }
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        //Эталонные состояния после каждого этапа, из которых берутся копии
+        State parsed;
+        std::ostringstream errs;
+        {
+            std::istringstream in(text);
+            if(ser_in(in, parsed.graph, parsed.values, errs) != 0) {
+                std::cerr << argv[i] << ": " << errs.str();
+                continue;
+            }
+        }
+        size_t nodes = parsed.values.size();
+        size_t edges = count_edges(parsed.graph);
+
+        State linked = parsed;
+        links_build(linked.graph, linked.values, linked.links);
+        reorder(linked.values, linked.links, opts.order);
+        if(opts.packed) {
+            links_pack(linked.links, linked.packed);
+            linked.links = Links();
+        }
+
+        //Этапы после links обходят сжатые или обычные связи
+        auto on_links = [&](State &s, auto body) {
+            if(opts.packed) {
+                body(s.packed);
+            } else {
+                body(s.links);
+            }
+        };
+
+        State split = linked;
+        on_links(split, [&](auto &l) { make_components(l, split.values, split.comps); });
+
+
+        std::unique_ptr<State> st;
+        auto run = [&](const char *stage, const State *from, const std::function<void()> &body) {
+            if(!enabled(stage)) {
+                return;
+            }
+            auto setup = [&]() {
+                st.reset();
+                st.reset(from ? new State(*from) : new State);
+            };
+            auto times = measure(warmup, reps, setup, body);
+            print_result(argv[i], stage, nodes, edges, reps, stats(times));
+        };
+
+        run("ser_in", nullptr, [&]() {
+            std::istringstream in(text);
+            ser_in(in, st->graph, st->values, errs);
+        });
+        run("links", &parsed, [&]() {
+            links_build(st->graph, st->values, st->links);
+            reorder(st->values, st->links, opts.order);
+            if(opts.packed) {
+                links_pack(st->links, st->packed);
+            }
+        });
+        run("make_components", &linked, [&]() {
+            on_links(*st, [&](auto &l) { make_components(l, st->values, st->comps); });
+        });
+        run("analyze", &split, [&]() {
+            on_links(*st, [&](auto &l) {
+                for(auto &c : st->comps) {
+                    analyze_comp(l, st->values, c);
+                }
+            });
+        });
+        run("bicon", &split, [&]() {
+            on_links(*st, [&](auto &l) {
+                for(auto &c : st->comps) {
+                    analyze_comp_parallel(l, st->values, c, threads >= 0 ? &pool : nullptr);
+                }
+            });
+        });
+        run("process", nullptr, [&]() {
+            std::istringstream in(text);
+            std::ostringstream out;
+            process(in, out, nullptr, opts);
+        });
+
+        //Модель не копируется, поэтому перед каждым запуском строится заново
+        if(enabled("update_weights") && nodes > 0) {
+            std::unique_ptr<Model> m;
+            Weights changes;
+            {
+                Model probe;
+                std::istringstream in(text);
+                model_build(probe, in, errs);
+                size_t step = std::max<size_t>(1, nodes / updates);
+                size_t k = 0;
+                for(size_t id = 0; id < probe.values.size(); ++id) {
+                    if(k++ % step == 0 && changes.size() < updates) {
+                        changes[*probe.values.names[id]] = probe.values.value[id] + 1;
+                    }
+                }
+            }
+            auto setup = [&]() {
+                m.reset(new Model);
+                std::istringstream in(text);
+                model_build(*m, in, errs);
+            };
+            auto times = measure(warmup, reps, setup, [&]() {
+                update_weights(*m, changes);
+            });
+            print_result(argv[i], "update_weights", nodes, edges, reps, stats(times));
+        }
+
+        //Каждая связь удаляется и сразу добавляется обратно
+        if(enabled("edges") && edges > 0) {
+            std::unique_ptr<Model> m;
+            std::vector<std::pair<Name, Name>> links;
+            {
+                size_t step = std::max<size_t>(1, edges / updates);
+                size_t k = 0;
+                for(auto &[a, to] : parsed.graph) {
+                    for(auto &b : to) {
+                        if(a < b && k++ % step == 0 && links.size() < updates) {
+                            links.push_back({a, b});
+                        }
+                    }
+                }
+            }
+            auto setup = [&]() {
+                m.reset(new Model);
+                std::istringstream in(text);
+                model_build(*m, in, errs);
+            };
+            auto times = measure(warmup, reps, setup, [&]() {
+                for(auto &[a, b] : links) {
+                    remove_edge(*m, a, b);
+                    add_edge(*m, a, b);
+                }
+            });
+            print_result(argv[i], "edges", nodes, edges, reps, stats(times));
+        }
+
+        //Сценарий k меняет вес каждого узла на k
+        if(enabled("what_if") && nodes > 0) {
+            Model m;
+            Topology t;
+            {
+                std::istringstream in(text);
+                model_build(m, in, errs);
+                topology_build(m, t);
+            }
+            std::vector<Weights> scenarios(updates);
+            for(size_t k = 0; k < updates; ++k) {
+                for(size_t id = 0; id < m.values.size(); ++id) {
+                    scenarios[k][*m.values.names[id]] = m.values.value[id] + k;
+                }
+            }
+            auto times = measure(warmup, reps, []() {}, [&]() {
+                std::ostringstream out;
+                what_if(t, scenarios, out);
+            });
+            print_result(argv[i], "what_if", nodes, edges, reps, stats(times));
+        }
+    }
+    if(threads >= 0) {
+        set_engine_pool(nullptr);
+        pool_stop(pool);
+    }
+    return EXIT_SUCCESS;
+}
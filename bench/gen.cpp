@@ -0,0 +1,409 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <unistd.h>
+
+/**
+ * Генератор синтетических графов во входном формате mgt:
+ * {[['A', 'B'], ...],{'A': 10, ...}}
+ * Один и тот же набор параметров (включая seed) всегда даёт
+ * один и тот же файл, поэтому генератор не использует std::*_distribution,
+ * поведение которых зависит от реализации стандартной библиотеки.
+ */
+
+/**
+ * Параметры генерации
+ *   std::string family - семейство графов
+ *   uint64_t n - количество узлов
+ *   uint64_t m - количество рёбер (для er)
+ *   uint64_t k - параметр семейства (ширина решётки, степень ba,
+ *                размер компоненты, максимальная длина цикла кактуса)
+ *   std::string dist - распределение весов: const, uniform, exp, pareto
+ *   long wmin, wmax - границы весов
+ *   double alpha - показатель степени для pareto
+ *   uint64_t seed - начальное значение генератора случайных чисел
+ *   std::string prefix - префикс имён узлов
+ */
+struct Params {
+    std::string family;
+    uint64_t n{};
+    uint64_t m{};
+    uint64_t k{};
+    std::string dist = "uniform";
+    long wmin = 1;
+    long wmax = 100;
+    double alpha = 1.5;
+    uint64_t seed = 1;
+    std::string prefix = "N";
+};
+
+/**
+ * Генератор псевдослучайных чисел splitmix64:
+ * переносимый и воспроизводимый на любой платформе
+ */
+struct Rng {
+    uint64_t state;
+
+    explicit Rng(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    //Равномерно распределённое целое в диапазоне [0, n)
+    uint64_t below(uint64_t n) {
+        return uint64_t((unsigned __int128)next() * n >> 64);
+    }
+
+    //Равномерно распределённое вещественное в диапазоне (0, 1]
+    double real() {
+        return ((next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+    }
+};
+
+/**
+ * Буферизованный вывод графа в файл.
+ * Числа и имена форматируются вручную: printf на 10^8 рёбрах
+ * заметно медленнее самой генерации.
+ */
+struct Writer {
+    FILE *f;
+    std::string prefix;
+    std::vector<char> buf;
+    size_t used = 0;
+    uint64_t edges = 0;
+
+    Writer(FILE *file, const std::string &p) : f(file), prefix(p), buf(1 << 20) {}
+
+    void flush() {
+        if(used && ::fwrite(buf.data(), 1, used, f) != used) {
+            perror("write");
+            std::exit(EXIT_FAILURE);
+        }
+        used = 0;
+    }
+
+    void put(const char *s, size_t len) {
+        if(used + len > buf.size()) {
+            flush();
+        }
+        ::memcpy(&buf[used], s, len);
+        used += len;
+    }
+
+    void put(const char *s) {
+        put(s, ::strlen(s));
+    }
+
+    void num(unsigned long long v) {
+        char tmp[24];
+        int i = sizeof(tmp);
+        do {
+            tmp[--i] = char('0' + v % 10);
+            v /= 10;
+        } while(v);
+        put(tmp + i, sizeof(tmp) - i);
+    }
+
+    void name(uint64_t id) {
+        put("'", 1);
+        put(prefix.data(), prefix.size());
+        num(id);
+        put("'", 1);
+    }
+
+    //Вывод одного ребра в виде ['A', 'B']
+    void edge(uint64_t a, uint64_t b) {
+        put(edges ? ",\n    [" : "    [");
+        name(a);
+        put(", ", 2);
+        name(b);
+        put("]", 1);
+        ++edges;
+    }
+};
+
+/**
+ * Вес узла по заданному распределению
+ */
+long
+weight(
+    Rng &r,
+    const Params &p
+) {
+    double span = double(p.wmax - p.wmin);
+    double w;
+    if(p.dist == "const") {
+        return p.wmin;
+    } else if(p.dist == "exp") {
+        //Среднее - четверть диапазона, хвост обрезается по wmax
+        w = p.wmin - std::log(r.real()) * span / 4;
+    } else if(p.dist == "pareto") {
+        //Степенной закон: большинство узлов лёгкие, немногие - очень тяжёлые
+        w = std::max(p.wmin, 1L) * std::pow(r.real(), -1.0 / p.alpha);
+    } else {
+        return p.wmin + long(r.below(uint64_t(p.wmax - p.wmin) + 1));
+    }
+    return std::min(long(w), p.wmax);
+}
+
+//Цепочка 0 - 1 - ... - n-1
+void gen_path(Writer &w, Rng &, const Params &p) {
+    for(uint64_t i = 1; i < p.n; ++i) {
+        w.edge(i - 1, i);
+    }
+}
+
+//Случайное рекурсивное дерево: каждый узел подвешивается к случайному предыдущему
+void gen_tree(Writer &w, Rng &r, const Params &p) {
+    for(uint64_t i = 1; i < p.n; ++i) {
+        w.edge(r.below(i), i);
+    }
+}
+
+//Решётка шириной k (по умолчанию - квадратная)
+void gen_grid(Writer &w, Rng &, const Params &p) {
+    uint64_t width = p.k ? p.k : std::max<uint64_t>(1, std::llround(std::sqrt(double(p.n))));
+    for(uint64_t i = 0; i < p.n; ++i) {
+        if((i + 1) % width && i + 1 < p.n) {
+            w.edge(i, i + 1);
+        }
+        if(i + width < p.n) {
+            w.edge(i, i + width);
+        }
+    }
+}
+
+//Звезда, как tests/sun1: центр 0 и n-1 лучей
+void gen_star(Writer &w, Rng &, const Params &p) {
+    for(uint64_t i = 1; i < p.n; ++i) {
+        w.edge(0, i);
+    }
+}
+
+/**
+ * Граф Эрдёша-Реньи G(n, p) с ожидаемым числом рёбер m.
+ * Рёбра перебираются с геометрическими пропусками (Batagelj, Brandes),
+ * так что время O(n + m) и без хранения рёбер в памяти.
+ */
+void gen_er(Writer &w, Rng &r, const Params &p) {
+    double pairs = double(p.n) * double(p.n - 1) / 2;
+    double prob = std::min(1.0, double(p.m) / pairs);
+    if(prob >= 1.0) {
+        for(uint64_t v = 1; v < p.n; ++v) {
+            for(uint64_t u = 0; u < v; ++u) {
+                w.edge(u, v);
+            }
+        }
+        return;
+    }
+    double lq = std::log(1.0 - prob);
+    uint64_t v = 1;
+    int64_t u = -1;
+    while(v < p.n) {
+        u += 1 + int64_t(std::floor(std::log(r.real()) / lq));
+        while(u >= int64_t(v) && v < p.n) {
+            u -= v;
+            ++v;
+        }
+        if(v < p.n) {
+            w.edge(uint64_t(u), v);
+        }
+    }
+}
+
+/**
+ * Модель Барабаши-Альберт: каждый новый узел соединяется с k узлами,
+ * выбранными пропорционально степени. Затравка - клика из k+1 узлов.
+ * Повторный выбор одного и того же соседа отбрасывается.
+ */
+void gen_ba(Writer &w, Rng &r, const Params &p) {
+    uint64_t k = p.k ? p.k : 2;
+    uint64_t seed_size = std::min(p.n, k + 1);
+    std::vector<uint32_t> ends;
+    ends.reserve(2 * k * p.n);
+    for(uint64_t v = 1; v < seed_size; ++v) {
+        for(uint64_t u = 0; u < v; ++u) {
+            w.edge(u, v);
+            ends.push_back(u);
+            ends.push_back(v);
+        }
+    }
+    std::vector<uint32_t> picked;
+    for(uint64_t v = seed_size; v < p.n; ++v) {
+        picked.clear();
+        for(uint64_t j = 0; j < k; ++j) {
+            uint32_t u = ends[r.below(ends.size())];
+            if(std::find(picked.begin(), picked.end(), u) == picked.end()) {
+                picked.push_back(u);
+            }
+        }
+        for(uint32_t u : picked) {
+            w.edge(u, v);
+            ends.push_back(u);
+            ends.push_back(v);
+        }
+    }
+}
+
+/**
+ * Много мелких компонент размером k: в каждой - случайное дерево
+ * и одна хорда, замыкающая цикл
+ */
+void gen_components(Writer &w, Rng &r, const Params &p) {
+    uint64_t size = p.k ? p.k : 8;
+    for(uint64_t base = 0; base < p.n; base += size) {
+        uint64_t len = std::min(size, p.n - base);
+        for(uint64_t i = 1; i < len; ++i) {
+            w.edge(base + r.below(i), base + i);
+        }
+        if(len > 2) {
+            w.edge(base, base + len - 1 - r.below(len - 2));
+        }
+    }
+}
+
+/**
+ * Кактус: к случайному уже построенному узлу подвешивается цикл
+ * длиной от 2 (мост) до k. Почти каждый узел - точка сочленения.
+ */
+void gen_cactus(Writer &w, Rng &r, const Params &p) {
+    uint64_t maxlen = std::max<uint64_t>(2, p.k ? p.k : 5);
+    uint64_t next = 1;
+    while(next < p.n) {
+        uint64_t anchor = r.below(next);
+        uint64_t len = std::min(2 + r.below(maxlen - 1), p.n - next + 1);
+        uint64_t prev = anchor;
+        for(uint64_t i = 1; i < len; ++i, ++next) {
+            w.edge(prev, next);
+            prev = next;
+        }
+        if(len > 2) {
+            w.edge(prev, anchor);
+        }
+    }
+}
+
+/**
+ * Параметры:
+ *   -t family - семейство: path, tree, grid, star, er, ba, components, cactus
+ *   -n nodes - количество узлов
+ *   -m edges - ожидаемое количество рёбер (er)
+ *   -k param - параметр семейства
+ *   -w dist - распределение весов: const, uniform, exp, pareto
+ *   -a min, -b max - границы весов
+ *   -p alpha - показатель степени для pareto
+ *   -s seed - начальное значение генератора
+ *   -x prefix - префикс имён узлов
+ *   -o file - выходной файл, по умолчанию stdout
+ */
+int main(int argc, char *argv[]) {
+    static const struct {
+        const char *name;
+        void (*gen)(Writer &, Rng &, const Params &);
+    } families[] = {
+        {"path", gen_path},
+        {"tree", gen_tree},
+        {"grid", gen_grid},
+        {"star", gen_star},
+        {"er", gen_er},
+        {"ba", gen_ba},
+        {"components", gen_components},
+        {"cactus", gen_cactus},
+    };
+
+    Params p;
+    const char *outname = nullptr;
+    int opt;
+    while((opt = ::getopt(argc, argv, "t:n:m:k:w:a:b:p:s:x:o:")) != -1) {
+        switch(opt) {
+            case 't': p.family = optarg; break;
+            case 'n': p.n = std::strtoull(optarg, nullptr, 10); break;
+            case 'm': p.m = std::strtoull(optarg, nullptr, 10); break;
+            case 'k': p.k = std::strtoull(optarg, nullptr, 10); break;
+            case 'w': p.dist = optarg; break;
+            case 'a': p.wmin = std::strtol(optarg, nullptr, 10); break;
+            case 'b': p.wmax = std::strtol(optarg, nullptr, 10); break;
+            case 'p': p.alpha = std::strtod(optarg, nullptr); break;
+            case 's': p.seed = std::strtoull(optarg, nullptr, 10); break;
+            case 'x': p.prefix = optarg; break;
+            case 'o': outname = optarg; break;
+            default: p.family.clear(); optind = argc; break;
+        }
+    }
+
+    void (*gen)(Writer &, Rng &, const Params &) = nullptr;
+    for(auto &f : families) {
+        if(p.family == f.name) {
+            gen = f.gen;
+        }
+    }
+    if(!gen || p.n < 2) {
+        std::fprintf(stderr,
+            "Usage: gen -t family -n nodes [-m edges] [-k param] [-w dist] [-a min] [-b max]\n"
+            "           [-p alpha] [-s seed] [-x prefix] [-o file]\n"
+            "  family: path, tree, grid, star, er, ba, components, cactus\n"
+            "  dist: const, uniform, exp, pareto\n");
+        return EXIT_FAILURE;
+    }
+    //Разборщик читает веса через std::stoi
+    if(p.wmin > p.wmax || p.wmax > INT_MAX || p.wmin < INT_MIN) {
+        std::fprintf(stderr, "gen: weights must satisfy INT_MIN <= min <= max <= INT_MAX\n");
+        return EXIT_FAILURE;
+    }
+    if(p.family == "er" && !p.m) {
+        p.m = 2 * p.n;
+    }
+    if(p.family == "ba" && p.n > UINT32_MAX) {
+        std::fprintf(stderr, "gen: ba supports up to 2^32 nodes\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *f = outname ? std::fopen(outname, "w") : stdout;
+    if(!f) {
+        perror("open");
+        return EXIT_FAILURE;
+    }
+
+    Writer w(f, p.prefix);
+    Rng topology(p.seed);
+    w.put("{\n  [\n");
+    gen(w, topology, p);
+    if(!w.edges) {
+        //Формат требует хотя бы одну связь
+        w.edge(0, 1);
+    }
+    w.put("\n  ],{\n");
+    //Отдельный поток случайных чисел для весов, чтобы смена распределения
+    //весов не меняла топологию
+    Rng weights(p.seed ^ 0xD1B54A32D192ED03ULL);
+    for(uint64_t i = 0; i < p.n; ++i) {
+        w.put(i ? ",\n    " : "    ");
+        w.name(i);
+        w.put(": ", 2);
+        long v = weight(weights, p);
+        if(v < 0) {
+            w.put("-", 1);
+            v = -v;
+        }
+        w.num(v);
+    }
+    w.put("\n  }\n}\n");
+    w.flush();
+    if(outname && std::fclose(f) != 0) {
+        perror("close");
+        return EXIT_FAILURE;
+    }
+    std::fprintf(stderr, "gen: %llu nodes, %llu edges\n",
+            (unsigned long long)p.n, (unsigned long long)w.edges);
+    return EXIT_SUCCESS;
+}
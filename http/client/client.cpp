@@ -5,6 +5,14 @@
 #include <unistd.h>
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <map>
+#include <cerrno>
 #include <netdb.h>
 #include <arpa/inet.h>
 
@@ -92,6 +100,7 @@ sock_write_timeout(
 #include <cctype>
 #include <iomanip>
 #include <string.h>
+#include <strings.h>
 
 /**
  * Вывод в выходной поток строки с преобразованием url_encode, при котором
@@ -131,10 +140,11 @@ bool url_encode(
 
 /**
  * Отправка запроса GET следующего вида:
- * GET /point=<url-кодированные данные для расчётов> HTTP/1.0\r\n
+ * GET /point=<url-кодированные данные для расчётов> HTTP/1.1\r\n
  * Host: host:port\r\n
  * User-Agent: mgt-client-http\r\n
  * Accept: text/html\r\n
+ * If-None-Match: "..."\r\n   ----- если известен ETag прежнего ответа
  * \r\n     ----- пустую строку в конце
  * Параметры:
  *    std::istream& in - входной поток
@@ -142,6 +152,8 @@ bool url_encode(
  *    const std::string& point - необязательное наименование ресурса сервера
  *    const std::string& host - имя (или адрес в текстовом виде) сервера
  *    unsigned port - порт сервера
+ *    const std::string& etag - ETag прежнего ответа на этот запрос
+ *                              (пусто - без If-None-Match)
  * Возвращаемое значение:
  *   true - успешно
  *   false - ошибка вывода
@@ -151,8 +163,8 @@ bool http_GET_request(
     std::ostream& out,
     const std::string& point,
     const std::string& host,
-    unsigned port
-
+    unsigned port,
+    const std::string& etag = ""
 ) {
     if(!(out <<"GET /" <<point <<"=")) {
         return false;
@@ -168,27 +180,464 @@ bool http_GET_request(
     }
     //Отправить хвост запроса и набор ещё каких-то полей запроса
     //Наверное, можно и без них
-    return bool(out <<" HTTP/1.0\r\n"
-                      "Host: " <<host <<":" <<port <<"\r\n"
-                      "User-Agent: mgt-client-http\r\n"
-                      "Accept: text/html\r\n"
-                      "\r\n"); //Пустая строка в конце
+    out <<" HTTP/1.1\r\n"
+          "Host: " <<host <<":" <<port <<"\r\n"
+          "User-Agent: mgt-client-http\r\n"
+          "Accept: text/html\r\n";
+    if(!etag.empty()) {
+        //Результат не изменился - сервер ответит 304 без тела
+        out <<"If-None-Match: " <<etag <<"\r\n";
+    }
+    return bool(out <<"\r\n"); //Пустая строка в конце
+}
+
+/**
+ * Подключение к серверу с назначением таймаутов
+ * Параметры:
+ *   const sockaddr_in &serv_addr - адрес сервера
+ *   long read_timeout - таймаут чтения, мс
+ * Возвращаемое значение:
+ *   >=0 - сокет
+ *   <0 - ошибка
+ */
+int
+connect_server(
+    const sockaddr_in &serv_addr,
+    long read_timeout
+) {
+    int client_socket;
+    if((client_socket = ::socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+    if(::connect(client_socket, (const sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        ::close(client_socket);
+        return -1;
+    }
+    sock_read_timeout(client_socket, read_timeout);
+    sock_write_timeout(client_socket, DEFAULT_WRITE_TIMEOUT);
+    return client_socket;
+}
+
+/**
+ * Параметры нагрузочного теста
+ *   int conns - количество одновременных соединений
+ *   double rate - общая целевая частота запросов в секунду,
+ *                 0 - замкнутый цикл (следующий запрос сразу после ответа)
+ *   double duration - длительность теста, с
+ *   long timeout - таймаут ожидания ответа, мс
+ */
+struct LoadParams {
+    int conns = 1;
+    double rate = 0;
+    double duration = 0;
+    long timeout = DEFAULT_READ_TIMEOUT;
+};
+
+/**
+ * Результаты одного соединения нагрузочного теста
+ *   std::vector<double> latencies - задержки успешных запросов, мс
+ *   unsigned long ok - количество успешных ответов
+ *   unsigned long errors - ошибки соединения, коды HTTP кроме 200 и ответы с @@ERROR
+ *   unsigned long timeouts - запросы без ответа за время таймаута
+ */
+struct LoadStats {
+    std::vector<double> latencies;
+    unsigned long ok = 0;
+    unsigned long errors = 0;
+    unsigned long timeouts = 0;
+};
+
+/**
+ * Отправка всего буфера в сокет
+ * Возвращаемое значение:
+ *   true - успешно
+ *   false - ошибка
+ */
+bool
+send_all(
+    int sockfd,
+    const std::string &data
+) {
+    size_t sent = 0;
+    while(sent < data.size()) {
+        ssize_t n = ::send(sockfd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+/**
+ * Дочитать из сокета очередную порцию данных в buf
+ * Возвращаемое значение:
+ *   0 - данные прочитаны
+ *   1 - истёк таймаут
+ *   2 - соединение закрыто сервером
+ *   -1 - ошибка
+ */
+int
+recv_more(
+    int sockfd,
+    std::string &buf
+) {
+    char chunk[4096];
+    ssize_t n = ::recv(sockfd, chunk, sizeof(chunk), 0);
+    if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 1;
+    }
+    if(n < 0) {
+        return -1;
+    }
+    if(n == 0) {
+        return 2;
+    }
+    buf.append(chunk, n);
+    return 0;
+}
+
+/**
+ * Чтение одного ответа HTTP: строка состояния, заголовки и тело.
+ * Конец тела определяется по заголовку Content-Length, поэтому в одном
+ * соединении можно получать ответы один за другим. Если Content-Length
+ * нет, тело читается до закрытия соединения сервером.
+ * Параметры:
+ *   int sockfd - сокет
+ *   std::string &buf - принятые, но ещё не разобранные данные
+ *   int &code - код ответа
+ *   std::string &status - текст состояния
+ *   std::string &body - тело ответа
+ *   bool &closed - true = соединение закрыто или будет закрыто сервером
+ *   std::string *etag - если не nullptr - заголовок ETag (пусто - нет)
+ * Возвращаемое значение:
+ *   0 - ответ прочитан
+ *   1 - истёк таймаут
+ *   -1 - ошибка; если buf пуст, то ответа не было вовсе
+ *        (сервер закрыл простаивающее соединение)
+ */
+int
+recv_response(
+    int sockfd,
+    std::string &buf,
+    int &code,
+    std::string &status,
+    std::string &body,
+    bool &closed,
+    std::string *etag = nullptr
+) {
+    closed = true;
+    if(etag) {
+        etag->clear();
+    }
+    size_t head_end;
+    while((head_end = buf.find("\r\n\r\n")) == std::string::npos) {
+        int r = recv_more(sockfd, buf);
+        if(r != 0) {
+            return r == 1 ? 1 : -1;
+        }
+    }
+    std::istringstream head(buf.substr(0, head_end));
+    std::string version;
+    std::string line;
+    //Первая строка: HTTP/1.1 200 OK
+    head >>version >>code;
+    std::getline(head, line);
+    size_t from = line.find_first_not_of(' ');
+    size_t to = line.find('\r');
+    status = from == std::string::npos ? "" : line.substr(from, to == std::string::npos ? to : to - from);
+    //HTTP/1.1 по умолчанию сохраняет соединение, HTTP/1.0 - закрывает
+    closed = version != "HTTP/1.1";
+    long length = -1;
+    while(std::getline(head, line)) {
+        if(etag && ::strncasecmp(line.c_str(), "etag:", 5) == 0) {
+            //Значение ETag сравнивается точно: без перевода в нижний регистр
+            size_t from = line.find_first_not_of(' ', 5);
+            size_t to = line.find_last_not_of("\r ");
+            if(from != std::string::npos && to >= from) {
+                etag->assign(line, from, to - from + 1);
+            }
+        }
+        for(auto &c : line) {
+            c = std::tolower(static_cast<unsigned char>(c));
+        }
+        if(line.compare(0, 15, "content-length:") == 0) {
+            length = ::atol(line.c_str() + 15);
+        } else if(line.compare(0, 11, "connection:") == 0) {
+            closed = line.find("close") != std::string::npos;
+        }
+    }
+    buf.erase(0, head_end + 4);
+    if(code == 304) {
+        //Ответ "не изменилось" не имеет тела
+        length = 0;
+    }
+    if(length < 0) {
+        //Старый сервер: тело - до закрытия соединения
+        int r;
+        while((r = recv_more(sockfd, buf)) == 0) {
+            ;
+        }
+        closed = true;
+        body.swap(buf);
+        buf.clear();
+        return r == 2 ? 0 : (r == 1 ? 1 : -1);
+    }
+    while(buf.size() < size_t(length)) {
+        int r = recv_more(sockfd, buf);
+        if(r != 0) {
+            return r == 1 ? 1 : -1;
+        }
+    }
+    body.assign(buf, 0, length);
+    buf.erase(0, length);
+    return 0;
+}
+
+/**
+ * Отправка запроса в постоянное соединение и получение ответа.
+ * При необходимости соединение открывается заново; если сервер успел
+ * закрыть простаивавшее соединение, запрос повторяется один раз.
+ * Параметры:
+ *   const sockaddr_in &serv_addr - адрес сервера
+ *   long timeout - таймаут ожидания ответа, мс
+ *   int &sockfd - сокет соединения, <0 - нет соединения
+ *   std::string &buf - принятые, но ещё не разобранные данные
+ *   const std::string &request - текст запроса
+ *   int &code, std::string &status, std::string &body - ответ
+ *   std::string *etag - если не nullptr - ETag ответа
+ * Возвращаемое значение:
+ *   0 - ответ получен
+ *   1 - истёк таймаут
+ *   -1 - ошибка
+ */
+int
+http_exchange(
+    const sockaddr_in &serv_addr,
+    long timeout,
+    int &sockfd,
+    std::string &buf,
+    const std::string &request,
+    int &code,
+    std::string &status,
+    std::string &body,
+    std::string *etag = nullptr
+) {
+    for(int attempt = 0; attempt < 2; ++attempt) {
+        bool fresh = sockfd < 0;
+        if(fresh) {
+            if((sockfd = connect_server(serv_addr, timeout)) < 0) {
+                return -1;
+            }
+            buf.clear();
+        }
+        bool closed = true;
+        int r = -1;
+        if(send_all(sockfd, request)) {
+            r = recv_response(sockfd, buf, code, status, body, closed, etag);
+        }
+        if(r != 0 || closed) {
+            ::close(sockfd);
+            sockfd = -1;
+        }
+        //Повторять имеет смысл, только если сервер не прислал ничего
+        //в уже открытое ранее соединение
+        if(r < 0 && buf.empty() && !fresh) {
+            continue;
+        }
+        return r;
+    }
+    return -1;
+}
+
+/**
+ * Одно соединение нагрузочного теста.
+ * Соединение постоянное, если сервер его не закрывает.
+ * При заданной частоте запросы отправляются по расписанию, и задержка
+ * отсчитывается от запланированного, а не фактического момента отправки
+ * (поправка на coordinated omission).
+ * Параметры:
+ *   const sockaddr_in &serv_addr - адрес сервера
+ *   const std::vector<std::string> &corpus - готовые тексты запросов GET
+ *   const LoadParams &p - параметры теста
+ *   int index - номер соединения
+ *   std::chrono::steady_clock::time_point start - момент начала теста
+ *   LoadStats &st - результаты соединения
+ */
+void
+load_worker(
+    const sockaddr_in &serv_addr,
+    const std::vector<std::string> &corpus,
+    const LoadParams &p,
+    int index,
+    std::chrono::steady_clock::time_point start,
+    LoadStats &st
+) {
+    using clock = std::chrono::steady_clock;
+    auto deadline = start + std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(p.duration));
+    //Интервал между запросами одного соединения; соединения сдвинуты
+    //друг относительно друга, чтобы не отправлять запросы пачками
+    clock::duration interval{};
+    clock::time_point next = start;
+    if(p.rate > 0) {
+        interval = std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(p.conns / p.rate));
+        next += interval * index / p.conns;
+    }
+    int sockfd = -1;
+    std::string buf;
+    std::string status;
+    std::string body;
+    size_t k = index;
+    while(true) {
+        clock::time_point intended;
+        if(p.rate > 0) {
+            intended = next;
+            next += interval;
+            if(intended >= deadline) {
+                break;
+            }
+            std::this_thread::sleep_until(intended);
+        } else {
+            intended = clock::now();
+            if(intended >= deadline) {
+                break;
+            }
+        }
+        int code = 0;
+        int r = http_exchange(serv_addr, p.timeout, sockfd, buf, corpus[k++ % corpus.size()],
+                code, status, body);
+        if(r == 1) {
+            ++st.timeouts;
+        } else if(r == 0 && code == 200 && body.find("@@ERROR") == std::string::npos) {
+            ++st.ok;
+            st.latencies.push_back(
+                    std::chrono::duration<double, std::milli>(clock::now() - intended).count());
+        } else {
+            ++st.errors;
+            if(r < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+    }
+    if(sockfd >= 0) {
+        ::close(sockfd);
+    }
+}
+
+//Значение перцентиля q (0..1) по упорядоченной выборке
+double percentile(const std::vector<double> &sorted, double q) {
+    if(sorted.empty()) {
+        return 0;
+    }
+    size_t i = size_t(q * sorted.size());
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+/**
+ * Нагрузочный тест: p.conns соединений отправляют запросы из corpus
+ * по кругу в течение p.duration секунд. Итог выводится одной строкой JSON.
+ * Возвращаемое значение:
+ *   EXIT_SUCCESS - был хотя бы один успешный ответ
+ *   EXIT_FAILURE - иначе
+ */
+int
+load_test(
+    const sockaddr_in &serv_addr,
+    const std::vector<std::string> &corpus,
+    const LoadParams &p
+) {
+    std::vector<LoadStats> stats(p.conns);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < p.conns; ++i) {
+        workers.emplace_back(load_worker, std::cref(serv_addr), std::cref(corpus),
+                std::cref(p), i, start, std::ref(stats[i]));
+    }
+    for(auto &w : workers) {
+        w.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LoadStats total;
+    for(auto &st : stats) {
+        total.latencies.insert(total.latencies.end(), st.latencies.begin(), st.latencies.end());
+        total.ok += st.ok;
+        total.errors += st.errors;
+        total.timeouts += st.timeouts;
+    }
+    std::sort(total.latencies.begin(), total.latencies.end());
+    double mean = 0;
+    for(double l : total.latencies) {
+        mean += l;
+    }
+    if(!total.latencies.empty()) {
+        mean /= total.latencies.size();
+    }
+
+    std::cout << "{\"mode\":\"" << (p.rate > 0 ? "open" : "closed") << "\""
+              << ",\"connections\":" << p.conns
+              << ",\"rate\":" << p.rate
+              << ",\"duration_s\":" << elapsed
+              << ",\"requests\":" << total.ok + total.errors + total.timeouts
+              << ",\"ok\":" << total.ok
+              << ",\"errors\":" << total.errors
+              << ",\"timeouts\":" << total.timeouts
+              << ",\"throughput_rps\":" << total.ok / elapsed
+              << ",\"co_corrected\":" << (p.rate > 0 ? "true" : "false")
+              << ",\"latency_ms\":{"
+              << "\"mean\":" << mean
+              << ",\"p50\":" << percentile(total.latencies, 0.50)
+              << ",\"p90\":" << percentile(total.latencies, 0.90)
+              << ",\"p99\":" << percentile(total.latencies, 0.99)
+              << ",\"p999\":" << percentile(total.latencies, 0.999)
+              << ",\"max\":" << (total.latencies.empty() ? 0 : total.latencies.back())
+              << "}}" << std::endl;
+    return total.ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 /**
  * Параметры
- *   argv[1] - имя хоста сервера в виде host:port
+ *   -c conns - нагрузочный тест: количество одновременных соединений
+ *   -r rate - нагрузочный тест: общая частота запросов в секунду
+ *             (по умолчанию - замкнутый цикл без пауз)
+ *   -d seconds - длительность нагрузочного теста; включает нагрузочный режим
+ *   -t msec - таймаут ожидания ответа
+ *   -i seconds - повторять запросы по всем файлам с этим интервалом
+ *             (опрос); повторный запрос файла передаёт ETag прежнего
+ *             ответа, и неизменившийся результат не пересылается
+ *   host[:port] - имя хоста сервера
  *             port по умолчанию = 12347
  *             Имя сервера задавать обязательно.
- *   argv[2....n] - имена текстовых файлов, содержащих запросы
- *             Необходимо указать хотябы 1 файл
+ *   file1 [file2 [...]] - имена текстовых файлов, содержащих запросы
+ *             Необходимо указать хотябы 1 файл.
+ *             В нагрузочном режиме - набор запросов, отправляемых по кругу
  */
 int main(int argc, char *argv[]) {
-    if(argc < 2) {
+    LoadParams load;
+    double interval = 0;
+    int opt;
+    while((opt = ::getopt(argc, argv, "c:r:d:t:i:")) != -1) {
+        switch(opt) {
+            case 'c': load.conns = std::max(1, ::atoi(optarg)); break;
+            case 'r': load.rate = ::atof(optarg); break;
+            case 'd': load.duration = ::atof(optarg); break;
+            case 't': load.timeout = ::atol(optarg); break;
+            case 'i': interval = ::atof(optarg); break;
+            default: optind = argc; break;
+        }
+    }
+
+    if(argc - optind < 2) {
         std::cout <<
-        "Usage: mgt-client-http host[:port] file1 [file2 [...]]" <<std::endl;
+        "Usage: mgt-client-http [-c conns] [-r rate] [-d seconds] [-t msec] [-i seconds]"
+        " host[:port] file1 [file2 [...]]" <<std::endl;
         return EXIT_FAILURE;
     }
+    //Дальше аргументы разбираются так же, как без ключей
+    argv += optind - 1;
+    argc -= optind - 1;
 
     in_port_t port = DEFAULT_PORT;
     {
@@ -222,86 +671,99 @@ int main(int argc, char *argv[]) {
         perror("Invalid address");
         return EXIT_FAILURE;
     }
-   
-    for(int i = 2; i < argc; i++) {
-        //Открыть файл запроса
-        std::string point(argv[i]);
-        std::ifstream infile(point);
-        if(!infile.is_open()) {
-            perror("open");
-            continue;
-        }
 
-        //Создать сокет
-        int client_socket;
-        if ((client_socket = ::socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-            perror("Create socket");
-            return EXIT_FAILURE;
+    if(load.duration > 0) {
+        //Подготовить набор запросов GET; каждый запрос - один файл целиком
+        std::vector<std::string> corpus;
+        for(int i = 2; i < argc; i++) {
+            std::string point(argv[i]);
+            std::ifstream infile(point);
+            if(!infile.is_open()) {
+                perror("open");
+                continue;
+            }
+            std::ostringstream request;
+            http_GET_request(infile, request, point, host, port);
+            corpus.push_back(request.str());
         }
-
-        //Подключиться к серверу
-        if (::connect(client_socket, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-            perror("Connection Failed");
+        if(corpus.empty()) {
             return EXIT_FAILURE;
         }
+        return load_test(serv_addr, corpus, load);
+    }
+   
+    //Все запросы отправляются в одно постоянное соединение
+    int client_socket = -1;
+    std::string buf;
+    //Последний ответ по каждому файлу: ETag и тело, которое выводится,
+    //если сервер ответил 304 - результат не изменился
+    struct Last {
+        std::string etag;
+        std::string body;
+    };
+    std::map<std::string, Last> last;
+    while(true) {
+        for(int i = 2; i < argc; i++) {
+            //Открыть файл запроса
+            std::string point(argv[i]);
+            std::ifstream infile(point);
+            if(!infile.is_open()) {
+                perror("open");
+                continue;
+            }
 
-        //Назначить таймауты для приёма и отправки данных
-        sock_read_timeout(client_socket, DEFAULT_READ_TIMEOUT);
-        sock_write_timeout(client_socket, DEFAULT_WRITE_TIMEOUT);
-
-        //Создать поток для чтения данных из сокета
-        __gnu_cxx::stdio_filebuf<char> inbuf(client_socket, std::ios::in);
-        std::istream in(&inbuf);
-
-        //Создать поток для записи данных в сокет
-        __gnu_cxx::stdio_filebuf<char> outbuf(client_socket, std::ios::out);
-        std::ostream out(&outbuf);
-
-        //Отправить запрос
-        if(!http_GET_request(infile, out, point, host, port)) {
-            perror("Error sending http request");
-            return EXIT_FAILURE;
-        }
-        //Сбросить выходной поток, и, возможно, подождать отправки данных
-        std::flush(out);
-
-        //ЧТЕНИЕ ОТВЕТА
-
-        std::string buf;
-        int code;
-        std::string status;
-        //Первая строка имеет какой-то смысл
-        //Например:
-        //HTTP/1.1 200 OK - всё в порядке
-        //         400 Bad Request - Ошибка текста запроса
-        //         404 Not Found - Страница не найдена
-        // ....
-
-        //Пропустить HTTP/1.1 и считать код завершения
-        in >>buf >>code;
-        //Прочитать остатьо строки.
-        //Там ещё только пробел в начале и \r в конце
-        std::getline(in, buf);
-        //Сформировать новую строку без лишних символов
-        status = buf.substr(1, buf.size()-2);
+            //Сформировать запрос
+            Last &known = last[point];
+            std::ostringstream request;
+            if(!http_GET_request(infile, request, point, host, port, known.etag)) {
+                perror("Error sending http request");
+                return EXIT_FAILURE;
+            }
 
-        //Остальную часть ответа можно пропустить до пустой строки:
-        while(std::getline(in, buf)) {
-            if(buf.begin()[0] == '\r') {
-                break;
+            //Отправить запрос и прочитать ответ
+            int code;
+            std::string status;
+            std::string body;
+            std::string etag;
+            //Первая строка ответа имеет какой-то смысл
+            //Например:
+            //HTTP/1.1 200 OK - всё в порядке
+            //         304 Not Modified - результат не изменился
+            //         400 Bad Request - Ошибка текста запроса
+            //         404 Not Found - Страница не найдена
+            // ....
+            if(http_exchange(serv_addr, DEFAULT_READ_TIMEOUT, client_socket, buf, request.str(),
+                    code, status, body, &etag) != 0) {
+                perror("Connection Failed");
+                return EXIT_FAILURE;
             }
-        }
 
-        if(code == 200) { //OK
-            //Дальше - данные
-            while(std::getline(in, buf)) {
-                std::cout <<buf <<std::endl;
+            if(code == 304) {
+                body = known.body;
+                code = 200;
+            } else if(code == 200) {
+                known.etag = etag;
+                known.body = body;
+            }
+            if(code == 200) { //OK
+                //Дальше - данные
+                std::cout <<body;
+                if(!body.empty() && body.back() != '\n') {
+                    std::cout <<std::endl;
+                }
+            } else {
+                //Сообщить о неудачном завершении обмена
+                std::cout <<"HTTP error code: " <<code <<" \"" <<status <<"\""<<std::endl;
             }
-        } else {
-            //Сообщить о неудачном завершении обмена
-            std::cout <<"HTTP error code: " <<code <<" \"" <<status <<"\""<<std::endl;
         }
-        //Закрыть клиентский сокет
+        if(interval <= 0) {
+            break;
+        }
+        std::cout <<std::flush;
+        std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+    }
+    //Закрыть клиентский сокет
+    if(client_socket >= 0) {
         ::close(client_socket);
     }
 
@@ -0,0 +1,179 @@
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <sstream>
+
+#include "mgt.h"
+
+/**
+ * Хэш графа для кэша результатов. Поток байтов обрабатывается словами
+ * по 8 байт в двух независимых полосах по 64 бита; слово смешивается
+ * с полосой умножением 64x64->128 и сложением половин произведения.
+ * Хэш быстрый, но не криптографический.
+ */
+static const uint64_t K0 = 0xa0761d6478bd642full;
+static const uint64_t K1 = 0xe7037ed1a0b428dbull;
+static const uint64_t K2 = 0x8ebc6af09c88c6e3ull;
+static const uint64_t K3 = 0x589965cc75374cc3ull;
+
+static uint64_t mix(uint64_t a, uint64_t b) {
+    hash_t r = hash_t(a) * b;
+    return uint64_t(r) ^ uint64_t(r >> 64);
+}
+
+/**
+ * Потоковый хэш
+ *   uint64_t a, b : полосы
+ *   uint64_t size : обработано байт
+ */
+struct Hasher {
+    uint64_t a = K0;
+    uint64_t b = K1;
+    uint64_t size = 0;
+
+    void word(uint64_t w) {
+        a = mix(a ^ w, K2);
+        b = mix(b + w, K3) ^ a;
+        size += 8;
+    }
+
+    //Байты с длиной впереди: соседние строки не склеиваются
+    void bytes(const char *p, size_t n) {
+        word(n);
+        for(; n >= 8; p += 8, n -= 8) {
+            uint64_t w;
+            std::memcpy(&w, p, 8);
+            word(w);
+        }
+        uint64_t w = 0;
+        std::memcpy(&w, p, n);
+        word(w);
+    }
+
+    hash_t done() const {
+        uint64_t x = mix(a ^ size, b ^ K0);
+        uint64_t y = mix(b ^ x, a ^ K1);
+        return hash_t(x) << 64 | y;
+    }
+};
+
+hash_t graph_hash(const Graph &g, const Values &v, const Options &opts) {
+    //Сумма хэшей узлов не зависит от порядка узлов в g,
+    //а соседи каждого узла уже упорядочены
+    hash_t sum = 0;
+    for(auto &[name, links] : g) {
+        Hasher h;
+        h.bytes(name.data(), name.size());
+        h.word(v.value[v.index.find(name)->second]);
+        for(auto &to : links) {
+            h.bytes(to.data(), to.size());
+        }
+        sum += h.done();
+    }
+    Hasher h;
+    h.word(uint64_t(sum));
+    h.word(uint64_t(sum >> 64));
+    h.word(g.size());
+    h.word(opts.top);
+    h.word(opts.all);
+    h.word(opts.edges);
+    return h.done();
+}
+
+//Объём записи: текст и узлы списка и индекса
+static size_t entry_bytes(const CacheEntry &e) {
+    return sizeof(CacheEntry) + sizeof(std::string) + e.text->capacity() + 8 * sizeof(void *);
+}
+
+//Сохранение результата с вытеснением давних записей
+//(результат больше всего кэша не сохраняется); вызывается под блокировкой
+static void cache_put(ResultCache &c, hash_t key, std::shared_ptr<const std::string> text) {
+    if(c.index.count(key)) {
+        return;
+    }
+    CacheEntry e{key, std::move(text)};
+    size_t size = entry_bytes(e);
+    if(size > c.capacity) {
+        return;
+    }
+    while(c.bytes + size > c.capacity) {
+        c.bytes -= entry_bytes(c.lru.back());
+        c.index.erase(c.lru.back().key);
+        c.lru.pop_back();
+    }
+    c.lru.push_front(std::move(e));
+    c.index[key] = c.lru.begin();
+    c.bytes += size;
+}
+
+CacheResult cache_answer(ResultCache &c, hash_t key, std::ostream &out,
+        const std::function<void(std::ostream &)> &calc) {
+    std::unique_lock<std::mutex> lock(c.mutex);
+    while(true) {
+        auto it = c.index.find(key);
+        if(it != c.index.end()) {
+            ++c.hits;
+            c.lru.splice(c.lru.begin(), c.lru, it->second);
+            std::shared_ptr<const std::string> text = it->second->text;
+            lock.unlock();
+            out << *text;
+            return CACHE_HIT;
+        }
+        auto f = c.flights.find(key);
+        if(f == c.flights.end()) {
+            break;
+        }
+        //Такой же запрос уже считается: ждать его результата
+        std::shared_ptr<Flight> other = f->second;
+        c.landed.wait(lock, [&]() { return other->done || other->failed; });
+        if(other->done) {
+            ++c.joined;
+            std::shared_ptr<const std::string> text = other->text;
+            lock.unlock();
+            out << *text;
+            return CACHE_JOINED;
+        }
+        //Расчёт прерван: считать самому, если никто не начал снова
+    }
+
+    ++c.misses;
+    auto flight = std::make_shared<Flight>();
+    c.flights[key] = flight;
+    lock.unlock();
+
+    std::ostringstream text;
+    try {
+        calc(text);
+    } catch(...) {
+        lock.lock();
+        flight->failed = true;
+        c.flights.erase(key);
+        c.landed.notify_all();
+        throw;
+    }
+    auto result = std::make_shared<const std::string>(text.str());
+
+    lock.lock();
+    cache_put(c, key, result);
+    flight->text = result;
+    flight->done = true;
+    c.flights.erase(key);
+    c.landed.notify_all();
+    lock.unlock();
+    out << *result;
+    return CACHE_MISS;
+}
+
+CacheStats cache_stats(ResultCache &c) {
+    std::lock_guard<std::mutex> lock(c.mutex);
+    return {c.hits, c.misses, c.joined, c.lru.size(), c.bytes};
+}
+
+void cache_print(ResultCache &c, std::ostream &out) {
+    CacheStats st = cache_stats(c);
+    out << "{'hits': " << st.hits
+        << ", 'misses': " << st.misses
+        << ", 'joined': " << st.joined
+        << ", 'entries': " << st.entries
+        << ", 'bytes': " << st.bytes << "}";
+}
@@ -2,10 +2,15 @@
 #include <limits>
 #include <map>
 #include <set>
-#include <list>
+#include <vector>
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <iterator>
+#include <cctype>
+#include <type_traits>
+#include <string_view>
+#include <strings.h>
 #include "mgt.h"
 
 
@@ -17,109 +22,189 @@ void print_cont(Container c) {
     }
 }
 
-//Поиск точек сочленения, точек, лежащих в одной компоненте связности, суммы по одной компоненте связности.
-value_t dfs (
-        Graph &g,
-        std::set<std::string> &used,
-        Values& v,
-        std::set<std::string> &cutpoints,
-        std::string node,
-        int comp_id,
-        std::string parent = {}
-        ) {
-    v[node].comp_id = comp_id;
-    static std::map<std::string, int> tin;
-    static std::map<std::string, int> fup;
-    static int timer;
-    value_t value = 0;
-    used.insert(node);
-    tin[node] = fup[node] = timer++;
-    int children = 0;
-    for (auto to = g[node].begin(); to != g[node].end(); ++to) {
-        if (*to == parent) {
-            continue;
-        }
-        if (used.find(*to) != used.end()) {
-            fup[node] = std::min(fup[node], tin[*to]);
-        }
-        else {
-            value += dfs(g, used, v, cutpoints, *to, comp_id, node);
-            fup[node] = std::min(fup[node], fup[*to]);
-            if (fup[*to] >= tin[node] && !parent.empty()) {
-                cutpoints.insert(node);
-                v[node].is_cutp = true;
-            }
-            ++children;
-        }
+Values::Values(const allocator_type &a)
+    : index(a), names(a), value(a), comp_id(a), flags(a), tin(a), low(a), sub(a), up(a),
+      cut(a) {}
+
+//Имена узлов - ключи index: после копирования или переноса index они указывают на старые ключи
+static void values_relink(Values &v) {
+    for(auto &[name, id] : v.index) {
+        v.names[id] = &name;
     }
-    if (parent.empty() && children > 1) {
-        cutpoints.insert(node);
-        v[node].is_cutp = true;
+}
+
+Values::Values(const Values &v, const allocator_type &a)
+    : index(v.index, a), names(v.names, a), value(v.value, a), comp_id(v.comp_id, a),
+      flags(v.flags, a), tin(v.tin, a), low(v.low, a), sub(v.sub, a), up(v.up, a),
+      cut(v.cut, a) {
+    values_relink(*this);
+}
+
+Values &Values::operator=(const Values &v) {
+    return *this = Values(v, get_allocator());
+}
+
+Values &Values::operator=(Values &&v) {
+    index = std::move(v.index);
+    names = std::move(v.names);
+    value = std::move(v.value);
+    comp_id = std::move(v.comp_id);
+    flags = std::move(v.flags);
+    tin = std::move(v.tin);
+    low = std::move(v.low);
+    sub = std::move(v.sub);
+    up = std::move(v.up);
+    cut = std::move(v.cut);
+    //При разных аллокаторах ключи index переносятся поэлементно
+    values_relink(*this);
+    return *this;
+}
+
+int node_add(Values &v, const Name &name, value_t value) {
+    auto [it, added] = v.index.insert({name, (int)v.names.size()});
+    if(!added) {
+        return it->second;
     }
-    return v[node].value + value;
+    v.names.push_back(&it->first);
+    v.value.push_back(value);
+    v.comp_id.push_back(-1);
+    v.flags.push_back(0);
+    v.tin.push_back(-1);
+    v.low.push_back(0);
+    v.sub.push_back(0);
+    v.up.push_back(-1);
+    v.cut.push_back(0);
+    return it->second;
 }
 
 //Разделение исходного графа на компоненты связности
 void make_components(Graph &g, Values &v, Components &comps) {
+    //Узлы без связей, но с весом, - отдельные компоненты
+    for(size_t id = 0; id < v.size(); ++id) {
+        g[*v.names[id]];
+    }
+    std::vector<int> stack;
     for(auto &[name, links] : g) {
-        if(v[name].comp_id == -1) {
-            Component c;
-            int comp_id = 0;
-            c.value = dfs(g, c.names, v, c.cutpoints, name, comp_id);
-            ++comp_id;
-            comps.push_back(c);
+        int root = node_add(v, name);
+        if(v.comp_id[root] != -1) {
+            continue;
         }
+        Component c(comps.get_allocator());
+        int comp_id = comps.size();
+        v.comp_id[root] = comp_id;
+        stack.push_back(root);
+        while(!stack.empty()) {
+            int cur = stack.back();
+            stack.pop_back();
+            c.nodes.push_back(cur);
+            c.value += v.value[cur];
+            for(auto &to : g.find(*v.names[cur])->second) {
+                int next = node_add(v, to);
+                if(v.comp_id[next] == -1) {
+                    v.comp_id[next] = comp_id;
+                    stack.push_back(next);
+                }
+            }
+        }
+        comps.push_back(std::move(c));
     }
 }
 
-//Объединение смежных вершин, не являющихся точками сочленения, в одну.
-void reduce_comp(Graph &g, Values &v, Component &c, std::string predator) {
-    value_t value = 0;
+/**
+ * Кадр обхода в глубину
+ *   int node : узел
+ *   int parent : родитель в дереве обхода (-1 - корень)
+ *   link, end : следующая непросмотренная связь и конец списка связей
+ *   value_t cut : суммарный вес поддеревьев, отделяемых узлом
+ *   Acc squares : сумма квадратов весов этих поддеревьев
+ *   int children : количество потомков в дереве обхода
+ *   int separated : количество поддеревьев, отделяемых узлом
+ */
+template<typename Acc>
+struct Frame {
+    int node;
+    int parent;
+    std::pmr::set<Name>::const_iterator link;
+    std::pmr::set<Name>::const_iterator end;
+    value_t cut{};
+    Acc squares{};
+    int children{};
+    int separated{};
+};
 
-    std::list<std::string> to_check(g[predator].begin(), g[predator].end());
+//Квадрат веса в разрядности Acc
+template<typename Acc>
+static Acc square(value_t x) {
+    return Acc(x) * x;
+}
 
-    for(auto it = to_check.begin(); it != to_check.end();) {
-        auto victim = *it;
-        auto next = std::next(it);
-        if(!v[victim].is_cutp && !v[victim].is_reduced) {
-            value += v[victim].value;
-            for(auto future_victim : g[victim]) {
-                if(future_victim != predator) {
-                    g[predator].insert(future_victim);
-                    to_check.push_back(future_victim);
-                    g[future_victim].erase(victim);
-                    g[future_victim].insert(predator);
-                }
-            }
-            g[predator].erase(victim);
-            g.erase(victim);
-            v[victim].is_reduced = true;
-        }
-        it = next;
-    }
-    v[predator].sum = v[predator].value + value;
+//Сумма квадратов весов частей компоненты веса w_comp без узла id плюс вес узла
+template<typename Acc>
+static Acc node_local(const Values &v, const Squares<Acc> &sq, int id, value_t w_comp) {
+    //Остаток компоненты - часть, в которой лежит родитель
+    value_t rest = w_comp - v.value[id] - v.cut[id];
+    return sq.squares[id] + square<Acc>(rest) + v.value[id];
 }
 
-//Объединение всех групп смежных точек, не являющихся точками сочленения в одну (на каждую группу)
-void reduce(Graph &g, Values &v, Component &c) {
-    for(auto name : c.names) {
-        if(!v[name].is_cutp && !v[name].is_reduced) {
-            reduce_comp(g, v, c, name);
+//Поиск точек сочленения компоненты и частей, на которые она распадается при удалении узла
+template<typename Acc>
+static void analyze_comp(Graph &g, Values &v, Component &c, Squares<Acc> &sq) {
+    //Обход без рекурсии: глубина дерева обхода может достигать размера компоненты.
+    //Только find(): контейнеры общие для параллельно обрабатываемых компонент
+    int timer = 0;
+    std::vector<Frame<Acc>> stack;
+    auto enter = [&](int id, int parent) {
+        v.tin[id] = v.low[id] = timer++;
+        v.sub[id] = v.value[id];
+        auto &links = g.find(*v.names[id])->second;
+        stack.push_back({id, parent, links.cbegin(), links.cend()});
+    };
+    enter(c.nodes[0], -1);
+    while(!stack.empty()) {
+        Frame<Acc> &f = stack.back();
+        if(f.link != f.end) {
+            int to = v.index.find(*f.link++)->second;
+            if(to == f.node || to == f.parent) {
+                continue;
+            }
+            if(v.tin[to] != -1) {
+                v.low[f.node] = std::min(v.low[f.node], v.tin[to]);
+            } else {
+                ++f.children;
+                enter(to, f.node);
+            }
+            continue;
         }
-    }
-}
 
-//Подсчет эффективности подсети
-value_t count_graph(Graph &g, Values &v, Component &c, std::set<std::string> &used,
-        std::string name) {
-    value_t counter = 0;
-    used.insert(name);
-    for(auto link : g[name]) {
-        if(used.find(link) == used.end()) {
-            counter += count_graph(g, v, c, used, link);
+        //Все связи узла просмотрены
+        int id = f.node;
+        v.cut[id] = f.cut;
+        sq.squares[id] = f.squares;
+        sq.local[id] = node_local(v, sq, id, c.value);
+        unsigned char flags = (f.parent != -1 ? f.separated > 0 : f.children > 1) ? NODE_CUTP : 0;
+        if(flags & NODE_CUTP) {
+            c.cutpoints.push_back(id);
+        }
+        stack.pop_back();
+        if(!stack.empty()) {
+            Frame<Acc> &p = stack.back();
+            v.sub[p.node] += v.sub[id];
+            v.low[p.node] = std::min(v.low[p.node], v.low[id]);
+            v.up[id] = p.node;
+            //Поддерево узла не связано с предками родителя в обход родителя
+            if(v.low[id] >= v.tin[p.node]) {
+                flags |= NODE_SEP;
+                ++p.separated;
+                p.cut += v.sub[id];
+                p.squares += square<Acc>(v.sub[id]);
+            }
+            //Связь с родителем - мост: из поддерева нет связей выше самого узла
+            if(v.low[id] > v.tin[p.node]) {
+                c.bridges.push_back({p.node, id});
+            }
         }
+        v.flags[id] = flags;
     }
-    return counter + v[name].sum;
 }
 
 //Отладочная печать графа и вершин
@@ -133,18 +218,18 @@ void print_gnv(Graph &g, Values &v) {
         std::cout << std::endl;
     }
     std::cout << "Nodes:" << std::endl;
-    for(auto &[name, node] : v) {
-        std::cout << name << " - " << node.value << std::endl;
+    for(size_t id = 0; id < v.size(); ++id) {
+        std::cout << *v.names[id] << " - " << v.value[id] << std::endl;
     }
 }
 
 //Отладочная печать компонент связности
-void print_comps(Components &comps) {
+void print_comps(Components &comps, Values &v) {
     int i = 0;
-    for(auto comp : comps) {
+    for(auto &comp : comps) {
         std::cout << "comp " << i << ", value " << comp.value << ": ";
-        for(auto name : comp.names) {
-            std::cout << name << " ";
+        for(auto id : comp.nodes) {
+            std::cout << *v.names[id] << " ";
         }
         std::cout << std::endl;
         ++i;
@@ -154,142 +239,404 @@ void print_comps(Components &comps) {
 //Отладочная печать всех точек сочленения
 void print_cutps(Values &v) {
     std::cout << "cutpoints: ";
-    for(auto &[name, node] : v) {
-        if(node.is_cutp) {
-            std::cout << name << " ";
+    for(size_t id = 0; id < v.size(); ++id) {
+        if(v.flags[id] & NODE_CUTP) {
+            std::cout << *v.names[id] << " ";
         }
     }
     std::cout << std::endl;
 
 }
 
+//Вывод 128-битного числа десятичными цифрами (в стандартной библиотеке его нет)
+static std::ostream &operator<<(std::ostream &out, wide_t x) {
+    char digits[40];
+    char *p = digits + sizeof(digits);
+    *--p = 0;
+    do {
+        *--p = '0' + int(x % 10);
+        x /= 10;
+    } while(x);
+    return out << p;
+}
+
 /**
- * Выполнить разбор данных и формирование графа
- * Параметры:
- *   Graph &graph - граф связей
- *   Values &values - массив значений в узлах
- *   std::istream &in - входной поток
- *   std::ostream &out - выходной поток
- * Возвращаемое значение:
- *   0 - нет ошибок
- *   не 0 - ошибка
+ * Оценка узла
+ *   Acc vitality : оценка
+ *   const Name *name : имя узла
  */
-int
-parse(
-    Graph &graph,
-    Values &values,
-    std::istream &in,
-    std::ostream &out
-) {
-    //...
-    //std::cout <<"Parsing ..." <<std::endl;
-    int ret = ser_in(in, graph, values, out);
-    //std::cout <<"Parsing done" <<std::endl;
-    return ret;
+template<typename Acc>
+struct Score {
+    Acc vitality;
+    const Name *name;
+};
+
+//Порядок оценок: по возрастанию, при равенстве - по имени узла
+template<typename Acc>
+static bool operator<(const Score<Acc> &a, const Score<Acc> &b) {
+    return a.vitality != b.vitality ? a.vitality < b.vitality : *a.name < *b.name;
 }
 
-int process(std::istream &in, std::ostream &out) {
-    Graph graph;
-    Values values;
-    std::map<std::string, value_t> variants;
-    auto min_vitality = std::numeric_limits<value_t>::max();
+/**
+ * Лучшие результаты по пачке компонент
+ *   Acc vitality : минимальная оценка
+ *   std::vector<const Name *> names : узлы с этой оценкой
+ *   std::vector<Score<Acc>> ranked : оценки для вывода с параметрами top/all
+ *                                    (для top - куча из не более чем top лучших)
+ */
+template<typename Acc>
+struct Best {
+    Acc vitality = std::numeric_limits<Acc>::max();
+    std::vector<const Name *> names;
+    std::vector<Score<Acc>> ranked;
+};
 
-    out <<"[";
-    if(parse(graph, values, in, out) != 0) {
-        out << "]" <<std::endl;
-        return -1;
+//Учесть оценку узла в лучших результатах
+template<typename Acc>
+static void keep_best(Best<Acc> &b, const Options &opts, Score<Acc> s) {
+    if(opts.all) {
+        b.ranked.push_back(s);
+    } else if(opts.top) {
+        //Куча с наихудшей из отобранных оценок в вершине
+        if(b.ranked.size() < opts.top) {
+            b.ranked.push_back(s);
+            std::push_heap(b.ranked.begin(), b.ranked.end());
+        } else if(s < b.ranked.front()) {
+            std::pop_heap(b.ranked.begin(), b.ranked.end());
+            b.ranked.back() = s;
+            std::push_heap(b.ranked.begin(), b.ranked.end());
+        }
+    } else {
+        if(s.vitality < b.vitality) {
+            b.vitality = s.vitality;
+            b.names.clear();
+        }
+        if(s.vitality == b.vitality) {
+            b.names.push_back(s.name);
+        }
     }
+}
 
-    Components comps;
-    make_components(graph, values, comps);
+/**
+ * Вывод элементов результата: узлы с наименьшей оценкой 'A', 'C' или,
+ * с параметрами top/all, узлы с оценками по возрастанию ('A', 12), ('C', 14)
+ */
+template<typename Acc>
+static void print_best(std::ostream &out, std::vector<Best<Acc>> &best, const Options &opts) {
+    if(opts.all || opts.top) {
+        std::vector<Score<Acc>> ranked;
+        for(auto &b : best) {
+            ranked.insert(ranked.end(), b.ranked.begin(), b.ranked.end());
+        }
+        size_t count = opts.all ? ranked.size() : std::min(opts.top, ranked.size());
+        std::nth_element(ranked.begin(), ranked.begin() + count, ranked.end());
+        std::sort(ranked.begin(), ranked.begin() + count);
+        for(size_t i = 0; i < count; ++i) {
+            out << (i ? ", " : "") << "(\'" << *ranked[i].name << "\', " << ranked[i].vitality << ")";
+        }
+        return;
+    }
 
-    for(auto c : comps) {
-        reduce(graph, values, c);
+    Best<Acc> result;
+    for(auto &b : best) {
+        if(b.vitality < result.vitality) {
+            result.vitality = b.vitality;
+            result.names.clear();
+        }
+        if(b.vitality == result.vitality) {
+            result.names.insert(result.names.end(), b.names.begin(), b.names.end());
+        }
     }
+    std::sort(result.names.begin(), result.names.end(),
+            [](const Name *a, const Name *b) { return *a < *b; });
 
-    for(auto &[name, links] : graph) {
-        if(values[name].is_cutp) {
-            values[name].sum = values[name].value;
+    bool is_only_answer = true;
+    for(auto name : result.names) {
+        if(is_only_answer) {
+            out << "\'" << *name << "\'";
+            is_only_answer = false;
+        } else {
+            out << ", \'" << *name << "\'";
         }
     }
+}
 
-    for(auto &[name, node] : values) {
-        value_t vitality = 0;
-        int comp_id = 0;
-        for(auto comp : comps) {
-            if(comp_id == node.comp_id) {
-                value_t result;
-                if(!node.is_cutp) {
-                    result = comp.value - node.value;
-                    vitality += result * result;
-                } else {
-                    std::set<std::string> used;
-                    used.insert(name);
-                    result = 0;
-                    for(auto link : graph[name]) {
-                        if(used.find(link) == used.end()) {
-                            result = count_graph(graph, values, comp, used, link);
-                            vitality += result * result;
-                        }
-                    }
-                }
-            } else {
-                vitality += comp.value * comp.value;
+/**
+ * Оценка связи - моста
+ *   Acc vitality : сумма квадратов весов компонент после удаления связи
+ *   const Name *a, *b : концы связи, a < b
+ */
+template<typename Acc>
+struct BridgeScore {
+    Acc vitality;
+    const Name *a;
+    const Name *b;
+};
+
+//Порядок оценок мостов: по возрастанию, при равенстве - по именам концов
+template<typename Acc>
+static bool operator<(const BridgeScore<Acc> &x, const BridgeScore<Acc> &y) {
+    if(x.vitality != y.vitality) {
+        return x.vitality < y.vitality;
+    }
+    return *x.a != *y.a ? *x.a < *y.a : *x.b < *y.b;
+}
+
+//Оценка мостов и вывод лучших, как print_best(): без скобок списка
+template<typename Acc>
+static void print_bridges(std::ostream &out, Components &comps, Values &values, Acc total,
+        const Options &opts) {
+    //Мост делит компоненту на поддерево веса sub и остаток
+    std::vector<BridgeScore<Acc>> ranked;
+    for(auto &c : comps) {
+        Acc others = total - square<Acc>(c.value);
+        for(auto &b : c.bridges) {
+            value_t sub = values.sub[b.to];
+            value_t rest = c.value - sub;
+            BridgeScore<Acc> s{others + square<Acc>(sub) + square<Acc>(rest),
+                    values.names[b.from], values.names[b.to]};
+            if(*s.b < *s.a) {
+                std::swap(s.a, s.b);
             }
-            ++comp_id;
+            ranked.push_back(s);
         }
-        vitality += values[name].value;
-        variants[name] = vitality;
-        if(vitality < min_vitality) {
-            min_vitality = vitality;
+    }
+
+    size_t count = ranked.size();
+    bool scores = opts.all || opts.top;
+    if(!scores && !ranked.empty()) {
+        Acc best = std::min_element(ranked.begin(), ranked.end())->vitality;
+        count = std::partition(ranked.begin(), ranked.end(),
+                [&](const BridgeScore<Acc> &s) { return s.vitality == best; }) - ranked.begin();
+    } else if(!opts.all) {
+        count = std::min(opts.top, count);
+    }
+    std::nth_element(ranked.begin(), ranked.begin() + count, ranked.end());
+    std::sort(ranked.begin(), ranked.begin() + count);
+    for(size_t i = 0; i < count; ++i) {
+        out << (i ? ", " : "") << "(\'" << *ranked[i].a << "\', \'" << *ranked[i].b << "\'";
+        if(scores) {
+            out << ", " << ranked[i].vitality;
         }
+        out << ")";
     }
+}
 
-    bool is_only_answer = true;
-    for(auto& [name, vitality] : variants) {
-        if(vitality == min_vitality) {
-            if(is_only_answer) {
-                out << "\'" << name << "\'";
-                is_only_answer = false;
-            } else {
-                out << ", \'" << name << "\'";
+/**
+ * Оценка всех узлов и вывод результата
+ * Параметры:
+ *   const Squares<Acc> &sq : суммы квадратов весов по узлам и всех компонент
+ */
+template<typename Acc>
+static void print_scores(std::ostream &out, Components &comps, Values &values,
+        const Squares<Acc> &sq, const Options &opts) {
+    if(opts.edges) {
+        print_bridges(out, comps, values, sq.total, opts);
+        out << "]" << std::endl;
+        return;
+    }
+
+    //Оценка узла v из компоненты C:
+    //сумма квадратов весов остальных компонент + Values::local
+    std::vector<Acc> others(comps.size());
+    for(size_t i = 0; i < comps.size(); ++i) {
+        others[i] = sq.total - square<Acc>(comps[i].value);
+    }
+    //Узлы обходятся подряд по номерам: читаются только comp_id и local
+    size_t n = values.size();
+    std::vector<Acc> score(n);
+    std::vector<Best<Acc>> best(1);
+    Best<Acc> &b = best[0];
+    for(size_t i = 0; i < n; ++i) {
+        score[i] = others[values.comp_id[i]] + sq.local[i];
+    }
+    if(opts.all || opts.top) {
+        for(size_t i = 0; i < n; ++i) {
+            keep_best(b, opts, {score[i], values.names[i]});
+        }
+    } else if(n) {
+        b.vitality = *std::min_element(score.begin(), score.end());
+        for(size_t i = 0; i < n; ++i) {
+            if(score[i] == b.vitality) {
+                b.names.push_back(values.names[i]);
             }
         }
     }
+    print_best(out, best, opts);
     out << "]" << std::endl;
+}
 
-    return 0;
+void *ArenaHeap::do_allocate(size_t bytes, size_t align) {
+    taken += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+}
+
+void ArenaHeap::do_deallocate(void *p, size_t bytes, size_t align) {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+}
+
+bool ArenaHeap::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
+
+Arena::Arena(size_t size) : buffer(new char[size]), size(size) {
+    mem.emplace(buffer.get(), size, &heap);
+}
+
+std::pmr::memory_resource *arena_resource(Arena &a) {
+    return &*a.mem;
+}
+
+void arena_reset(Arena &a) {
+    a.mem->release();
+    if(a.heap.taken == 0) {
+        return;
+    }
+    //Запрос не уместился: следующий такой же обойдётся одним буфером
+    a.size += a.heap.taken;
+    a.heap.taken = 0;
+    a.mem.reset();
+    a.buffer.reset(new char[a.size]);
+    a.mem.emplace(a.buffer.get(), a.size, &a.heap);
+}
+
+//Модели запросов - в арене обработчика, переиспользуемой от запроса к запросу
+static thread_local Arena request_arena;
+
+//Расчёт по разобранному графу с ключом key и вывод результата
+//без открывающей скобки; с кэшем - повторный или одновременно
+//считаемый другим обработчиком граф не пересчитывается
+static CacheResult model_answer(Model &m, const Options &opts, hash_t key, std::ostream &out,
+        ResultCache *cache) {
+    auto calc = [&](std::ostream &text) {
+        model_analyze(m);
+        model_print(m, text, opts);
+    };
+    if(cache) {
+        return cache_answer(*cache, key, out, calc);
+    }
+    calc(out);
+    return CACHE_MISS;
+}
+
+int process(std::istream &in, std::ostream &out, ResultCache *cache) {
+    int ret = 0;
+    {
+        Model m(arena_resource(request_arena));
+        Options opts;
+
+        out <<"[";
+        if(ser_in(in, m.graph, m.values, out, &opts) != 0) {
+            out << "]" <<std::endl;
+            ret = -1;
+        } else {
+            model_answer(m, opts, cache ? graph_hash(m.graph, m.values, opts) : 0, out, cache);
+        }
+    }
+    arena_reset(request_arena);
+    return ret;
+}
+
+//Сильный ETag результата по ключу графа: "<32 шестнадцатеричные цифры>"
+static std::string etag_text(hash_t key) {
+    static const char digits[] = "0123456789abcdef";
+    std::string etag(34, '"');
+    for(int i = 32; i > 0; --i, key >>= 4) {
+        etag[i] = digits[unsigned(key) & 15];
+    }
+    return etag;
 }
 
+/**
+ * Проверка значения заголовка If-None-Match: список ETag через запятую
+ * или * - любой результат. ETag сравниваются точно, с учётом регистра;
+ * слабый ETag (W/"...") совпадает с сильным с тем же значением
+ * Параметры:
+ *   std::string_view list - значение заголовка
+ *   const std::string &etag - ETag результата в кавычках
+ * Возвращаемое значение:
+ *   true - ETag результата есть в списке
+ */
+static bool etag_listed(std::string_view list, const std::string &etag) {
+    std::string_view tag(etag);
+    tag = tag.substr(1, tag.size() - 2);
+    while(!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+        size_t begin = item.find_first_not_of(" \t\r");
+        if(begin == std::string_view::npos) {
+            continue;
+        }
+        item = item.substr(begin, item.find_last_not_of(" \t\r") - begin + 1);
+        if(item == "*") {
+            return true;
+        }
+        if(item.compare(0, 2, "W/") == 0) {
+            item.remove_prefix(2);
+        }
+        if(item.size() >= 2 && item.front() == '"' && item.back() == '"') {
+            item = item.substr(1, item.size() - 2);
+        }
+        if(item == tag) {
+            return true;
+        }
+    }
+    return false;
+}
 
 /**
  * Разбор входного потока данных, включая заголовки http,
- * построение графа, рачёт по графу, вывод результатов,
- * в т.ч. заголовкв http
+ * построение графа, рачёт по графу, вывод результатов.
+ * Граф из строки запроса разбирается до заголовков: если в If-None-Match
+ * указан ETag этого графа, расчёт не выполняется.
+ * Заголовки ответа формирует вызывающий: ему нужна длина тела ответа
  * Параметры:
  *   std::istream& in - входной поток
- *   std::ostream& out - выходной поток для вывода результата или ошибок
-     bool keepalive = false - 1=не завершать сеанс после вывода результатов
+ *   std::ostream& out - выходной поток для вывода тела ответа
+ *   bool &keepalive - на входе: сервер разрешает постоянные соединения,
+ *                     на выходе: клиент просит не закрывать соединение
+ *                     (HTTP/1.1 без "Connection: close"
+ *                     или HTTP/1.0 с "Connection: keep-alive")
+ *   ResultCache *cache - если не nullptr - кэш результатов
+ *   std::string &etag - ETag результата (пусто - ошибка разбора, без ETag)
+ *   bool &not_modified - ETag указан в If-None-Match: ответ 304 без тела
+ *   CacheResult &how - откуда результат: из кэша, от такого же запроса
+ *                      в расчёте или рассчитан
  * Возвращаемое значение:
  *   0 - успешно, можно продолжать сеанс
- *   < 0 - ошибка
+ *   < 0 - ошибка; если тело ответа пустое, то запроса не было вовсе
+ *         (клиент закрыл соединение)
  *   > 0 - успешно, завершить сеанс
  */
 int
 process_http_GET(
     std::istream &in,
     std::ostream &out,
-    bool keepalive
+    bool &keepalive,
+    ResultCache *cache,
+    std::string &etag,
+    bool &not_modified,
+    CacheResult &how
 ) {
+    bool allowed = keepalive;
+    keepalive = false;
+    etag.clear();
+    not_modified = false;
+    how = CACHE_MISS;
+
     //Первая строка запроса - это сам запрос
     //GET /path/to/resource?request HTTP/1.*
 
+    //Счётчики строк и символов - для каждого запроса свои,
+    //иначе конец потока после предыдущего запроса считается ошибкой
+    ser_zero_counters();
     //убираем ключевое слово
-    if(ser_expect_char(in, "GET/", out, true) < 0) {
+    if(ser_expect_char(in, "GET/", out, true) != 0) {
         return -1;
     }
     //Считываем има ресурса
-    std::string point; //Ресурс на нашем сервере. Выведем в результате
+    Name point; //Ресурс на нашем сервере. Выведем в результате
     //Всё от начала до знака ? или = - это имя ресурса, читаем её как есть
     if(ser_read_until(in, point, "?=", out) < 0) {
         return -1;
@@ -297,17 +644,62 @@ process_http_GET(
     if(!point.empty()) {
         out <<"'" <<point <<"':";
     }
-    int r = process(in, out);
 
-    //Остальные строки запроса можно игнрировать,
-    //но прочесть надо - до пустой строки включительно
-    std::string buf;
-    while(std::getline(in, buf)) {
-        if(buf.begin()[0] == '\r') {
-            break;
+    int r = 0;
+    {
+        Model m(arena_resource(request_arena));
+        Options opts;
+        hash_t key = 0;
+
+        out <<"[";
+        if(ser_in(in, m.graph, m.values, out, &opts) != 0) {
+            out << "]" <<std::endl;
+            r = -1;
+        } else {
+            key = graph_hash(m.graph, m.values, opts);
+            etag = etag_text(key);
+        }
+
+        //Остаток первой строки - версия протокола,
+        //остальные строки - заголовки до пустой строки включительно
+        std::string buf;
+        bool first = true;
+        while(std::getline(in, buf)) {
+            if(buf.begin()[0] == '\r') {
+                break;
+            }
+            //Имена заголовков - без учёта регистра, значение If-None-Match - с учётом
+            bool match = !first && ::strncasecmp(buf.c_str(), "if-none-match:", 14) == 0;
+            if(match) {
+                if(r == 0) {
+                    not_modified = not_modified || etag_listed(std::string_view(buf).substr(14), etag);
+                }
+                continue;
+            }
+            for(auto &c : buf) {
+                c = std::tolower(static_cast<unsigned char>(c));
+            }
+            if(first) {
+                keepalive = buf.find("http/1.1") != std::string::npos;
+                first = false;
+            } else if(buf.compare(0, 11, "connection:") == 0) {
+                if(buf.find("close") != std::string::npos) {
+                    keepalive = false;
+                } else if(buf.find("keep-alive") != std::string::npos) {
+                    keepalive = true;
+                }
+            }
+        }
+
+        if(r == 0 && !not_modified) {
+            how = model_answer(m, opts, key, out, cache);
         }
     }
+    arena_reset(request_arena);
+
+    keepalive = keepalive && allowed && in;
     if(r < 0) {
+        keepalive = false;
         return -1;
     }
     if(keepalive) {
@@ -316,3 +708,302 @@ process_http_GET(
         return 1; //1 - всё хорошо, но нужно закончить сеанс
     }
 }
+
+int model_build(Model &m, std::istream &in, std::ostream &out, Options *opts) {
+    int ret = ser_in(in, m.graph, m.values, out, opts);
+    if(ret != 0) {
+        return ret;
+    }
+    model_analyze(m);
+    return 0;
+}
+
+//Суммы квадратов модели в разрядности Acc
+template<typename Acc>
+static Squares<Acc> &model_squares(Model &m) {
+    if constexpr(std::is_same_v<Acc, wide_t>) {
+        return m.wide_squares;
+    } else {
+        return m.squares;
+    }
+}
+
+//Вызов f(sq) с суммами квадратов модели в её текущей разрядности
+template<typename F>
+static void with_squares(Model &m, F &&f) {
+    if(m.wide) {
+        f(m.wide_squares);
+    } else {
+        f(m.squares);
+    }
+}
+
+//Суммы квадратов по узлам - на все узлы модели (новые узлы - нулевые)
+template<typename Acc>
+static void squares_fit(const Model &m, Squares<Acc> &sq) {
+    sq.local.resize(m.values.size());
+    sq.squares.resize(m.values.size());
+}
+
+//Повторный поиск точек сочленения и пересчёт оценок компоненты модели
+template<typename Acc>
+static void model_reanalyze(Model &m, Squares<Acc> &sq, int comp_id) {
+    squares_fit(m, sq);
+    Component &c = m.comps[comp_id];
+    c.cutpoints.clear();
+    c.bridges.clear();
+    for(auto id : c.nodes) {
+        m.values.tin[id] = -1;
+        m.values.up[id] = -1;
+    }
+    analyze_comp(m.graph, m.values, c, sq);
+}
+
+//Пересчёт оценок всех компонент модели в разрядности Acc
+template<typename Acc>
+static void model_rescore(Model &m) {
+    Squares<Acc> &sq = model_squares<Acc>(m);
+    sq.total = 0;
+    for(size_t i = 0; i < m.comps.size(); ++i) {
+        Component &c = m.comps[i];
+        c.value = 0;
+        for(auto id : c.nodes) {
+            c.value += m.values.value[id];
+        }
+        model_reanalyze(m, sq, i);
+        sq.total += square<Acc>(c.value);
+    }
+}
+
+void model_analyze(Model &m) {
+    make_components(m.graph, m.values, m.comps);
+    //Разрядность сумм выбирается по весам, как в mgt-single
+    m.wide = needs_wide(m.values);
+    if(m.wide) {
+        model_rescore<wide_t>(m);
+    } else {
+        model_rescore<value_t>(m);
+    }
+}
+
+bool needs_wide(const Values &v, const Weights *changes) {
+    const value_t limit = std::numeric_limits<int>::max();
+    wide_t sum = 0;
+    size_t negative = 0;
+    for(auto w : v.value) {
+        sum += w;
+        negative += w > limit;
+    }
+    if(changes) {
+        for(auto &[name, value] : *changes) {
+            auto it = v.index.find(name);
+            if(it == v.index.end()) {
+                continue;
+            }
+            value_t old = v.value[it->second];
+            sum = sum + value - old;
+            negative = negative + (value > limit) - (old > limit);
+        }
+    }
+    return negative == 0 && sum > std::numeric_limits<unsigned int>::max();
+}
+
+//Изменение весов с пересчётом только затронутых частей, разрядность не меняется
+template<typename Acc>
+static void update_weights_sized(Model &m, Squares<Acc> &sq, const Weights &changes) {
+    Values &v = m.values;
+    std::vector<bool> dirty(m.comps.size());
+    for(auto &[name, value] : changes) {
+        int id = v.index.find(name)->second;
+        value_t delta = value - v.value[id];
+        if(delta == 0) {
+            continue;
+        }
+        v.value[id] = value;
+        //Вес меняется у всех поддеревьев, содержащих узел
+        for(int n = id; n != -1; n = v.up[n]) {
+            value_t old = v.sub[n];
+            v.sub[n] += delta;
+            int up = v.up[n];
+            if(up != -1 && (v.flags[n] & NODE_SEP)) {
+                v.cut[up] += delta;
+                sq.squares[up] += square<Acc>(v.sub[n]) - square<Acc>(old);
+            }
+        }
+        Component &c = m.comps[v.comp_id[id]];
+        sq.total -= square<Acc>(c.value);
+        c.value += delta;
+        sq.total += square<Acc>(c.value);
+        dirty[v.comp_id[id]] = true;
+    }
+    //Части, на которые распадается компонента, изменились для всех её узлов
+    for(size_t i = 0; i < m.comps.size(); ++i) {
+        if(dirty[i]) {
+            for(auto id : m.comps[i].nodes) {
+                sq.local[id] = node_local(v, sq, id, m.comps[i].value);
+            }
+        }
+    }
+}
+
+int update_weights(Model &m, const Weights &changes) {
+    Values &v = m.values;
+    for(auto &[name, value] : changes) {
+        if(v.index.find(name) == v.index.end()) {
+            return -1;
+        }
+    }
+    bool wide = needs_wide(v, &changes);
+    if(wide != m.wide) {
+        //Суммы квадратов в другой разрядности: пересчёт всех компонент,
+        //сами компоненты и связи не меняются
+        for(auto &[name, value] : changes) {
+            v.value[v.index.find(name)->second] = value;
+        }
+        m.wide = wide;
+        if(wide) {
+            model_rescore<wide_t>(m);
+        } else {
+            model_rescore<value_t>(m);
+        }
+        return 0;
+    }
+    with_squares(m, [&](auto &sq) { update_weights_sized(m, sq, changes); });
+    return 0;
+}
+
+//Исключение компоненты comp_id из модели: на её место встаёт последняя
+static void model_drop_comp(Model &m, int comp_id) {
+    int last = m.comps.size() - 1;
+    if(comp_id != last) {
+        m.comps[comp_id] = std::move(m.comps[last]);
+        for(auto id : m.comps[comp_id].nodes) {
+            m.values.comp_id[id] = comp_id;
+        }
+    }
+    m.comps.pop_back();
+}
+
+//Номер компоненты узла; отсутствующий узел создаётся отдельной компонентой
+template<typename Acc>
+static int model_node(Model &m, Squares<Acc> &sq, const Name &name) {
+    auto it = m.values.index.find(name);
+    if(it != m.values.index.end()) {
+        return m.values.comp_id[it->second];
+    }
+    int id = node_add(m.values, name);
+    m.graph[name];
+    int comp_id = m.comps.size();
+    m.values.comp_id[id] = comp_id;
+    m.comps.emplace_back();
+    m.comps.back().nodes.push_back(id);
+    model_reanalyze(m, sq, comp_id);
+    return comp_id;
+}
+
+//Добавление связи; новые узлы без веса, поэтому разрядность не меняется
+template<typename Acc>
+static void add_edge_sized(Model &m, Squares<Acc> &sq, const Name &a, const Name &b) {
+    int ca = model_node(m, sq, a);
+    int cb = model_node(m, sq, b);
+    if(!m.graph[a].insert(b).second) {
+        return;
+    }
+    m.graph[b].insert(a);
+    if(a == b) {
+        //Петля не меняет ни компонент, ни точек сочленения
+        return;
+    }
+
+    if(ca != cb) {
+        //Слияние: узлы меньшей компоненты переходят в большую
+        if(m.comps[ca].nodes.size() < m.comps[cb].nodes.size()) {
+            std::swap(ca, cb);
+        }
+        Component &to = m.comps[ca];
+        Component &from = m.comps[cb];
+        sq.total -= square<Acc>(to.value) + square<Acc>(from.value);
+        for(auto id : from.nodes) {
+            m.values.comp_id[id] = ca;
+        }
+        to.nodes.insert(to.nodes.end(), from.nodes.begin(), from.nodes.end());
+        to.value += from.value;
+        sq.total += square<Acc>(to.value);
+        model_drop_comp(m, cb);
+        if(ca == (int)m.comps.size()) {
+            //Большая компонента была последней и переехала на место меньшей
+            ca = cb;
+        }
+    }
+    model_reanalyze(m, sq, ca);
+}
+
+int add_edge(Model &m, const Name &a, const Name &b) {
+    with_squares(m, [&](auto &sq) { add_edge_sized(m, sq, a, b); });
+    return 0;
+}
+
+//Удаление связи, которая есть в графе; веса не меняются, разрядность - тоже
+template<typename Acc>
+static void remove_edge_sized(Model &m, Squares<Acc> &sq, const Name &a, const Name &b) {
+    //Компоненту разделяет только мост: ребро дерева обхода (v, w),
+    //из поддерева w которого нет обратных рёбер выше w
+    Values &v = m.values;
+    int na = v.index.find(a)->second;
+    int nb = v.index.find(b)->second;
+    int ca = v.comp_id[na];
+    int side = -1;
+    if(v.up[nb] == na && v.low[nb] > v.tin[na]) {
+        side = nb;
+    } else if(v.up[na] == nb && v.low[na] > v.tin[nb]) {
+        side = na;
+    }
+    if(side != -1) {
+        //Узлы отделившегося поддерева сразу получают номер новой компоненты
+        int cb = m.comps.size();
+        Component part(m.comps.get_allocator());
+        std::vector<int> stack{side};
+        v.comp_id[side] = cb;
+        while(!stack.empty()) {
+            int cur = stack.back();
+            stack.pop_back();
+            part.nodes.push_back(cur);
+            part.value += v.value[cur];
+            for(auto &link : m.graph.find(*v.names[cur])->second) {
+                int to = v.index.find(link)->second;
+                if(v.comp_id[to] != cb) {
+                    v.comp_id[to] = cb;
+                    stack.push_back(to);
+                }
+            }
+        }
+
+        //Компонента распалась: поддерево становится новой компонентой
+        Component &c = m.comps[ca];
+        sq.total -= square<Acc>(c.value);
+        c.nodes.erase(std::remove_if(c.nodes.begin(), c.nodes.end(),
+                [&](int id) { return v.comp_id[id] == cb; }), c.nodes.end());
+        c.value -= part.value;
+        sq.total += square<Acc>(c.value) + square<Acc>(part.value);
+        m.comps.push_back(std::move(part));
+        model_reanalyze(m, sq, cb);
+    }
+    model_reanalyze(m, sq, ca);
+}
+
+int remove_edge(Model &m, const Name &a, const Name &b) {
+    auto ia = m.graph.find(a);
+    if(ia == m.graph.end() || ia->second.erase(b) == 0) {
+        return -1;
+    }
+    m.graph.find(b)->second.erase(a);
+    if(a == b) {
+        return 0;
+    }
+    with_squares(m, [&](auto &sq) { remove_edge_sized(m, sq, a, b); });
+    return 0;
+}
+
+void model_print(Model &m, std::ostream &out, const Options &opts) {
+    with_squares(m, [&](auto &sq) { print_scores(out, m.comps, m.values, sq, opts); });
+}
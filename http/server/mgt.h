@@ -3,15 +3,28 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <list>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
 #include <set>
 #include <string>
 #include <vector>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <istream>
 
+/**
+ * Имя узла. Имена и контейнеры графа используют полиморфные аллокаторы:
+ * память одного запроса берётся из арены (см. Arena) и освобождается разом
+ */
+using Name = std::pmr::string;
+
 /**
  * Граф, сформированный из входного файла
  */
-using Graph = std::unordered_map<std::string, std::set<std::string>>;
+using Graph = std::pmr::unordered_map<Name, std::pmr::set<Name>>;
 
 /**
  * Тип данных для подсчёта квадратов сумм
@@ -19,46 +32,174 @@ using Graph = std::unordered_map<std::string, std::set<std::string>>;
 using value_t = unsigned long long;
 
 /**
- * Представление узла графа с дополнительными данными
- *   Node(value_t v = 0) : value(v) {}: конструктор с заданием собственного веса
- *   value_t value{}; //собственный исходный вес узла
- *   int comp_id = -1; //Индекс в векторе компонент связности графа
- *   value_t sum{}; //Сумма весов узла после редуцирования графа
- *   bool is_cutp{}; // true = узел является точкой сочленения
- *   bool is_reduced{};
- *   std::vector<value_t> subtree_sums;
+ * Тип для квадратов сумм, когда сумма весов не помещается в 32 бита
+ * (см. needs_wide)
  */
-struct Node {
-    Node(value_t v = 0) : value(v) {}
-    value_t value{};
-    int comp_id = -1;
-    value_t sum{};
-    bool is_cutp{};
-    bool is_reduced{};
-    std::vector<value_t> subtree_sums;
+using wide_t = unsigned __int128;
+
+/**
+ * Признаки узла, упакованные битами в один байт
+ *   NODE_CUTP : узел является точкой сочленения
+ *   NODE_SEP : при удалении родителя в дереве обхода поддерево узла отделяется
+ */
+enum : unsigned char {
+    NODE_CUTP = 1,
+    NODE_SEP = 2,
+};
+
+/**
+ * Узлы графа. Атрибуты узлов хранятся параллельными плотными массивами,
+ * индексированными номером узла: проход по одному атрибуту читает память
+ * подряд и не затрагивает остальные.
+ *   std::pmr::unordered_map<Name, int> index : номер узла по имени
+ *   std::pmr::vector<const Name *> names : имя узла (ключ в index)
+ *   std::pmr::vector<value_t> value : собственный исходный вес узла
+ *   std::pmr::vector<int> comp_id : индекс в векторе компонент связности графа
+ *                                   (-1 - не определён)
+ *   std::pmr::vector<unsigned char> flags : признаки узла NODE_*
+ *   std::pmr::vector<int> tin : время входа при обходе в глубину (-1 = узел не посещён)
+ *   std::pmr::vector<int> low : наименьшее время входа, достижимое из поддерева узла
+ *   std::pmr::vector<value_t> sub : суммарный вес поддерева узла в дереве обхода
+ * Для пересчёта оценок после изменения весов (заполняет analyze_comp):
+ *   std::pmr::vector<int> up : родитель в дереве обхода (-1 - корень)
+ *   std::pmr::vector<value_t> cut : суммарный вес отделяемых поддеревьев детей
+ * Суммы квадратов весов - в Squares: их разрядность зависит от весов.
+ * При копировании и присваивании names перестраивается по ключам нового index.
+ */
+struct Values {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    explicit Values(const allocator_type &a = {});
+    Values(const Values &v, const allocator_type &a = {});
+    Values(Values &&) = default;
+    Values &operator=(const Values &v);
+    Values &operator=(Values &&v);
+    allocator_type get_allocator() const { return index.get_allocator(); }
+    size_t size() const { return names.size(); }
+    std::pmr::unordered_map<Name, int> index;
+    std::pmr::vector<const Name *> names;
+    std::pmr::vector<value_t> value;
+    std::pmr::vector<int> comp_id;
+    std::pmr::vector<unsigned char> flags;
+    std::pmr::vector<int> tin;
+    std::pmr::vector<int> low;
+    std::pmr::vector<value_t> sub;
+    std::pmr::vector<int> up;
+    std::pmr::vector<value_t> cut;
+};
+
+/**
+ * Суммы квадратов весов по узлам в разрядности Acc: value_t, либо wide_t,
+ * когда квадрат суммы весов не помещается в value_t (см. needs_wide)
+ *   std::pmr::vector<Acc> local : сумма квадратов весов частей компоненты, на которые
+ *                                 она распадается при удалении узла, плюс вес узла
+ *   std::pmr::vector<Acc> squares : сумма квадратов весов поддеревьев, отделяемых узлом
+ *   Acc total : сумма квадратов весов компонент
+ */
+template<typename Acc>
+struct Squares {
+    explicit Squares(std::pmr::memory_resource *mem) : local(mem), squares(mem) {}
+    std::pmr::vector<Acc> local;
+    std::pmr::vector<Acc> squares;
+    Acc total{};
 };
 
 /**
- * Тип данных для массива узлов
+ * Номер узла name; отсутствующий узел добавляется с весом value
+ * (вес уже имеющегося узла не меняется)
  */
-using Values = std::unordered_map<std::string, Node>;
+int node_add(Values &v, const Name &name, value_t value = 0);
+
+/**
+ * Веса узлов по именам: новые веса и сценарии весов
+ */
+using Weights = std::pmr::unordered_map<Name, value_t>;
+
+/**
+ * Мост - связь, при удалении которой компонента распадается на две части
+ *   int from : конец связи со стороны корня дерева обхода
+ *   int to : конец связи, поддерево которого отделяется
+ *            (вес отделяемой части - Values::sub[to])
+ */
+struct Bridge {
+    int from;
+    int to;
+};
 
 /**
  * Структула, описывающая компоненту связности графа
- *   std::set<std::string> names : перечень узлов
- *   std::set<std::string> cutpoints : перечень точек сочленения
+ *   std::pmr::vector<int> nodes : номера узлов, первый - корень обхода
+ *   std::pmr::vector<int> cutpoints : номера точек сочленения
  *   value_t value{} : суммарный вес компоненты связности
+ *   std::pmr::vector<Bridge> bridges : мосты компоненты
+ * Конструкторы с аллокатором нужны, чтобы компоненты в Components
+ * размещали свои перечни в памяти самого массива.
  */
 struct Component {
-    std::set<std::string> names;
-    std::set<std::string> cutpoints;
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    explicit Component(const allocator_type &a = {}) : nodes(a), cutpoints(a), bridges(a) {}
+    Component(const Component &c, const allocator_type &a)
+        : nodes(c.nodes, a), cutpoints(c.cutpoints, a), value(c.value), bridges(c.bridges, a) {}
+    Component(Component &&c, const allocator_type &a)
+        : nodes(std::move(c.nodes), a), cutpoints(std::move(c.cutpoints), a), value(c.value),
+          bridges(std::move(c.bridges), a) {}
+    Component(const Component &) = default;
+    Component(Component &&) = default;
+    Component &operator=(const Component &) = default;
+    Component &operator=(Component &&) = default;
+    std::pmr::vector<int> nodes;
+    std::pmr::vector<int> cutpoints;
     value_t value{};
+    std::pmr::vector<Bridge> bridges;
 };
 
 /**
  * Тип данных для массива компонентов связности
  */
-using Components = std::vector<Component>;
+using Components = std::pmr::vector<Component>;
+
+/**
+ * Память арены сверх её буфера: обычная куча с подсчётом выданного
+ *   size_t taken : выдано байт с последнего сброса арены
+ */
+struct ArenaHeap : std::pmr::memory_resource {
+    size_t taken{};
+    void *do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void *p, size_t bytes, size_t align) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+};
+
+/**
+ * Арена для контейнеров одного запроса: память выдаётся подряд из буфера,
+ * освобождение отдельных объектов ничего не стоит, а вся память
+ * освобождается разом при сбросе. Буфер сохраняется между запросами и
+ * растёт до пикового объёма запроса, поэтому в установившемся режиме
+ * запрос не обращается к куче. Арена однопоточная: у каждого обработчика своя.
+ *   std::unique_ptr<char[]> buffer : буфер
+ *   size_t size : размер буфера, байт
+ *   ArenaHeap heap : память, взятая сверх буфера
+ *   std::optional<std::pmr::monotonic_buffer_resource> mem : выделение из буфера
+ */
+struct Arena {
+    explicit Arena(size_t size = 256 * 1024);
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    std::unique_ptr<char[]> buffer;
+    size_t size;
+    ArenaHeap heap;
+    std::optional<std::pmr::monotonic_buffer_resource> mem;
+};
+
+/**
+ * Источник памяти арены для контейнеров
+ */
+std::pmr::memory_resource *arena_resource(Arena &a);
+
+/**
+ * Сброс арены: вся выделенная из неё память освобождается, а если запрос
+ * не уместился в буфер, буфер увеличивается на недостающий объём.
+ * Контейнеры на арене к этому моменту должны быть уничтожены.
+ */
+void arena_reset(Arena &a);
 
 
 /**
@@ -93,7 +234,7 @@ ser_expect_char(
  * символов-ограничителей
  * Параметры:
  *   std::istream& in - входной поток
- *   std::string& s, - строка для накопления данных
+ *   Name& s, - строка для накопления данных
  *   const char *stop_symbols, - массив символов - ограничителеё
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
@@ -103,11 +244,26 @@ ser_expect_char(
 int
 ser_read_until(
     std::istream& in,
-    std::string& s,
+    Name& s,
     const char *stop_symbols,
     std::ostream& out
 );
 
+/**
+ * Параметры запроса: необязательный третий раздел входных данных,
+ * например {[...],{...},{'top':5}}
+ *   size_t top : вывести top лучших узлов с оценками
+ *                (0 - только узлы с наименьшей оценкой, без оценок)
+ *   bool all : вывести оценки всех узлов
+ *   bool edges : оценивать удаление связей-мостов вместо узлов
+ *                (сумма квадратов весов компонент после удаления связи)
+ */
+struct Options {
+    size_t top{};
+    bool all{};
+    bool edges{};
+};
+
 /**
  * Разбор входного потока и формирование контейнеров графа и
  * массива узлов графа
@@ -116,6 +272,7 @@ ser_read_until(
  *   Graph& g : сформированный граф
  *   Values& v : сформированный массив узлов графа
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ *   Options *opts : если не nullptr - параметры запроса из входных данных
  * Возвращаемое значение:
  *   0 - успешно
  *   не 0 - ошибка
@@ -124,16 +281,230 @@ int ser_in(
     std::istream& in,
     Graph& g,
     Values& v,
-    std::ostream& out
+    std::ostream& out,
+    Options *opts = nullptr
 );
 
+/**
+ * Ключ кэша результатов: 128-битный хэш запроса
+ */
+using hash_t = unsigned __int128;
+
+/**
+ * Ключ кэша результатов по разобранному запросу: хэш графа (связи и веса
+ * узлов) и параметров запроса. Хэш узла считается по имени, весу и
+ * упорядоченному списку соседей, хэши узлов складываются - ключ не
+ * зависит от порядка связей и весов во входных данных.
+ */
+hash_t graph_hash(const Graph &g, const Values &v, const Options &opts);
+
+/**
+ * Запись кэша результатов
+ *   hash_t key : ключ запроса
+ *   std::shared_ptr<const std::string> text : текст результата; выводится
+ *                                             без блокировки кэша
+ */
+struct CacheEntry {
+    hash_t key;
+    std::shared_ptr<const std::string> text;
+};
+
+/**
+ * Расчёт, который ждут одинаковые запросы других обработчиков
+ *   bool done : расчёт завершён, text - результат
+ *   bool failed : расчёт прерван исключением - ожидающие считают сами
+ *   std::shared_ptr<const std::string> text : результат
+ */
+struct Flight {
+    bool done{};
+    bool failed{};
+    std::shared_ptr<const std::string> text;
+};
+
+/**
+ * Кэш результатов запросов с данными графа, общий для всех соединений
+ * и обработчиков сервера: повторно присланный граф получает сохранённый
+ * текст результата без поиска компонент, точек сочленения и оценок.
+ * Когда объём записей превышает capacity, вытесняются давно не
+ * использованные. Одинаковые запросы, пришедшие одновременно, считаются
+ * один раз: остальные обработчики ждут результата первого (flights),
+ * даже если кэш выключен (capacity = 0).
+ *   size_t capacity : наибольший объём записей, байт
+ *   size_t bytes : объём записей вместе с узлами списка и индекса
+ *   size_t hits : запросов, ответ на которые найден в кэше
+ *   size_t misses : запросов, ответ на которые пришлось считать
+ *   size_t joined : запросов, дождавшихся расчёта такого же запроса
+ *   std::list<CacheEntry> lru : записи от недавно использованных к давним
+ *   std::unordered_map<hash_t, ...> index : запись по ключу
+ *   std::unordered_map<hash_t, ...> flights : идущие расчёты по ключу
+ *   std::mutex mutex : блокировка всех полей
+ *   std::condition_variable landed : завершение какого-либо расчёта
+ */
+struct ResultCache {
+    struct KeyHash {
+        size_t operator()(hash_t k) const { return size_t(k) ^ size_t(k >> 64); }
+    };
+    explicit ResultCache(size_t capacity) : capacity(capacity) {}
+    ResultCache(const ResultCache &) = delete;
+    ResultCache &operator=(const ResultCache &) = delete;
+    size_t capacity;
+    size_t bytes{};
+    size_t hits{};
+    size_t misses{};
+    size_t joined{};
+    std::list<CacheEntry> lru;
+    std::unordered_map<hash_t, std::list<CacheEntry>::iterator, KeyHash> index;
+    std::unordered_map<hash_t, std::shared_ptr<Flight>, KeyHash> flights;
+    std::mutex mutex;
+    std::condition_variable landed;
+};
+
+/**
+ * Откуда взят результат запроса
+ */
+enum CacheResult {
+    CACHE_HIT,    //из кэша
+    CACHE_JOINED, //от такого же запроса другого обработчика
+    CACHE_MISS,   //рассчитан этим запросом
+};
+
+/**
+ * Результат запроса с ключом key: из кэша, от такого же запроса, который
+ * уже считает другой обработчик, или от calc. Расчёт calc выполняется без
+ * блокировки кэша и выводит результат в переданный ему поток; результат
+ * сохраняется в кэше. Результат выводится в out.
+ * Возвращаемое значение:
+ *   откуда взят результат
+ */
+CacheResult cache_answer(ResultCache &c, hash_t key, std::ostream &out,
+        const std::function<void(std::ostream &)> &calc);
+
+/**
+ * Счётчики кэша на один момент времени
+ */
+struct CacheStats {
+    size_t hits;
+    size_t misses;
+    size_t joined;
+    size_t entries;
+    size_t bytes;
+};
+
+/**
+ * Снимок счётчиков кэша
+ */
+CacheStats cache_stats(ResultCache &c);
+
+/**
+ * Вывод счётчиков кэша:
+ * {'hits': 3, 'misses': 5, 'joined': 1, 'entries': 5, 'bytes': 1234}
+ */
+void cache_print(ResultCache &c, std::ostream &out);
+
+/**
+ * Граф, сохраняемый между запросами вместе с результатами анализа:
+ * после изменения весов узлов оценки пересчитываются без повторного
+ * разбора и поиска точек сочленения.
+ * Не копируется: узлы ссылаются друг на друга указателями.
+ *   Model(std::pmr::memory_resource *mem) : конструктор с источником
+ *                                           памяти всех контейнеров модели
+ *   Graph graph : граф
+ *   Values values : узлы
+ *   Components comps : компоненты связности
+ *   bool wide : суммы квадратов - в wide_squares, иначе - в squares
+ *   Squares<value_t> squares, Squares<wide_t> wide_squares : суммы квадратов
+ *                  весов; память неиспользуемой разрядности сохраняется
+ */
+struct Model {
+    explicit Model(std::pmr::memory_resource *mem = std::pmr::get_default_resource())
+        : graph(mem), values(mem), comps(mem), squares(mem), wide_squares(mem) {}
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+    Graph graph;
+    Values values;
+    Components comps;
+    bool wide{};
+    Squares<value_t> squares;
+    Squares<wide_t> wide_squares;
+};
+
+/**
+ * Разбор входного потока и анализ графа с сохранением в модели
+ * Параметры:
+ *   Model &m : модель (должна быть пустой)
+ *   std::istream &in : входной поток
+ *   std::ostream &out : выходной поток для вывода ошибок
+ *   Options *opts : если не nullptr - параметры запроса из входных данных
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка разбора
+ */
+int model_build(Model &m, std::istream &in, std::ostream &out, Options *opts = nullptr);
+
+/**
+ * Анализ графа, уже разобранного в m.graph и m.values
+ */
+void model_analyze(Model &m);
+
+/**
+ * Изменение весов узлов модели. Для каждого изменённого узла
+ * пересчитываются веса поддеревьев на пути к корню дерева обхода,
+ * затем - оценки узлов затронутых компонент. Если новые веса требуют
+ * другой разрядности сумм (см. needs_wide), оценки всех компонент
+ * пересчитываются в ней заново.
+ * Параметры:
+ *   Model &m : модель
+ *   const Weights &changes : новые веса узлов
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - в модели нет какого-то из узлов, веса не изменены
+ */
+int update_weights(Model &m, const Weights &changes);
+
+/**
+ * Нужны ли суммам квадратов 128 бит: оценка узла не больше S^2 + S,
+ * где S - сумма весов, поэтому value_t хватает при S < 2^32.
+ * Отрицательные веса (больше INT_MAX) хранятся по модулю - с ними
+ * арифметика остаётся модульной в value_t, как в mgt-single
+ * Параметры:
+ *   const Values &v : узлы и веса
+ *   const Weights *changes : если не nullptr - новые веса части узлов
+ */
+bool needs_wide(const Values &v, const Weights *changes = nullptr);
+
+/**
+ * Добавление связи между узлами a и b модели (отсутствующие узлы
+ * создаются с нулевым весом). Связь разных компонент сливает их:
+ * узлы меньшей получают номер большей. Точки сочленения и оценки
+ * пересчитываются только для получившейся компоненты.
+ * Возвращаемое значение:
+ *   0 - успешно (в том числе если связь уже была)
+ */
+int add_edge(Model &m, const Name &a, const Name &b);
+
+/**
+ * Удаление связи между узлами a и b модели. Пересчитывается только
+ * компонента, которой принадлежала связь; если она распалась,
+ * отделившаяся часть становится новой компонентой.
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - такой связи нет
+ */
+int remove_edge(Model &m, const Name &a, const Name &b);
+
+/**
+ * Вывод результата по модели в формате process()
+ * без открывающей скобки: process() выводит её до разбора запроса
+ */
+void model_print(Model &m, std::ostream &out, const Options &opts);
+
 /**
  * Разбор входного потока данных (без лишних заголовков),
  * построение графа, рачёт по графу, вывод результатов
  * Параметры:
  *   std::istream& in - входной поток
  *   std::ostream& out - выходной поток для вывода результата или ошибок
- *   std::string &point - наименоване зоны из запроса
+ *   ResultCache *cache - если не nullptr - кэш результатов
  * Возвращаемое значение:
  *   0 - успешно
  *   не 0 - ошибка
@@ -142,27 +513,40 @@ int
 process(
     std::istream &in,
     std::ostream &out,
-    std::string &point
+    ResultCache *cache = nullptr
 );
 
 /**
  * Разбор входного потока данных, включая заголовки http,
- * построение графа, рачёт по графу, вывод результатов,
- * в т.ч. заголовкв http
+ * построение графа, рачёт по графу, вывод результатов.
+ * Если в If-None-Match указан ETag графа запроса, расчёт не выполняется.
+ * Заголовки ответа формирует вызывающий: ему нужна длина тела ответа
  * Параметры:
  *   std::istream& in - входной поток
- *   std::ostream& out - выходной поток для вывода результата или ошибок
-     bool keepalive = false - 1=не завершать сеанс после вывода результатов
+ *   std::ostream& out - выходной поток для вывода тела ответа
+ *   bool &keepalive - на входе: сервер разрешает постоянные соединения,
+ *                     на выходе: клиент просит не закрывать соединение
+ *   ResultCache *cache - если не nullptr - кэш результатов
+ *   std::string &etag - сильный ETag результата по хэшу графа и параметров
+ *                       запроса (пусто - ошибка разбора)
+ *   bool &not_modified - клиент указал этот ETag в If-None-Match:
+ *                        ответ 304 без тела
+ *   CacheResult &how - результат из кэша (CACHE_HIT), получен от такого же
+ *                      одновременного запроса (CACHE_JOINED) или рассчитан
  * Возвращаемое значение:
  *   0 - успешно, можно продолжать сеанс
- *   < 0 - ошибка
+ *   < 0 - ошибка; если тело ответа пустое, то запроса не было вовсе
  *   > 0 - успешно, завершить сеанс
  */
 int
 process_http_GET(
     std::istream &in,
     std::ostream &out,
-    bool keepalive = false
+    bool &keepalive,
+    ResultCache *cache,
+    std::string &etag,
+    bool &not_modified,
+    CacheResult &how
 );
 
 #endif
@@ -12,11 +12,11 @@
 /**
  * Хранение последнего символа,
  * подсчёт количества обработанных строк и символов
- * пока так
+ * пока так; у каждого рабочего потока сервера свои
  */
-static int ser_last_char = 0; //Последний считанный не пробельный символ
-static int line_num; //Количество обработанных строк на одном блоке данных
-static int char_num; //Количество обработанных символов на одном блоке данных
+static thread_local int ser_last_char = 0; //Последний считанный не пробельный символ
+static thread_local int line_num; //Количество обработанных строк на одном блоке данных
+static thread_local int char_num; //Количество обработанных символов на одном блоке данных
 
 /**
  * Обнулить счётчики строк ибайтов
@@ -160,7 +160,7 @@ ser_expect_char(
  * символов-ограничителей
  * Параметры:
  *   std::istream& in - входной поток
- *   std::string& s, - строка для накопления данных
+ *   Name& s, - строка для накопления данных
  *   const char *stop_symbols, - массив символов - ограничителеё
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
@@ -170,7 +170,7 @@ ser_expect_char(
 int
 ser_read_until(
     std::istream& in,
-    std::string& s,
+    Name& s,
     const char *stop_symbols,
     std::ostream& out
 ) {
@@ -211,7 +211,7 @@ ser_read_until(
  * Считывание имени, залючённого в одинарные кавычки, например, 'A'
  * Параметры:
  *   std::istream& in - входной поток
- *   std::string& name - строка для сохранения имени
+ *   Name& name - строка для сохранения имени
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
  *   0 - успешно
@@ -220,7 +220,7 @@ ser_read_until(
 int
 ser_get_name(
     std::istream& in,
-    std::string& name,
+    Name& name,
     std::ostream& out
 ) {
     OK(ser_expect_char(in, "'", out, true));
@@ -246,8 +246,8 @@ ser_get_graph(
     std::ostream& out
 ) {
     do {
-        std::string n1;
-        std::string n2;
+        Name n1(graph.get_allocator());
+        Name n2(graph.get_allocator());
         OK(ser_expect_char(in, "[", out, true));
         OK(ser_get_name(in, n1, out));
         OK(ser_expect_char(in, ",", out, true));
@@ -277,10 +277,10 @@ ser_get_val(
     std::ostream& out
 ) {
     OK(ser_expect_char(in, ":", out, true));
-    std::string valstr;
+    Name valstr;
     OK(ser_read_until(in, valstr, ",}] \t\n", out));
     size_t pos = 0;
-    int v = std::stoi(valstr, &pos);
+    int v = std::stoi(std::string(valstr), &pos);
     if(pos != valstr.size()) {
         out <<"'@@ERROR':'"
             <<ser_err()
@@ -298,7 +298,7 @@ ser_get_val(
  * считывание продолжается пока после значения стоит запятая
  * Параметры:
  *   std::istream& in - входной поток
- *   Value& values - контейнер для хранения значений
+ *   Values& values - массив узлов (повторный вес узла не учитывается)
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
  *   0 - успешно
@@ -311,11 +311,54 @@ ser_get_values(
     std::ostream& out
 ) {
     do {
-        std::string name;
+        Name name(values.get_allocator());
         OK(ser_get_name(in, name, out));
         int value;
         OK(ser_get_val(in, value, out));
-        values.insert({name, value});
+        node_add(values, name, value);
+        if(isspace(ser_last_char)) {
+            ser_expect_char(in, ",", out, false);
+        }
+    } while(ser_last_char == ',');
+    return 0;
+}
+
+/**
+ * Считывание параметров запроса вида 'top':5, 'all':1
+ * считывание продолжается пока после значения стоит запятая
+ * Параметры:
+ *   std::istream& in - входной поток
+ *   Options &opts - параметры запроса
+ *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка
+ */
+int
+ser_get_options(
+    std::istream& in,
+    Options &opts,
+    std::ostream& out
+) {
+    do {
+        Name name;
+        OK(ser_get_name(in, name, out));
+        int value;
+        OK(ser_get_val(in, value, out));
+        if(name == "top") {
+            opts.top = value > 0 ? value : 0;
+        } else if(name == "all") {
+            opts.all = value != 0;
+        } else if(name == "edges") {
+            opts.edges = value != 0;
+        } else {
+            out <<"'@@ERROR':'"
+                <<ser_err()
+                <<"unknown option "
+                <<name
+                <<"'";
+            return -1;
+        }
         if(isspace(ser_last_char)) {
             ser_expect_char(in, ",", out, false);
         }
@@ -331,6 +374,7 @@ ser_get_values(
  *   Links& l - контейнер связей
  *   Value& v - контейнер весовых коэффициентов
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ *   Options *opts - если не nullptr - параметры запроса из входных данных
  * Возвращаемое значение:
  *   0 - успешно
  *   не 0 - ошибка
@@ -340,7 +384,8 @@ ser_in(
     std::istream& in,
     Graph& g,
     Values& v,
-    std::ostream& out
+    std::ostream& out,
+    Options *opts
 ) {
     ser_zero_counters();
     OK(ser_expect_char(in, "{[", out, true));
@@ -361,18 +406,39 @@ ser_in(
             <<"expected char } after value list'";
         return -1;
     }
-    OK(ser_expect_char(in, "}", out, true));
+    //Необязательный раздел параметров запроса
+    int next = ser_expect_char(in, "}", out, false);
+    if(next == ',') {
+        Options ignored;
+        OK(ser_expect_char(in, "{", out, true));
+        OK(ser_get_options(in, opts ? *opts : ignored, out));
+        if(ser_last_char == '\n') {
+            OK(ser_expect_char(in, "}", out, true));
+        } else if(ser_last_char != '}') {
+            out <<"'@@ERROR':'"
+                <<ser_err()
+                <<"expected char } after option list'";
+            return -1;
+        }
+        OK(ser_expect_char(in, "}", out, true));
+    } else if(next > 0) {
+        out <<"'@@ERROR':'"
+            <<ser_err()
+            <<"expected char } but found "
+            <<char(next)
+            <<"'";
+        return next;
+    } else if(next != 0) {
+        return next;
+    }
 
     //Дополнить граф одиночными узлами из списка узлов
-    for(auto value : v) {
-        g[value.first];
+    for(size_t id = 0; id < v.size(); ++id) {
+        g[*v.names[id]];
     }
     //Дополнить список узлов из графа
     for(auto &[from, tos] : g) {
-        v[from];
-        for(auto to : tos) {
-            v[to];
-        }
+        node_add(v, from);
     }
     return 0;
 }
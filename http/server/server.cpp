@@ -7,18 +7,32 @@
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
+#include <sstream>
 #include <csignal>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <condition_variable>
 #include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <poll.h>
 
 #include "mgt.h"
 
 enum {
     DEFAULT_READ_TIMEOUT = 1000,
-    DEFAULT_WRITE_TIMEOUT = 5000
+    DEFAULT_WRITE_TIMEOUT = 5000,
+    DEFAULT_CACHE_MB = 64,
+    DEFAULT_THREADS = 4
 };
 
-static volatile std::sig_atomic_t GotSigTerm;
+//Флаг читают все рабочие потоки; atomic без блокировок допустим в обработчике сигнала
+static std::atomic<bool> GotSigTerm{false};
+static_assert(std::atomic<bool>::is_always_lock_free);
 /**
  * Обработчик сигнала SIGTERM для хорошего завершения сервера
  * без прерывания сеанса связи
@@ -27,19 +41,19 @@ void
 sigterm_handler(
     int signal
 ) {
-    GotSigTerm = signal;
+    GotSigTerm = signal != 0;
 }
 
-static volatile std::sig_atomic_t GotSigPipe;
 /**
  * Обработчик сигнала SIGPIPE, который приходит при
- * попытке вывода в неисправный сокет (клиент закрыл сокет)
+ * попытке вывода в неисправный сокет (клиент закрыл сокет).
+ * Сигнал не должен завершать сервер; ошибку записи видит
+ * поток вывода соединения в своём рабочем потоке
  */
 void
 sigpipe_handler(
-    int signal
+    int
 ) {
-    GotSigPipe = signal;
 }
 
 /**
@@ -118,25 +132,339 @@ sock_write_timeout(
     return status;
 }
 
+/**
+ * Соединение с клиентом: сокет и потоки ввода/вывода на нём.
+ * Буфер закрывает свой дескриптор при уничтожении, поэтому у буфера
+ * записи - своя копия дескриптора сокета
+ */
+struct Connection {
+    explicit Connection(int fd);
+    int fd;
+    __gnu_cxx::stdio_filebuf<char> inbuf;
+    __gnu_cxx::stdio_filebuf<char> outbuf;
+    std::istream in;
+    std::ostream out;
+    //Время, с которого соединение ждёт следующего запроса
+    std::chrono::steady_clock::time_point idle_since;
+};
+
+Connection::Connection(int fd)
+    : fd(fd), inbuf(fd, std::ios::in), outbuf(::dup(fd), std::ios::out),
+      in(&inbuf), out(&outbuf) {}
+
+/**
+ * Передача соединений между опрашивающим потоком и рабочими.
+ * Рабочий поток получает соединение, в котором пришёл запрос, обрабатывает
+ * запрос и возвращает соединение на опрос, поэтому постоянные соединения
+ * в ожидании следующего запроса не занимают рабочие потоки
+ */
+struct Dispatch {
+    std::mutex lock;
+    std::condition_variable has_ready;
+    //Соединения с пришедшими запросами - для рабочих потоков
+    std::deque<std::unique_ptr<Connection>> ready;
+    //Соединения, возвращённые рабочими потоками на опрос
+    std::vector<std::unique_ptr<Connection>> returned;
+    //Канал, которым рабочий поток будит опрос, вернув соединение
+    int wake[2];
+    bool stop = false;
+};
+
+/**
+ * Обработка одного запроса соединения
+ * Параметры:
+ *   Connection &c - соединение
+ *   ResultCache &cache - кэш результатов
+ *   bool keepalive - разрешить постоянные соединения
+ * Возвращаемое значение:
+ *   true - соединение остаётся открытым для следующего запроса
+ *   false - соединение нужно закрыть
+ */
+static bool
+serve_request(
+    Connection &c,
+    ResultCache &cache,
+    bool keepalive
+) {
+    //Запрос может выглядеть так:
+    //http://localhost:12347/test={[['A','B'],['B','C'],['C','A']],{'A':100,'B':10,'C':100}}
+    //или после url_encode:
+    //http://localhost:12347/test=%7B[[%27A%27,%20%27B%27],[%27B%27,%20%27C%27],[%27C%27,%20%27A%27]],
+    //                            %7B%27A%27:%20100,%27B%27:%2010,%27C%27:%20100%7D%7D
+    //Результат должен быть таким: 'test':['A','C']
+    //Если слово test в запросе отсутствует, то и результат будет таким: ['A','C']
+    //Ответ сначала формируется в буфере: заголовку нужна его длина,
+    //по которой клиент находит конец ответа в постоянном соединении
+    std::ostream &out = c.out;
+    std::ostringstream body;
+    bool persistent = keepalive;
+    std::string etag;
+    bool not_modified;
+    CacheResult how;
+    int r = process_http_GET(c.in, body, persistent, &cache, etag, not_modified, how);
+    std::string text = body.str();
+    if(text.empty()) {
+        //Клиент закрыл соединение или молчит дольше таймаута
+        return false;
+    }
+
+    //Зафиксируем дату и время выполнения запроса
+    ::time_t now;
+    ::time(&now);
+    //gmtime_r: статический буфер gmtime общий для всех рабочих потоков
+    struct ::tm utc;
+    ::gmtime_r(&now, &utc);
+    char dtime[100] = {0};
+    ::strftime(dtime, sizeof(dtime), "%a, %d %b %Y %T %Z", &utc);
+
+    CacheStats stats = cache_stats(cache);
+
+    if(not_modified) {
+        //Результат у клиента не изменился: ответ без тела
+        out <<"HTTP/1.1 304 Not Modified\r\n"
+              "Date: " <<dtime <<"\r\n"
+              "Server: mgt-server-http\r\n"
+              "ETag: " <<etag <<"\r\n"
+              "Connection: " <<(persistent ? "keep-alive" : "close") <<"\r\n"
+              "X-Cache-Hits: " <<stats.hits <<"\r\n"
+              "X-Cache-Misses: " <<stats.misses <<"\r\n"
+              "X-Cache-Joined: " <<stats.joined <<"\r\n"
+              "\r\n";
+        std::flush(out);
+        return r == 0 && out;
+    }
+
+    //Код ошибки, если она будет, передаётся в тексте решения.
+    //ETag - по хэшу графа запроса, у ответа с ошибкой его нет.
+    //X-Cache - ответ из кэша результатов, получен от такого же
+    //запроса в расчёте (JOINED) или рассчитан,
+    //X-Cache-Hits/X-Cache-Misses/X-Cache-Joined - счётчики кэша сервера
+    out <<"HTTP/1.1 200 OK\r\n"
+          "Date: " <<dtime <<"\r\n"
+          "Server: mgt-server-http\r\n"
+          "Last-Modified:" <<dtime <<"\r\n"
+          "Accept-Ranges: bytes\r\n"
+          "Content-type: text/html\r\n"
+          "Content-Length: " <<text.size() <<"\r\n"
+          "Connection: " <<(persistent ? "keep-alive" : "close") <<"\r\n";
+    if(!etag.empty()) {
+        out <<"ETag: " <<etag <<"\r\n";
+    }
+    out <<"X-Cache: " <<(how == CACHE_HIT ? "HIT" : how == CACHE_JOINED ? "JOINED" : "MISS") <<"\r\n"
+          "X-Cache-Hits: " <<stats.hits <<"\r\n"
+          "X-Cache-Misses: " <<stats.misses <<"\r\n"
+          "X-Cache-Joined: " <<stats.joined <<"\r\n"
+          "\r\n"
+        <<text;
+    std::flush(out);
+    return r == 0 && out;
+}
+
+/**
+ * Рабочий поток сервера: берёт соединения с пришедшими запросами и
+ * обрабатывает их. Запросы, уже прочитанные в буфер соединения
+ * (конвейер), обрабатываются сразу, после чего соединение возвращается
+ * на опрос. Потоки делят кэш результатов, одинаковые графы, пришедшие
+ * одновременно, считаются один раз
+ * Параметры:
+ *   Dispatch &d - очередь соединений
+ *   ResultCache &cache - кэш результатов
+ *   bool keepalive - разрешить постоянные соединения
+ */
+static void
+serve_clients(
+    Dispatch &d,
+    ResultCache &cache,
+    bool keepalive
+) {
+    for(;;) {
+        std::unique_ptr<Connection> c;
+        {
+            std::unique_lock<std::mutex> guard(d.lock);
+            d.has_ready.wait(guard, [&] { return d.stop || !d.ready.empty(); });
+            if(d.stop) {
+                break;
+            }
+            c = std::move(d.ready.front());
+            d.ready.pop_front();
+        }
+
+        bool open;
+        do {
+            open = serve_request(*c, cache, keepalive);
+        } while(open && c->inbuf.in_avail() > 0);
+
+        if(open) {
+            //Ждать следующего запроса на опросе
+            c->idle_since = std::chrono::steady_clock::now();
+            {
+                std::lock_guard<std::mutex> guard(d.lock);
+                d.returned.push_back(std::move(c));
+            }
+            char byte = 0;
+            if(::write(d.wake[1], &byte, 1) < 0) {
+                perror("wake");
+            }
+            continue;
+        }
+        if(c->out) {
+            //Если клиентский сокет всё ещё живой,
+            //то сбросить буфер (за одно подождать отправки данных)
+            std::flush(c->out);
+        } else {
+            //Если сокет поломался, то сообщить
+            perror("Send error");
+        }
+        //Соединение закрывается вместе с буферами
+    }
+}
+
+/**
+ * Опрос слушающего сокета и постоянных соединений, ждущих запроса.
+ * Новые соединения ставятся на опрос, соединения с пришедшими данными
+ * передаются рабочим потокам, соединения без запроса дольше
+ * DEFAULT_READ_TIMEOUT закрываются
+ * Параметры:
+ *   int server_fd - слушающий сокет
+ *   Dispatch &d - очередь соединений
+ * Возвращаемое значение:
+ *   0 - завершение по SIGTERM
+ *   не 0 - ошибка
+ */
+static int
+poll_clients(
+    int server_fd,
+    Dispatch &d
+) {
+    using clock = std::chrono::steady_clock;
+    const auto timeout = std::chrono::milliseconds(DEFAULT_READ_TIMEOUT);
+    std::vector<std::unique_ptr<Connection>> waiting;
+    std::vector<pollfd> fds;
+    int status = 0;
+    while(!GotSigTerm) {
+        //Ждать до ближайшего истечения таймаута соединения
+        auto now = clock::now();
+        auto wait = timeout;
+        for(auto &c : waiting) {
+            wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(
+                c->idle_since + timeout - now));
+        }
+        fds.clear();
+        fds.push_back({server_fd, POLLIN, 0});
+        fds.push_back({d.wake[0], POLLIN, 0});
+        for(auto &c : waiting) {
+            fds.push_back({c->fd, POLLIN, 0});
+        }
+        if(::poll(fds.data(), fds.size(), std::max<long>(wait.count(), 0) + 1) < 0) {
+            if(errno == EINTR) {
+                //SIGTERM проверяется в условии цикла
+                continue;
+            }
+            perror("poll");
+            status = -1;
+            break;
+        }
+
+        //Соединения с данными - рабочим потокам, молчащие - закрыть
+        now = clock::now();
+        size_t kept = 0;
+        bool handed = false;
+        for(size_t i = 0; i < waiting.size(); ++i) {
+            if(fds[i + 2].revents != 0) {
+                std::lock_guard<std::mutex> guard(d.lock);
+                d.ready.push_back(std::move(waiting[i]));
+                handed = true;
+            } else if(now - waiting[i]->idle_since < timeout) {
+                waiting[kept++] = std::move(waiting[i]);
+            }
+        }
+        waiting.resize(kept);
+        if(handed) {
+            d.has_ready.notify_all();
+        }
+
+        if(fds[1].revents & POLLIN) {
+            //Соединения, возвращённые рабочими потоками
+            char bytes[64];
+            if(::read(d.wake[0], bytes, sizeof(bytes)) < 0) {
+                perror("wake");
+            }
+            std::lock_guard<std::mutex> guard(d.lock);
+            for(auto &c : d.returned) {
+                waiting.push_back(std::move(c));
+            }
+            d.returned.clear();
+        }
+
+        if(fds[0].revents & POLLIN) {
+            //Подключение клиента
+            sockaddr_in address;
+            socklen_t addrlen = sizeof(address);
+            int client_socket;
+            if((client_socket = ::accept(server_fd, (sockaddr *)(&address), &addrlen)) < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                perror("accept");
+                status = -1;
+                break;
+            }
+            //Клиент подключен
+            //address.sin_addr - адрас клиента
+
+            //Назачить таймауты на клиентском сокете: запрос, начатый
+            //клиентом, рабочий поток дочитывает с таймаутом
+            sock_read_timeout(client_socket, DEFAULT_READ_TIMEOUT);
+            sock_write_timeout(client_socket, DEFAULT_WRITE_TIMEOUT);
+
+            waiting.push_back(std::make_unique<Connection>(client_socket));
+            waiting.back()->idle_since = clock::now();
+        }
+    }
+
+    //Остановить рабочие потоки; соединения закрываются вместе с очередью
+    {
+        std::lock_guard<std::mutex> guard(d.lock);
+        d.stop = true;
+    }
+    d.has_ready.notify_all();
+    return status;
+}
+
 /**
  * Параметры:
  *   argv[1] - порт прослушивания сервера
  *             Задавать обязательно
+ *   argv[2] - объём кэша результатов, МБ
+ *             (по умолчанию DEFAULT_CACHE_MB, 0 - без кэша)
+ *   argv[3] - число рабочих потоков
+ *             (по умолчанию DEFAULT_THREADS)
  */
 int main(int argc, char *argv[]) {
 
     if(argc < 2) {
         std::cout <<
-        "Usage: mgt-server-http port" <<std::endl;
+        "Usage: mgt-server-http port [cache-mb [threads]]" <<std::endl;
         return EXIT_FAILURE;
     }
 
     //Порт сервера
     in_port_t port = std::stoi(argv[1], NULL, 10);
 
-    //1 = Не закрывать соединение после расчёта, пытаться получить
-    //    следующую порцию данных в течении таймаута чтения
-    bool keepalive = false;
+    //Кэш результатов, общий для всех соединений
+    size_t cache_mb = argc > 2 ? std::stoul(argv[2], NULL, 10) : DEFAULT_CACHE_MB;
+    ResultCache cache(cache_mb << 20);
+
+    //Рабочие потоки
+    size_t threads = argc > 3 ? std::stoul(argv[3], NULL, 10) : DEFAULT_THREADS;
+    if(threads == 0) {
+        threads = 1;
+    }
+
+    //1 = Разрешить постоянные соединения: не закрывать соединение после
+    //    расчёта, если клиент об этом просит, и ждать следующий запрос
+    //    в течении таймаута чтения
+    bool keepalive = true;
 
     //Создание сокета
     int server_fd;
@@ -171,7 +499,6 @@ int main(int argc, char *argv[]) {
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port);
-    int addrlen = sizeof(address);
     if(::bind(server_fd, (sockaddr*)(&address), sizeof(address)) < 0) {
         perror("bind failed");
         return EXIT_FAILURE;
@@ -193,78 +520,33 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
-    //Главный цикл сервера
-    while(!GotSigTerm) {
-        //Ждать подключения клиента
-        int client_socket;
-        if ((client_socket = ::accept(server_fd, (sockaddr *)(&address), (socklen_t*)(&addrlen))) < 0) {
-            if(GotSigTerm) {
-                //Если получен SIGTERM, то сразу выход
-                //perror("got SIGTERM");
-                break;
-            }
-            perror("accept");
-            return EXIT_FAILURE;
-        }
-        //Клиент подключен
-        //address.sin_addr - адрас клиента
-
-        //Назачить таймауты на клиентском сокете
-        sock_read_timeout(client_socket, DEFAULT_READ_TIMEOUT);
-        sock_write_timeout(client_socket, DEFAULT_WRITE_TIMEOUT);
-
-        //Создать буфер для чтения из клиентского сокета
-        __gnu_cxx::stdio_filebuf<char> inbuf(client_socket, std::ios::in);
-        //Создать поток ввода из клиентского сокета
-        std::istream in(&inbuf);
-
-        //Создать буфер для записи в клиентский сокет
-        __gnu_cxx::stdio_filebuf<char> outbuf(client_socket, std::ios::out);
-        //Создать поток вывода в клиентский сокет
-        std::ostream out(&outbuf);
-
-        //Зафиксируем дату и время выполнения запроса
-        ::time_t now;
-        ::time(&now);
-        char dtime[100] = {0};
-        ::strftime(dtime, sizeof(dtime), "%a, %d %b %Y %T %Z", ::gmtime(&now));
-
-        //Сначала вывести заголовок
-        //Заголовок примерно такой:
-        out <<"HTTP/1.0 200 OK\r\n"
-              "Date: " <<dtime <<"\r\n"
-              "Server: mgt-server-http\r\n"
-              "Last-Modified:" <<dtime <<"\r\n"
-              "Accept-Ranges: bytes\r\n"
-              "Content-type: text/html\r\n"
-              "\r\n";
-
-        //Сначала выводим заголовок, а потом решение.
-        //Код ошибки, если она будет, передаётся в тексте решения
-
-        //Выполнять цикл обработки запросов
-        //Запрос может выглядеть так:
-        //http://localhost:12347/test={[['A','B'],['B','C'],['C','A']],{'A':100,'B':10,'C':100}}
-        //или после url_encode:
-        //http://localhost:12347/test=%7B[[%27A%27,%20%27B%27],[%27B%27,%20%27C%27],[%27C%27,%20%27A%27]],
-        //                            %7B%27A%27:%20100,%27B%27:%2010,%27C%27:%20100%7D%7D
-        //Результат должен быть таким: 'test':['A','C']
-        //Если слово test в запросе отсутствует, то и результат будет таким: ['A','C']
-        while(process_http_GET(in, out, keepalive) == 0) {
-            ;
-        }
-        if(!GotSigPipe) {
-            //Если клиентский сокет всё ещё живой,
-            //то сбросить буфер (за одно подождать отправки данных)
-            std::flush(out);
-        } else {
-            //Если сокет поломался, то сообщить
-            perror("Send error");
-            GotSigPipe = 0;
+    //Рабочие потоки обрабатывают запросы, главный поток принимает
+    //соединения и опрашивает ждущие запроса; SIGTERM получает только он
+    Dispatch d;
+    if(::pipe(d.wake) < 0) {
+        perror("pipe");
+        return EXIT_FAILURE;
+    }
+    std::vector<std::thread> workers;
+    {
+        sigset_t term, old;
+        sigemptyset(&term);
+        sigaddset(&term, SIGTERM);
+        ::pthread_sigmask(SIG_BLOCK, &term, &old);
+        for(size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([&] {
+                serve_clients(d, cache, keepalive);
+            });
         }
-        //Закрыть клиентский сокет
-        ::close(client_socket);
+        ::pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+    int failed = poll_clients(server_fd, d);
+    for(auto &w : workers) {
+        w.join();
     }
+    ::close(d.wake[0]);
+    ::close(d.wake[1]);
+    ::close(server_fd);
 
-    return EXIT_SUCCESS;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,290 @@
+#include <string>
+#include <vector>
+#include <atomic>
+#include <utility>
+#include <algorithm>
+
+#include "mgt.h"
+#include "pool.h"
+
+/**
+ * Параллельный поиск точек сочленения по схеме Тарьяна - Вишкина.
+ * Вместо последовательного обхода в глубину:
+ *   1. остовное дерево строится параллельным обходом в ширину по уровням;
+ *   2. по уровням снизу вверх и сверху вниз считаются веса и размеры
+ *      поддеревьев, прямая (preorder) нумерация дерева и для каждого
+ *      поддерева low/high - наименьший и наибольший номер узла,
+ *      смежного с поддеревом;
+ *   3. рёбра дерева объединяются в блоки (компоненты двусвязности)
+ *      системой непересекающихся множеств по двум правилам:
+ *      - концы недревесного ребра лежат в разных ветвях дерева -
+ *        рёбра в их родителей в одном блоке;
+ *      - поддерево w связано с узлами вне поддерева своего родителя v -
+ *        рёбра (v, w) и (родитель v, v) в одном блоке;
+ *   4. при удалении узла v его дети с одним блоком ребра образуют одну
+ *      часть графа, а дети из блока ребра в родителя присоединяются
+ *      к остатку компоненты; ребро в родителя - мост, если все связи
+ *      поддерева, кроме него самого, остаются внутри поддерева.
+ * Все узлы обрабатываются в позициях обхода в ширину: дети узла лежат
+ * в следующем уровне подряд, в порядке позиций родителей.
+ */
+
+//Количество узлов в одной задаче пула
+static const size_t GRAIN = 2048;
+
+//Корень множества, содержащего x, со сжатием путей через шаг
+static int uf_find(std::vector<std::atomic<int>> &uf, int x) {
+    while(true) {
+        int p = uf[x].load();
+        if(p == x) {
+            return x;
+        }
+        int gp = uf[p].load();
+        if(gp != p) {
+            uf[x].compare_exchange_weak(p, gp);
+        }
+        x = gp;
+    }
+}
+
+//Объединение множеств, содержащих a и b (корнем становится меньший номер)
+static void uf_union(std::vector<std::atomic<int>> &uf, int a, int b) {
+    while(true) {
+        a = uf_find(uf, a);
+        b = uf_find(uf, b);
+        if(a == b) {
+            return;
+        }
+        if(a < b) {
+            std::swap(a, b);
+        }
+        int expected = a;
+        if(uf[a].compare_exchange_strong(expected, b)) {
+            return;
+        }
+    }
+}
+
+template<typename L>
+static void bicon(const L &l, Values &v, Component &c, Pool *pool) {
+    size_t n = c.nodes.size();
+
+    //Плотная нумерация узлов компоненты и списки смежности подряд в одном массиве:
+    //nodes[i] - номер узла i компоненты в графе, id - обратно
+    const std::pmr::vector<int> &nodes = c.nodes;
+    std::vector<int> id(v.size());
+    std::vector<size_t> first(n + 1);
+    pool_for(pool, n, GRAIN, [&](size_t from, size_t to) {
+        for(size_t i = from; i < to; ++i) {
+            id[nodes[i]] = i;
+            first[i + 1] = l.degree(nodes[i]);
+        }
+    });
+    for(size_t i = 0; i < n; ++i) {
+        first[i + 1] += first[i];
+    }
+    std::vector<int> adj(first[n]);
+    pool_for(pool, n, GRAIN, [&](size_t from, size_t to) {
+        for(size_t i = from; i < to; ++i) {
+            size_t k = first[i];
+            for(auto [j, end] = l.of(nodes[i]); j != end; ++j) {
+                adj[k++] = id[l.to(j)];
+            }
+        }
+    });
+
+    //1. Обход в ширину: order[pos] - узел в позиции pos, pos_of - обратно,
+    //parent[pos] - позиция родителя, children[pos] - количество детей
+    std::vector<int> order(n);
+    std::vector<int> pos_of(n);
+    std::vector<int> parent(n, -1);
+    std::vector<int> children(n);
+    std::vector<std::atomic<bool>> seen(n);
+    std::vector<size_t> levels{0, 1};
+    order[0] = 0;
+    pos_of[0] = 0;
+    seen[0] = true;
+    while(levels.back() > levels[levels.size() - 2]) {
+        size_t lb = levels[levels.size() - 2];
+        size_t le = levels.back();
+        size_t chunks = (le - lb + GRAIN - 1) / GRAIN;
+        //Найденные узлы следующего уровня по пачкам: (узел, позиция родителя)
+        std::vector<std::vector<std::pair<int, int>>> found(chunks);
+        pool_for(pool, le - lb, GRAIN, [&](size_t from, size_t to) {
+            auto &out = found[from / GRAIN];
+            for(size_t p = lb + from; p < lb + to; ++p) {
+                int u = order[p];
+                int count = 0;
+                for(size_t k = first[u]; k < first[u + 1]; ++k) {
+                    int x = adj[k];
+                    if(!seen[x].load(std::memory_order_relaxed) && !seen[x].exchange(true)) {
+                        out.push_back({x, (int)p});
+                        ++count;
+                    }
+                }
+                children[p] = count;
+            }
+        });
+        size_t next = le;
+        for(auto &chunk : found) {
+            for(auto &[x, p] : chunk) {
+                order[next] = x;
+                pos_of[x] = next;
+                parent[next] = p;
+                ++next;
+            }
+        }
+        levels.push_back(next);
+    }
+    levels.pop_back();
+
+    //Дети узла в позиции p занимают позиции с child_first[p] подряд
+    std::vector<int> child_first(n);
+    int next_child = 1;
+    for(size_t p = 0; p < n; ++p) {
+        child_first[p] = next_child;
+        next_child += children[p];
+    }
+
+    //Проход по уровням: снизу вверх (up = true) или сверху вниз
+    auto by_levels = [&](bool up, const std::function<void(size_t)> &body) {
+        for(size_t l = 0; l + 1 < levels.size(); ++l) {
+            size_t k = up ? levels.size() - 2 - l : l;
+            size_t lb = levels[k];
+            pool_for(pool, levels[k + 1] - lb, GRAIN, [&](size_t from, size_t to) {
+                for(size_t p = lb + from; p < lb + to; ++p) {
+                    body(p);
+                }
+            });
+        }
+    };
+
+    //2. Веса и размеры поддеревьев, прямая нумерация, low/high
+    //(без ребра в родителя: для правил п.3 оно ничего не меняет)
+    std::vector<value_t> sub(n);
+    std::vector<int> size(n);
+    by_levels(true, [&](size_t p) {
+        value_t s = v.value[nodes[order[p]]];
+        int z = 1;
+        for(int ch = child_first[p]; ch < child_first[p] + children[p]; ++ch) {
+            s += sub[ch];
+            z += size[ch];
+        }
+        sub[p] = s;
+        size[p] = z;
+    });
+    std::vector<int> pre(n);
+    by_levels(false, [&](size_t p) {
+        int number = pre[p] + 1;
+        for(int ch = child_first[p]; ch < child_first[p] + children[p]; ++ch) {
+            pre[ch] = number;
+            number += size[ch];
+        }
+    });
+    std::vector<int> low(n);
+    std::vector<int> high(n);
+    by_levels(true, [&](size_t p) {
+        int lo = pre[p];
+        int hi = pre[p];
+        int u = order[p];
+        for(size_t k = first[u]; k < first[u + 1]; ++k) {
+            int x = pos_of[adj[k]];
+            if(x == parent[p]) {
+                continue;
+            }
+            lo = std::min(lo, pre[x]);
+            hi = std::max(hi, pre[x]);
+        }
+        for(int ch = child_first[p]; ch < child_first[p] + children[p]; ++ch) {
+            lo = std::min(lo, low[ch]);
+            hi = std::max(hi, high[ch]);
+        }
+        low[p] = lo;
+        high[p] = hi;
+    });
+
+    //3. Блоки рёбер дерева; ребро (parent[p], p) обозначается позицией p
+    std::vector<std::atomic<int>> uf(n);
+    pool_for(pool, n, GRAIN, [&](size_t from, size_t to) {
+        for(size_t p = from; p < to; ++p) {
+            uf[p] = p;
+        }
+    });
+    pool_for(pool, n, GRAIN, [&](size_t from, size_t to) {
+        for(size_t p = from; p < to; ++p) {
+            int u = order[p];
+            for(size_t k = first[u]; k < first[u + 1]; ++k) {
+                size_t x = pos_of[adj[k]];
+                //Каждое ребро - один раз; в несвязанных ветвях нет корня
+                if(p < x && (pre[x] + size[x] <= pre[p] || pre[p] + size[p] <= pre[x])) {
+                    uf_union(uf, p, x);
+                }
+            }
+            int w = parent[p];
+            if(w > 0 && (low[p] < pre[w] || high[p] >= pre[w] + size[w])) {
+                uf_union(uf, p, w);
+            }
+        }
+    });
+
+    //4. Части компоненты при удалении каждого узла
+    std::vector<std::vector<int>> cutpoints((n + GRAIN - 1) / GRAIN);
+    std::vector<std::vector<Bridge>> bridges(cutpoints.size());
+    pool_for(pool, n, GRAIN, [&](size_t from, size_t to) {
+        std::vector<std::pair<int, value_t>> groups;
+        for(size_t p = from; p < to; ++p) {
+            int up = p ? uf_find(uf, p) : -1;
+            groups.clear();
+            for(int ch = child_first[p]; ch < child_first[p] + children[p]; ++ch) {
+                int block = uf_find(uf, ch);
+                if(block != up) {
+                    groups.push_back({block, sub[ch]});
+                }
+            }
+            std::sort(groups.begin(), groups.end());
+            value_t cut = 0;
+            value_t squares = 0;
+            int pieces = 0;
+            for(size_t i = 0; i < groups.size();) {
+                value_t piece = 0;
+                size_t j = i;
+                for(; j < groups.size() && groups[j].first == groups[i].first; ++j) {
+                    piece += groups[j].second;
+                }
+                cut += piece;
+                squares += piece * piece;
+                ++pieces;
+                i = j;
+            }
+            int node = nodes[order[p]];
+            v.sub[node] = sub[p];
+            if(p && low[p] >= pre[p] && high[p] < pre[p] + size[p]) {
+                bridges[from / GRAIN].push_back({nodes[order[parent[p]]], node});
+            }
+            value_t rest = c.value - v.value[node] - cut;
+            v.local[node] = squares + rest * rest + v.value[node];
+            v.flags[node] = (p ? pieces > 0 : pieces > 1) ? NODE_CUTP : 0;
+            if(v.flags[node] & NODE_CUTP) {
+                cutpoints[from / GRAIN].push_back(node);
+            }
+        }
+    });
+    for(auto &chunk : cutpoints) {
+        c.cutpoints.insert(c.cutpoints.end(), chunk.begin(), chunk.end());
+    }
+    for(auto &chunk : bridges) {
+        c.bridges.insert(c.bridges.end(), chunk.begin(), chunk.end());
+    }
+}
+
+void analyze_comp_parallel(const Links &l, Values &v, Component &c, Pool *pool) {
+    bicon(l, v, c, pool);
+}
+
+void analyze_comp_parallel(const PackedLinks &l, Values &v, Component &c, Pool *pool) {
+    bicon(l, v, c, pool);
+}
+
+void analyze_comp_parallel(const MappedLinks &l, Values &v, Component &c, Pool *pool) {
+    bicon(l, v, c, pool);
+}
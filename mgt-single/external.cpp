@@ -0,0 +1,221 @@
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdio>
+#include <sys/mman.h>
+
+#include "mgt.h"
+
+/**
+ * Внешний режим для графов, которые не помещаются в память. В памяти
+ * процесса - только данные узлов, O(V): имена, веса, результаты обхода,
+ * система непересекающихся множеств и начала списков связей.
+ *   1. при разборе рёбра пишутся во временный файл, а их концы
+ *      объединяются в системе непересекающихся множеств - компоненты
+ *      связности известны сразу после разбора;
+ *   2. списки связей строятся порциями: узлы делятся на отрезки номеров,
+ *      концы рёбер которых помещаются в бюджет, рёбра раскладываются по
+ *      временным файлам отрезков, и каждый отрезок сортируется в памяти
+ *      и дописывается в файл списков связей;
+ *   3. файл списков отображается в память, и обход в глубину идёт по нему
+ *      так же, как по Links: система подгружает нужные страницы и
+ *      вытесняет прочитанные, собственная память процесса не растёт.
+ * Оценки узлов совпадают с обычным режимом. Перебор наборов узлов
+ * (print_kset) и параллельный разбор компоненты (bicon.cpp) копируют
+ * связи в память - для них внешний режим памяти не экономит.
+ */
+
+//Рёбер в буфере чтения временного файла
+static const size_t READ_EDGES = 1 << 16;
+
+//Корень множества, содержащего x, со сжатием путей через шаг
+static int uf_find(std::pmr::vector<int> &uf, int x) {
+    while(uf[x] != x) {
+        uf[x] = uf[uf[x]];
+        x = uf[x];
+    }
+    return x;
+}
+
+MappedLinks::~MappedLinks() {
+    if(adj) {
+        ::munmap(const_cast<int *>(adj), mapped);
+    }
+    if(edges) {
+        std::fclose(edges);
+    }
+    if(file) {
+        std::fclose(file);
+    }
+}
+
+int ser_in(std::istream &in, MappedLinks &l, Values &v, std::ostream &out, Options *opts) {
+    l.edges = std::tmpfile();
+    if(!l.edges) {
+        out << "can't create temporary file" << std::endl;
+        return -1;
+    }
+    auto grow = [&]() {
+        while(l.comp.size() < v.size()) {
+            l.comp.push_back(l.comp.size());
+        }
+    };
+    int ret = ser_in(in, [&](int from, int to) {
+        std::pair<int, int> e{from, to};
+        std::fwrite(&e, sizeof(e), 1, l.edges);
+        grow();
+        //Представитель множества - наименьший номер: он первым встречается
+        //при просмотре узлов по номерам
+        int a = uf_find(l.comp, from);
+        int b = uf_find(l.comp, to);
+        if(a != b) {
+            l.comp[std::max(a, b)] = std::min(a, b);
+        }
+    }, v, out, opts);
+    //Узлы без связей - из раздела весов
+    grow();
+    if(std::fflush(l.edges) != 0) {
+        out << "can't write temporary file" << std::endl;
+        return -1;
+    }
+    return ret;
+}
+
+//Просмотр рёбер временного файла f с начала
+template<typename F>
+static void each_edge(FILE *f, std::vector<std::pair<int, int>> &buf, F body) {
+    std::rewind(f);
+    size_t got;
+    while((got = std::fread(buf.data(), sizeof(buf[0]), buf.size(), f)) > 0) {
+        for(size_t i = 0; i < got; ++i) {
+            body(buf[i].first, buf[i].second);
+        }
+    }
+}
+
+int links_map(MappedLinks &l, size_t n, std::ostream &out) {
+    for(size_t id = 0; id < n; ++id) {
+        l.comp[id] = uf_find(l.comp, id);
+    }
+
+    //Концов рёбер у каждого узла, с повторами
+    std::vector<std::pair<int, int>> buf(READ_EDGES);
+    auto &first = l.first;
+    first.assign(n + 1, 0);
+    each_edge(l.edges, buf, [&](int a, int b) {
+        ++first[a + 1];
+        if(a != b) {
+            ++first[b + 1];
+        }
+    });
+    for(size_t id = 0; id < n; ++id) {
+        first[id + 1] += first[id];
+    }
+
+    //Отрезки номеров узлов, концы рёбер которых помещаются в бюджет
+    //(в отрезке не меньше одного узла)
+    std::vector<size_t> bounds{0};
+    for(size_t id = 0; id < n; ++id) {
+        if(id > bounds.back() && first[id + 1] - first[bounds.back()] > l.budget) {
+            bounds.push_back(id);
+        }
+    }
+    bounds.push_back(n);
+    size_t parts = bounds.size() - 1;
+
+    //Рёбра раскладываются по файлам отрезков их концов;
+    //единственный отрезок читается прямо из файла рёбер
+    std::vector<FILE *> files(parts);
+    bool failed = false;
+    if(parts > 1) {
+        for(auto &f : files) {
+            f = std::tmpfile();
+            failed = failed || !f;
+        }
+        auto part_of = [&](int id) {
+            return std::upper_bound(bounds.begin(), bounds.end(), size_t(id)) - bounds.begin() - 1;
+        };
+        if(!failed) {
+            each_edge(l.edges, buf, [&](int a, int b) {
+                std::pair<int, int> e{a, b};
+                size_t pa = part_of(a);
+                size_t pb = part_of(b);
+                std::fwrite(&e, sizeof(e), 1, files[pa]);
+                if(pb != pa) {
+                    std::fwrite(&e, sizeof(e), 1, files[pb]);
+                }
+            });
+        }
+        std::fclose(l.edges);
+        l.edges = nullptr;
+    } else {
+        files[0] = l.edges;
+        l.edges = nullptr;
+    }
+    l.file = std::tmpfile();
+    failed = failed || !l.file;
+
+    //Отрезок сортируется в памяти, повторные рёбра отбрасываются,
+    //списки дописываются в файл связей
+    std::vector<int> adj;
+    std::vector<size_t> pos;
+    size_t written = 0;
+    for(size_t p = 0; p < parts && !failed; ++p) {
+        size_t lo = bounds[p];
+        size_t hi = bounds[p + 1];
+        size_t base = first[lo];
+        adj.resize(first[hi] - base);
+        pos.assign(first.begin() + lo, first.begin() + hi);
+        auto place = [&](int a, int b) {
+            if(size_t(a) >= lo && size_t(a) < hi) {
+                adj[pos[a - lo]++ - base] = b;
+            }
+        };
+        failed = std::fflush(files[p]) != 0;
+        each_edge(files[p], buf, [&](int a, int b) {
+            place(a, b);
+            if(a != b) {
+                place(b, a);
+            }
+        });
+        std::fclose(files[p]);
+        files[p] = nullptr;
+
+        size_t k = 0;
+        size_t from = 0;
+        for(size_t id = lo; id < hi; ++id) {
+            size_t to = first[id + 1] - base;
+            int *begin = adj.data() + from;
+            std::sort(begin, adj.data() + to);
+            int *end = std::unique(begin, adj.data() + to);
+            first[id] = written + k;
+            k = std::move(begin, end, adj.data() + k) - adj.data();
+            from = to;
+        }
+        failed = failed || std::fwrite(adj.data(), sizeof(int), k, l.file) != k;
+        written += k;
+    }
+    for(auto f : files) {
+        if(f) {
+            std::fclose(f);
+        }
+    }
+    if(failed || std::fflush(l.file) != 0) {
+        out << "can't write temporary file" << std::endl;
+        return -1;
+    }
+    first[n] = written;
+
+    l.mapped = written * sizeof(int);
+    if(l.mapped) {
+        void *m = ::mmap(nullptr, l.mapped, PROT_READ, MAP_SHARED, fileno(l.file), 0);
+        if(m == MAP_FAILED) {
+            l.mapped = 0;
+            out << "can't map temporary file" << std::endl;
+            return -1;
+        }
+        l.adj = static_cast<const int *>(m);
+    }
+    return 0;
+}
@@ -0,0 +1,1130 @@
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+#include "mgt.h"
+#include "pool.h"
+
+/**
+ * Поиск набора из k узлов, совместное удаление которых даёт наименьшую
+ * оценку: сумму квадратов весов компонент оставшегося графа плюс веса
+ * удалённых узлов (при k = 1 - обычная оценка узла).
+ *
+ * Пара узлов u, v (k = 2) относится к одному из двух видов:
+ *   1. u и v не лежат в одном блоке (компоненте двусвязности) - в том
+ *      числе лежат в разных компонентах. Тогда части графа без u и v -
+ *      части без u, не содержащие v, части без v, не содержащие u,
+ *      и одна средняя часть между ними, и оценка пары считается за O(1)
+ *      по данным одиночного удаления: s(u) + s(v) - T + 2(W-a)(W-b),
+ *      где T - сумма квадратов весов компонент, W - вес общей компоненты,
+ *      a, b - веса частей без u и без v, содержащих другой узел.
+ *      При неотрицательных весах оценка пары не меньше
+ *      s(u) + s(v) - T + 2 e(u) e(v), где e(u) - вес компоненты без
+ *      наибольшей части без u (для разных компонент - s(u) + s(v) - T),
+ *      и по огибающей этих границ для каждого u находится нижняя граница
+ *      всех его пар. Узлы перебираются по возрастанию границ, пока
+ *      граница не превысит лучшую найденную оценку.
+ *   2. u и v лежат в одном блоке B. Всё, что подвешено к узлам блока
+ *      в дереве блоков и точек сочленения, переносится в веса c узлов
+ *      блока. Если B без u и v связен, оценка пары зависит только от
+ *      весов: остаток блока весит W - c(u) - c(v), и такие пары
+ *      перебираются по убыванию c с отсечением. B распадается только
+ *      тогда, когда один узел - предок другого в дереве обхода, а
+ *      поддерево ребёнка или путь между ними связаны только с этими
+ *      двумя узлами; такие пары находятся по обратным связям поддеревьев
+ *      (деревом отрезков) и считаются точно.
+ * Границы верны только для неотрицательных весов, при которых оценки
+ * точны; сами границы считаются в 128 битах (bound_t), поэтому отсечение
+ * не зависит от величины весов. Иначе перебираются все пары с модульными
+ * оценками, как в остальном расчёте, а пары блока - обходом B без каждого
+ * из его узлов.
+ * При k > 2 первый узел перебирается полностью, а для каждого
+ * из них остальные k - 1 ищутся на графе без него.
+ * Пары и узлы блоков обрабатываются на пуле. Среди равных оценок
+ * выбирается набор с наименьшими в лексикографическом порядке именами.
+ */
+
+//Наибольший суммарный вес графа, при котором оценки точны в Acc:
+//в value_t - S^2 + S < 2^64, в wide_t - любая сумма весов int
+template<typename Acc>
+static const wide_t BOUNDED_WEIGHT = std::is_same_v<Acc, value_t> ?
+        wide_t(std::numeric_limits<unsigned int>::max()) : wide_t(1) << 62;
+
+//Границы оценок: сумма оценок и удвоенных произведений весов частей
+//не помещается в 64 бита уже при точных оценках
+using bound_t = __int128;
+
+//Количество узлов в одной задаче пула при переборе пар
+static const size_t PAIR_GRAIN = 64;
+
+/**
+ * Граф с плотной нумерацией узлов в порядке имён
+ *   std::vector<const Name *> names : имена узлов
+ *   std::vector<Acc> w : веса узлов
+ *   std::vector<size_t> first : начало списка связей узла в adj
+ *   std::vector<int> adj : списки связей подряд
+ *   bool bounded : веса неотрицательны (не больше INT_MAX, как в needs_wide)
+ *                  и в сумме не больше BOUNDED_WEIGHT
+ *   int shift : отбрасываемые младшие разряды оценки в границе отсечения
+ *               (в wide_t оценка не помещается в 64-битный атомарный счётчик)
+ */
+template<typename Acc>
+struct Dense {
+    std::vector<const Name *> names;
+    std::vector<Acc> w;
+    std::vector<size_t> first;
+    std::vector<int> adj;
+    bool bounded{};
+    int shift{};
+};
+
+/**
+ * Лес обхода в глубину графа без удалённых узлов
+ *   comp, weight : компонента узла (-1 - удалён) и веса компонент
+ *   tin, size : время входа и размер поддерева (для проверки предка)
+ *   parent : родитель в дереве обхода (-1 - корень)
+ *   sep : при удалении родителя поддерево узла отделяется
+ *   sub, cut, squares : вес поддерева, сумма весов и квадратов
+ *                       отделяемых поддеревьев детей
+ *   rest : вес части с родителем при удалении узла
+ *   kid_first, kids : дети узла по времени входа
+ *   at : узлы по времени входа
+ *   block : верхний узел блока ребра в родителя (голова блока - его родитель)
+ *   member_first, members : узлы блока, кроме головы, по верхнему узлу
+ *   total : сумма квадратов весов компонент
+ */
+template<typename Acc>
+struct Forest {
+    std::vector<int> comp;
+    std::vector<Acc> weight;
+    std::vector<int> tin;
+    std::vector<int> size;
+    std::vector<int> parent;
+    std::vector<int> low;
+    std::vector<char> sep;
+    std::vector<Acc> sub;
+    std::vector<Acc> cut;
+    std::vector<Acc> squares;
+    std::vector<Acc> rest;
+    std::vector<int> kid_first;
+    std::vector<int> kids;
+    std::vector<int> block;
+    std::vector<int> member_first;
+    std::vector<int> members;
+    std::vector<int> at;
+    Acc total{};
+};
+
+/**
+ * Набор узлов с оценкой
+ *   Acc vitality : оценка
+ *   std::vector<int> ids : номера узлов по возрастанию
+ */
+template<typename Acc>
+struct KSet {
+    Acc vitality = std::numeric_limits<Acc>::max();
+    std::vector<int> ids;
+};
+
+//Порядок наборов: по оценке, при равенстве - по именам узлов
+template<typename Acc>
+static bool better(const KSet<Acc> &a, const KSet<Acc> &b) {
+    if(b.ids.empty()) {
+        return !a.ids.empty();
+    }
+    return a.vitality != b.vitality ? a.vitality < b.vitality : a.ids < b.ids;
+}
+
+template<typename Acc, typename L>
+static void dense_build(const L &l, Values &v, Dense<Acc> &d) {
+    size_t n = v.size();
+    //order[i] - номер в графе узла i по порядку имён, id - обратно
+    std::vector<int> order(n);
+    for(size_t i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(),
+            [&](int a, int b) { return *v.names[a] < *v.names[b]; });
+    std::vector<int> id(n);
+    d.names.resize(n);
+    for(size_t i = 0; i < n; ++i) {
+        id[order[i]] = i;
+        d.names[i] = v.names[order[i]];
+    }
+    d.w.resize(n);
+    d.first.assign(n + 1, 0);
+    wide_t sum = 0;
+    d.bounded = true;
+    for(size_t i = 0; i < n; ++i) {
+        d.w[i] = v.value[order[i]];
+        //Отрицательный вес хранится в value_t по модулю
+        d.bounded = d.bounded && d.w[i] <= Acc(std::numeric_limits<int>::max());
+        sum += d.w[i];
+        d.first[i + 1] = d.first[i] + l.degree(order[i]);
+    }
+    d.bounded = d.bounded && sum <= BOUNDED_WEIGHT<Acc>;
+    //Оценка пары не больше S^2 + S
+    d.shift = 0;
+    if(d.bounded) {
+        for(wide_t top = sum * sum + sum; (top >> d.shift) > std::numeric_limits<value_t>::max();) {
+            ++d.shift;
+        }
+    }
+    d.adj.resize(d.first[n]);
+    for(size_t i = 0; i < n; ++i) {
+        //Связи - по порядку имён, как и узлы
+        size_t k = d.first[i];
+        for(auto [j, end] = l.of(order[i]); j != end; ++j) {
+            d.adj[k++] = id[l.to(j)];
+        }
+        std::sort(d.adj.begin() + d.first[i], d.adj.begin() + k);
+    }
+}
+
+template<typename Acc>
+static void forest_build(const Dense<Acc> &d, const std::vector<char> &removed, Forest<Acc> &f) {
+    int n = d.w.size();
+    f.comp.assign(n, -1);
+    f.weight.clear();
+    f.tin.assign(n, -1);
+    f.size.assign(n, 1);
+    f.parent.assign(n, -1);
+    f.low.assign(n, 0);
+    f.sep.assign(n, 0);
+    f.sub.assign(n, 0);
+    f.cut.assign(n, 0);
+    f.squares.assign(n, 0);
+    f.rest.assign(n, 0);
+    f.block.assign(n, -1);
+
+    //Обход без рекурсии
+    std::vector<int> &order = f.at;
+    order.clear();
+    order.reserve(n);
+    std::vector<std::pair<int, size_t>> stack;
+    int timer = 0;
+    auto enter = [&](int x, int c) {
+        f.comp[x] = c;
+        f.tin[x] = f.low[x] = timer++;
+        f.sub[x] = d.w[x];
+        order.push_back(x);
+        stack.push_back({x, d.first[x]});
+    };
+    for(int r = 0; r < n; ++r) {
+        if(removed[r] || f.tin[r] != -1) {
+            continue;
+        }
+        int c = f.weight.size();
+        f.weight.push_back(0);
+        enter(r, c);
+        while(!stack.empty()) {
+            auto &[x, k] = stack.back();
+            if(k < d.first[x + 1]) {
+                int y = d.adj[k++];
+                if(removed[y] || y == x || y == f.parent[x]) {
+                    continue;
+                }
+                if(f.tin[y] != -1) {
+                    f.low[x] = std::min(f.low[x], f.tin[y]);
+                } else {
+                    f.parent[y] = x;
+                    enter(y, c);
+                }
+                continue;
+            }
+            int node = x;
+            stack.pop_back();
+            f.weight[c] += d.w[node];
+            int p = f.parent[node];
+            if(p >= 0) {
+                f.sub[p] += f.sub[node];
+                f.size[p] += f.size[node];
+                f.low[p] = std::min(f.low[p], f.low[node]);
+                f.sep[node] = f.low[node] >= f.tin[p];
+                if(f.sep[node]) {
+                    f.cut[p] += f.sub[node];
+                    f.squares[p] += f.sub[node] * f.sub[node];
+                }
+            }
+        }
+    }
+
+    f.total = 0;
+    for(auto w : f.weight) {
+        f.total += w * w;
+    }
+    //Блоки и дети узлов по времени входа
+    f.kid_first.assign(n + 1, 0);
+    f.member_first.assign(n + 1, 0);
+    for(int x : order) {
+        f.rest[x] = f.weight[f.comp[x]] - d.w[x] - f.cut[x];
+        int p = f.parent[x];
+        if(p >= 0) {
+            f.block[x] = f.sep[x] ? x : f.block[p];
+            ++f.kid_first[p + 1];
+            ++f.member_first[f.block[x] + 1];
+        }
+    }
+    for(int i = 0; i < n; ++i) {
+        f.kid_first[i + 1] += f.kid_first[i];
+        f.member_first[i + 1] += f.member_first[i];
+    }
+    f.kids.resize(f.kid_first[n]);
+    f.members.resize(f.member_first[n]);
+    std::vector<int> kid_next(f.kid_first.begin(), f.kid_first.end() - 1);
+    std::vector<int> member_next(f.member_first.begin(), f.member_first.end() - 1);
+    for(int x : order) {
+        int p = f.parent[x];
+        if(p >= 0) {
+            f.kids[kid_next[p]++] = x;
+            f.members[member_next[f.block[x]]++] = x;
+        }
+    }
+}
+
+//Сумма квадратов весов частей компоненты без узла x плюс вес x
+template<typename Acc>
+static Acc local(const Dense<Acc> &d, const Forest<Acc> &f, int x) {
+    return f.squares[x] + f.rest[x] * f.rest[x] + d.w[x];
+}
+
+//Оценка удаления одного узла x
+template<typename Acc>
+static Acc single(const Dense<Acc> &d, const Forest<Acc> &f, int x) {
+    Acc w = f.weight[f.comp[x]];
+    return f.total - w * w + local(d, f, x);
+}
+
+//Является ли a предком b или самим b
+template<typename Acc>
+static bool covers(const Forest<Acc> &f, int a, int b) {
+    return f.tin[a] <= f.tin[b] && f.tin[b] < f.tin[a] + f.size[a];
+}
+
+//Ребёнок x, в поддереве которого лежит y: последний с временем входа не больше
+template<typename Acc>
+static int kid_toward(const Forest<Acc> &f, int x, int y) {
+    auto from = f.kids.begin() + f.kid_first[x];
+    auto to = f.kids.begin() + f.kid_first[x + 1];
+    auto it = std::upper_bound(from, to, f.tin[y],
+            [&](int tin, int kid) { return tin < f.tin[kid]; });
+    return *(it - 1);
+}
+
+//Вес части компоненты без узла x, в которой лежит узел y той же компоненты
+template<typename Acc>
+static Acc piece_with(const Forest<Acc> &f, int x, int y) {
+    if(x != y && covers(f, x, y)) {
+        int kid = kid_toward(f, x, y);
+        if(f.sep[kid]) {
+            return f.sub[kid];
+        }
+    }
+    return f.rest[x];
+}
+
+//Лежат ли узлы u и v одной компоненты в одном блоке
+template<typename Acc>
+static bool share_block(const Forest<Acc> &f, int u, int v) {
+    if(f.parent[u] >= 0 && f.parent[v] >= 0 && f.block[u] == f.block[v]) {
+        return true;
+    }
+    return (f.parent[u] >= 0 && f.parent[f.block[u]] == v)
+        || (f.parent[v] >= 0 && f.parent[f.block[v]] == u);
+}
+
+/**
+ * Лучший набор в пределах одной задачи и общая граница отсечения
+ *   KSet<Acc> best : лучший найденный набор
+ *   std::atomic<value_t> *limit : лучшая оценка среди всех задач без shift
+ *                                 младших разрядов, округлённая вверх
+ *                                 (nullptr - отсечение отключено)
+ *   int shift : отбрасываемые разряды (Dense::shift)
+ */
+template<typename Acc>
+struct Finder {
+    KSet<Acc> best;
+    std::atomic<value_t> *limit{};
+    int shift{};
+};
+
+template<typename Acc>
+static void consider(Finder<Acc> &fd, Acc vitality, int u, int v) {
+    KSet<Acc> s;
+    s.vitality = vitality;
+    s.ids = {std::min(u, v), std::max(u, v)};
+    if(better(s, fd.best)) {
+        fd.best = std::move(s);
+        if(fd.limit) {
+            value_t key = value_t((vitality >> fd.shift) + ((vitality & ((Acc(1) << fd.shift) - 1)) != 0));
+            value_t cur = fd.limit->load();
+            while(key < cur && !fd.limit->compare_exchange_weak(cur, key)) {
+            }
+        }
+    }
+}
+
+//Граница не лучше найденной оценки (равные оценки не отсекаются из-за выбора по именам)
+template<typename Acc>
+static bool pruned(const Finder<Acc> &fd, bound_t bound) {
+    return fd.limit && bound > bound_t(fd.limit->load(std::memory_order_relaxed)) << fd.shift;
+}
+
+/**
+ * Прямая y = k * x + b
+ */
+struct Line {
+    bound_t k;
+    bound_t b;
+};
+
+/**
+ * Произведение x * y для |x| < 2^126, |y| < 2^63 в виде hi * 2^64 + lo:
+ * разность свободных членов прямых, умноженная на разность наклонов,
+ * может не поместиться в 128 бит
+ */
+struct Product {
+    bound_t hi;
+    uint64_t lo;
+};
+
+static Product multiply(bound_t x, bound_t y) {
+    bound_t low = bound_t(uint64_t(x)) * y;
+    return {(x >> 64) * y + (low >> 64), uint64_t(low)};
+}
+
+static bool operator>=(const Product &a, const Product &b) {
+    return a.hi != b.hi ? a.hi > b.hi : a.lo >= b.lo;
+}
+
+//Прямая b не опускается ниже огибающей прямых a и c (k: a > b > c)
+static bool hidden(const Line &a, const Line &b, const Line &c) {
+    return multiply(b.b - a.b, a.k - c.k) >= multiply(c.b - a.b, a.k - b.k);
+}
+
+//Минимум огибающей hull[from, to) (прямые по убыванию k) в точке x
+static bound_t hull_min(const std::vector<Line> &hull, size_t from, size_t to, bound_t x) {
+    while(to - from > 1) {
+        size_t mid = (from + to) / 2;
+        if(hull[mid - 1].k * x + hull[mid - 1].b > hull[mid].k * x + hull[mid].b) {
+            from = mid;
+        } else {
+            to = mid;
+        }
+    }
+    return hull[from].k * x + hull[from].b;
+}
+
+/**
+ * Нижние границы оценок пар из разных блоков для каждого узла u.
+ * Части без u, кроме содержащей v, не меньше e(u) = W - (наибольшая часть),
+ * поэтому оценка пары не меньше s(u) + s(v) - T + 2 e(u) e(v), а минимум
+ * по v своей компоненты - нижняя огибающая прямых s(v) + 2 e(v) x в точке e(u).
+ * С узлами других компонент оценка пары - s(u) + s(v) - T.
+ */
+template<typename Acc>
+static void apart_bounds(const Forest<Acc> &f, const std::vector<int> &nodes,
+        const std::vector<Acc> &s, const std::vector<Acc> &e, std::vector<bound_t> &lo) {
+    size_t comps = f.weight.size();
+    const bound_t none = bound_t(1) << 125;
+    std::vector<bound_t> least(comps, none);
+    for(int x : nodes) {
+        least[f.comp[x]] = std::min(least[f.comp[x]], bound_t(s[x]));
+    }
+    //Две наименьшие одиночные оценки среди компонент
+    size_t first_comp = comps;
+    bound_t first = none;
+    bound_t second = none;
+    for(size_t c = 0; c < comps; ++c) {
+        if(least[c] < first) {
+            second = first;
+            first = least[c];
+            first_comp = c;
+        } else {
+            second = std::min(second, least[c]);
+        }
+    }
+
+    std::vector<int> lines(nodes);
+    std::sort(lines.begin(), lines.end(), [&](int a, int b) {
+        if(f.comp[a] != f.comp[b]) {
+            return f.comp[a] < f.comp[b];
+        }
+        return e[a] != e[b] ? e[a] > e[b] : s[a] < s[b];
+    });
+    std::vector<Line> hull;
+    std::vector<size_t> hull_first(comps + 1);
+    for(size_t i = 0; i < lines.size(); ++i) {
+        int c = f.comp[lines[i]];
+        if(i == 0 || f.comp[lines[i - 1]] != c) {
+            hull_first[c] = hull.size();
+        }
+        Line l{2 * bound_t(e[lines[i]]), bound_t(s[lines[i]])};
+        size_t from = hull_first[c];
+        if(hull.size() > from && hull.back().k == l.k) {
+            continue;
+        }
+        while(hull.size() >= from + 2 && hidden(hull[hull.size() - 2], hull.back(), l)) {
+            hull.pop_back();
+        }
+        hull.push_back(l);
+        hull_first[c + 1] = hull.size();
+    }
+
+    bound_t t = f.total;
+    for(int x : nodes) {
+        size_t c = f.comp[x];
+        bound_t pair = c == first_comp ? second : first;
+        pair = std::min(pair, hull_min(hull, hull_first[c], hull_first[c + 1], e[x]));
+        lo[x] = bound_t(s[x]) - t + pair;
+    }
+}
+
+/**
+ * Пары узлов из разных блоков для узлов order[from, to): узел u
+ * пропускается по нижней границе lo[u], партнёры v - позже u в order,
+ * по возрастанию одиночных оценок (by_s), пока s(u) + s(v) - T
+ * не превысит найденную оценку
+ */
+template<typename Acc>
+static void pairs_apart(const Forest<Acc> &f, const std::vector<int> &order,
+        const std::vector<int> &rank, const std::vector<int> &by_s,
+        const std::vector<Acc> &s, const std::vector<Acc> &e,
+        const std::vector<bound_t> &lo, Finder<Acc> &fd, size_t from, size_t to) {
+    for(size_t i = from; i < to; ++i) {
+        int u = order[i];
+        if(pruned(fd, lo[u])) {
+            break;
+        }
+        //s(u) + s(v) - T + 2 e(u) e(v) может быть отрицательной
+        //и не помещаться в Acc - границы в bound_t
+        bound_t su = bound_t(s[u]) - bound_t(f.total);
+        for(int v : by_s) {
+            if(pruned(fd, su + s[v])) {
+                break;
+            }
+            if(rank[v] <= rank[u]) {
+                continue;
+            }
+            if(f.comp[u] != f.comp[v]) {
+                consider(fd, s[u] + s[v] - f.total, u, v);
+                continue;
+            }
+            if(pruned(fd, su + s[v] + 2 * bound_t(e[u]) * e[v]) || share_block(f, u, v)) {
+                continue;
+            }
+            Acc w = f.weight[f.comp[u]];
+            Acc a = piece_with(f, u, v);
+            Acc b = piece_with(f, v, u);
+            consider(fd, s[u] + s[v] - f.total + 2 * (w - a) * (w - b), u, v);
+        }
+    }
+}
+
+/**
+ * Узлы блока с подвешенными к ним частями
+ *   int top : верхний узел блока
+ *   std::vector<int> nodes : голова и остальные узлы блока
+ *   std::vector<Acc> c : вес узла вместе с подвешенными частями
+ *   std::vector<Acc> hs : сумма квадратов подвешенных частей плюс вес узла
+ *   std::vector<int> by_c : номера узлов в блоке по убыванию c
+ *   Acc hs_min : наименьший hs по блоку
+ */
+template<typename Acc>
+struct Block {
+    int top{};
+    std::vector<int> nodes;
+    std::vector<Acc> c;
+    std::vector<Acc> hs;
+    std::vector<int> by_c;
+    Acc hs_min{};
+};
+
+template<typename Acc>
+static void block_build(const Dense<Acc> &d, const Forest<Acc> &f, int top, Block<Acc> &b) {
+    int head = f.parent[top];
+    b.top = top;
+    b.nodes.assign(1, head);
+    b.nodes.insert(b.nodes.end(), f.members.begin() + f.member_first[top],
+            f.members.begin() + f.member_first[top + 1]);
+    size_t m = b.nodes.size();
+    b.c.resize(m);
+    b.hs.resize(m);
+    //К голове подвешено всё, кроме поддерева верхнего узла блока
+    Acc w = f.weight[f.comp[head]];
+    b.c[0] = w - f.sub[top];
+    b.hs[0] = local(d, f, head) - f.sub[top] * f.sub[top];
+    for(size_t i = 1; i < m; ++i) {
+        int x = b.nodes[i];
+        b.c[i] = d.w[x] + f.cut[x];
+        b.hs[i] = f.squares[x] + d.w[x];
+    }
+    b.by_c.resize(m);
+    for(size_t i = 0; i < m; ++i) {
+        b.by_c[i] = i;
+    }
+    std::sort(b.by_c.begin(), b.by_c.end(), [&](int x, int y) {
+        return b.c[x] != b.c[y] ? b.c[x] > b.c[y] : x < y;
+    });
+    b.hs_min = *std::min_element(b.hs.begin(), b.hs.end());
+}
+
+//Оценки пар (u, v) блока: обход в глубину по блоку без узла с номером ui
+template<typename Acc>
+static void pairs_in_block(const Dense<Acc> &d, const std::vector<char> &removed, const Forest<Acc> &f,
+        const Block<Acc> &b, size_t ui, Finder<Acc> &fd) {
+    size_t m = b.nodes.size();
+    int head = b.nodes[0];
+    Acc w = f.weight[f.comp[head]];
+    Acc others = f.total - w * w;
+
+    //Номер узла в блоке по номеру в графе; после обхода сбрасывается
+    static thread_local std::vector<int> slot;
+    if(slot.size() < d.w.size()) {
+        slot.assign(d.w.size(), -1);
+    }
+    for(size_t i = 0; i < m; ++i) {
+        slot[b.nodes[i]] = i;
+    }
+    std::vector<size_t> first(m + 1);
+    std::vector<int> adj;
+    for(size_t i = 0; i < m; ++i) {
+        int x = b.nodes[i];
+        for(size_t k = d.first[x]; k < d.first[x + 1]; ++k) {
+            int y = d.adj[k];
+            if(!removed[y] && y != x && slot[y] >= 0) {
+                adj.push_back(slot[y]);
+            }
+        }
+        first[i + 1] = adj.size();
+    }
+    for(size_t i = 0; i < m; ++i) {
+        slot[b.nodes[i]] = -1;
+    }
+
+    //Блок без ui связен: один обход от любого другого узла
+    std::vector<int> tin(m, -1);
+    std::vector<int> low(m);
+    std::vector<int> parent(m, -1);
+    std::vector<Acc> sub(m);
+    std::vector<Acc> cut(m);
+    std::vector<Acc> squares(m);
+    std::vector<std::pair<int, size_t>> stack;
+    int timer = 0;
+    auto enter = [&](int x) {
+        tin[x] = low[x] = timer++;
+        sub[x] = b.c[x];
+        stack.push_back({x, first[x]});
+    };
+    enter(ui == 0 ? 1 : 0);
+    while(!stack.empty()) {
+        auto &[x, k] = stack.back();
+        if(k < first[x + 1]) {
+            int y = adj[k++];
+            if((size_t)y == ui || y == parent[x]) {
+                continue;
+            }
+            if(tin[y] != -1) {
+                low[x] = std::min(low[x], tin[y]);
+            } else {
+                parent[y] = x;
+                enter(y);
+            }
+            continue;
+        }
+        int node = x;
+        stack.pop_back();
+        int p = parent[node];
+        if(p >= 0) {
+            sub[p] += sub[node];
+            low[p] = std::min(low[p], low[node]);
+            if(low[node] >= tin[p]) {
+                cut[p] += sub[node];
+                squares[p] += sub[node] * sub[node];
+            }
+        }
+    }
+
+    Acc mass = w - b.c[ui];
+    for(size_t v = 0; v < m; ++v) {
+        if(v == ui) {
+            continue;
+        }
+        Acc rest = mass - b.c[v] - cut[v];
+        consider(fd, others + b.hs[ui] + b.hs[v] + squares[v] + rest * rest,
+                b.nodes[ui], b.nodes[v]);
+    }
+}
+
+/**
+ * Дерево отрезков для минимума
+ *   size_t size : количество листьев (степень двойки)
+ *   std::vector<int> t : узлы дерева, листья - с позиции size
+ */
+struct MinTree {
+    size_t size{};
+    std::vector<int> t;
+};
+
+static void tree_init(MinTree &m, size_t n) {
+    m.size = 1;
+    while(m.size < n) {
+        m.size *= 2;
+    }
+    m.t.assign(2 * m.size, std::numeric_limits<int>::max());
+}
+
+//Уменьшение значения в позиции pos до value
+static void tree_lower(MinTree &m, size_t pos, int value) {
+    for(pos += m.size; pos > 0 && m.t[pos] > value; pos /= 2) {
+        m.t[pos] = value;
+    }
+}
+
+//Минимум на отрезке [from, to)
+static int tree_min(const MinTree &m, size_t from, size_t to) {
+    int r = std::numeric_limits<int>::max();
+    for(from += m.size, to += m.size; from < to; from /= 2, to /= 2) {
+        if(from & 1) {
+            r = std::min(r, m.t[from++]);
+        }
+        if(to & 1) {
+            r = std::min(r, m.t[--to]);
+        }
+    }
+    return r;
+}
+
+//Первая (last = false) или последняя позиция [from, to) со значением меньше below
+//в поддереве node, покрывающем [lo, hi); -1 - таких нет
+static int tree_find(const MinTree &m, size_t from, size_t to, int below, bool last,
+        size_t node, size_t lo, size_t hi) {
+    if(hi <= from || to <= lo || m.t[node] >= below) {
+        return -1;
+    }
+    if(hi - lo == 1) {
+        return lo;
+    }
+    size_t mid = (lo + hi) / 2;
+    int r = last ? tree_find(m, from, to, below, last, 2 * node + 1, mid, hi)
+                 : tree_find(m, from, to, below, last, 2 * node, lo, mid);
+    if(r >= 0) {
+        return r;
+    }
+    return last ? tree_find(m, from, to, below, last, 2 * node, lo, mid)
+                : tree_find(m, from, to, below, last, 2 * node + 1, mid, hi);
+}
+
+/**
+ * Данные обхода для поиска разделяющих пар блоков
+ *   MinTree own : по времени входа узла - наименьшее время входа предка,
+ *                 с которым узел связан обратной связью
+ *   std::vector<int> hi : наибольшее время входа предка выше родителя узла,
+ *                         с которым связано поддерево узла (-1 - такого нет)
+ *   std::vector<std::vector<int>> lift : lift[i][x] - предок x на 2^i
+ *                                        уровней выше (корень - сам x)
+ */
+struct Splits {
+    MinTree own;
+    std::vector<int> hi;
+    std::vector<std::vector<int>> lift;
+};
+
+template<typename Acc>
+static void splits_build(const Dense<Acc> &d, const std::vector<char> &removed, const Forest<Acc> &f,
+        Splits &sp) {
+    size_t n = d.w.size();
+    size_t count = f.at.size();
+    //Обратные связи (время входа предка, время входа узла)
+    std::vector<std::pair<int, int>> back;
+    tree_init(sp.own, count);
+    for(int x : f.at) {
+        for(size_t k = d.first[x]; k < d.first[x + 1]; ++k) {
+            int y = d.adj[k];
+            if(removed[y] || y == f.parent[x] || f.tin[y] >= f.tin[x]) {
+                continue;
+            }
+            back.push_back({f.tin[y], f.tin[x]});
+            tree_lower(sp.own, f.tin[x], f.tin[y]);
+        }
+    }
+
+    //Дети перебираются по возрастанию времени входа родителя, а связи
+    //добавляются в дерево (со знаком минус) по возрастанию времени входа предка
+    std::sort(back.begin(), back.end());
+    MinTree high;
+    tree_init(high, count);
+    sp.hi.assign(n, -1);
+    size_t next = 0;
+    for(int p : f.at) {
+        for(; next < back.size() && back[next].first < f.tin[p]; ++next) {
+            tree_lower(high, back[next].second, -back[next].first);
+        }
+        for(int k = f.kid_first[p]; k < f.kid_first[p + 1]; ++k) {
+            int c = f.kids[k];
+            int r = tree_min(high, f.tin[c], f.tin[c] + f.size[c]);
+            sp.hi[c] = r == std::numeric_limits<int>::max() ? -1 : -r;
+        }
+    }
+
+    size_t levels = 1;
+    while((size_t(1) << levels) < count) {
+        ++levels;
+    }
+    sp.lift.assign(levels, std::vector<int>(n));
+    for(size_t x = 0; x < n; ++x) {
+        sp.lift[0][x] = f.parent[x] >= 0 ? f.parent[x] : x;
+    }
+    for(size_t i = 1; i < levels; ++i) {
+        for(size_t x = 0; x < n; ++x) {
+            sp.lift[i][x] = sp.lift[i - 1][sp.lift[i - 1][x]];
+        }
+    }
+}
+
+//Наименьший общий предок узлов a и b
+template<typename Acc>
+static int lca(const Forest<Acc> &f, const Splits &sp, int a, int b) {
+    if(covers(f, a, b)) {
+        return a;
+    }
+    for(size_t i = sp.lift.size(); i-- > 0;) {
+        if(!covers(f, sp.lift[i][a], b)) {
+            a = sp.lift[i][a];
+        }
+    }
+    return f.parent[a];
+}
+
+//Общий предок узлов поддерева dv, связанных обратными связями с узлами
+//выше родителя dv (-1 - таких узлов нет)
+template<typename Acc>
+static int lifted(const Forest<Acc> &f, const Splits &sp, int dv) {
+    size_t from = f.tin[dv];
+    size_t to = from + f.size[dv];
+    int below = f.tin[f.parent[dv]];
+    int first = tree_find(sp.own, from, to, below, false, 1, 0, sp.own.size);
+    if(first < 0) {
+        return -1;
+    }
+    int last = tree_find(sp.own, from, to, below, true, 1, 0, sp.own.size);
+    return lca(f, sp, f.at[first], f.at[last]);
+}
+
+/**
+ * Оценка пары узлов блока, где v - предок u в дереве обхода.
+ * Блок без u и v распадается не более чем на группы: над v (всё вне
+ * поддерева dv - ребёнка v на пути к u), между v и u и поддеревья детей u.
+ * Поддерево ребёнка связано с верхней группой, если его обратные связи
+ * уходят выше v, и со средней - если есть связь с предком между v и u;
+ * средняя группа напрямую связана с верхней, если её узлы связаны
+ * с узлами выше v, т.е. не все такие узлы поддерева dv (их общий предок
+ * top) лежат в поддереве u.
+ */
+template<typename Acc>
+static Acc pair_related(const Dense<Acc> &d, const Forest<Acc> &f, const Splits &sp, const Block<Acc> &b,
+        int u, int v, int dv, int top) {
+    int head = b.nodes[0];
+    Acc w = f.weight[f.comp[u]];
+    Acc cv = v == head ? b.c[0] : d.w[v] + f.cut[v];
+    Acc hv = v == head ? b.hs[0] : f.squares[v] + d.w[v];
+    Acc above = w - cv - f.sub[dv];
+    Acc between = f.sub[dv] - f.sub[u];
+    bool joined = v != head && dv != u && top >= 0 && !covers(f, u, top);
+    Acc alone = 0;
+    for(int k = f.kid_first[u]; k < f.kid_first[u + 1]; ++k) {
+        int c = f.kids[k];
+        if(f.sep[c]) {
+            continue;
+        }
+        bool up = f.low[c] < f.tin[v];
+        bool mid = sp.hi[c] > f.tin[v];
+        if(up) {
+            above += f.sub[c];
+            joined = joined || mid;
+        } else if(mid) {
+            between += f.sub[c];
+        } else {
+            alone += f.sub[c] * f.sub[c];
+        }
+    }
+    Acc parts = joined ? (above + between) * (above + between)
+                           : above * above + between * between;
+    return f.total - w * w + f.squares[u] + d.w[u] + hv + parts + alone;
+}
+
+/**
+ * Пары блока, которые могут разделить блок (разделяющие пары), для узла x:
+ *   - x - ребёнок, поддерево которого связано только с одним предком v
+ *     выше родителя u: пара (u, v);
+ *   - x - ребёнок v (не головы): пары (u, v) для u на пути от x (без него)
+ *     до общего предка узлов поддерева x, связанных с узлами выше v, -
+ *     без u и v часть между ними не связана с частью над v напрямую.
+ * Пары, где ни один узел не предок другого, блок не разделяют.
+ */
+template<typename Acc>
+static void pairs_split(const Dense<Acc> &d, const Forest<Acc> &f, const Splits &sp, const Block<Acc> &b,
+        int x, Finder<Acc> &fd) {
+    int head = b.nodes[0];
+    int u = f.parent[x];
+    if(u != head && sp.hi[x] >= 0 && f.low[x] == sp.hi[x]) {
+        int v = f.at[f.low[x]];
+        int dv = kid_toward(f, v, u);
+        consider(fd, pair_related(d, f, sp, b, u, v, dv, v == head ? -1 : lifted(f, sp, dv)), u, v);
+    }
+    if(u != head) {
+        int top = lifted(f, sp, x);
+        for(int y = top; y >= 0 && y != x; y = f.parent[y]) {
+            consider(fd, pair_related(d, f, sp, b, y, u, x, top), y, u);
+        }
+    }
+}
+
+/**
+ * Пары блока без разделения для узла с номером by_c[i]: оставшаяся
+ * часть блока весит W - c(u) - c(v), партнёры - дальше по убыванию c,
+ * пока оценка не станет хуже найденной
+ */
+template<typename Acc>
+static void pairs_whole(const Forest<Acc> &f, const Block<Acc> &b, size_t i, Finder<Acc> &fd) {
+    int x = b.by_c[i];
+    Acc w = f.weight[f.comp[b.nodes[0]]];
+    Acc others = f.total - w * w;
+    for(size_t j = i + 1; j < b.by_c.size(); ++j) {
+        int y = b.by_c[j];
+        Acc rest = w - b.c[x] - b.c[y];
+        if(pruned(fd, bound_t(others) + b.hs[x] + b.hs_min + bound_t(rest) * rest)) {
+            break;
+        }
+        consider(fd, others + b.hs[x] + b.hs[y] + rest * rest, b.nodes[x], b.nodes[y]);
+    }
+}
+
+//Лучшая пара графа без удалённых узлов
+template<typename Acc>
+static KSet<Acc> best_pair(const Dense<Acc> &d, const std::vector<char> &removed, Pool *pool) {
+    Forest<Acc> f;
+    forest_build(d, removed, f);
+    size_t n = d.w.size();
+    std::atomic<value_t> limit(std::numeric_limits<value_t>::max());
+    std::mutex lock;
+    KSet<Acc> best;
+    auto merge = [&](Finder<Acc> &fd) {
+        std::lock_guard<std::mutex> guard(lock);
+        if(better(fd.best, best)) {
+            best = std::move(fd.best);
+        }
+    };
+
+    //1. Пары из одного блока (первыми - их оценки дают начальную границу):
+    //блоки из двух узлов - сразу, остальные - по узлам: без отсечения -
+    //обходом блока без узла, с отсечением - разделяющие пары отдельно,
+    //остальные по весам
+    std::vector<int> tops;
+    for(int x : f.at) {
+        if(f.parent[x] >= 0 && f.sep[x]) {
+            tops.push_back(x);
+        }
+    }
+    std::vector<Block<Acc>> blocks(tops.size());
+    std::vector<int> block_of(n, -1);
+    std::vector<std::pair<int, int>> tasks;
+    std::vector<int> members;
+    {
+        Finder<Acc> fd;
+        fd.limit = d.bounded ? &limit : nullptr;
+        fd.shift = d.shift;
+        for(size_t i = 0; i < tops.size(); ++i) {
+            Block<Acc> &b = blocks[i];
+            block_build(d, f, tops[i], b);
+            if(b.nodes.size() == 2) {
+                Acc w = f.weight[f.comp[b.nodes[0]]];
+                consider(fd, f.total - w * w + b.hs[0] + b.hs[1], b.nodes[0], b.nodes[1]);
+                continue;
+            }
+            block_of[tops[i]] = i;
+            for(size_t ui = 0; ui < b.nodes.size(); ++ui) {
+                tasks.push_back({i, ui});
+            }
+            members.insert(members.end(), b.nodes.begin() + 1, b.nodes.end());
+        }
+        merge(fd);
+    }
+    if(!d.bounded) {
+        pool_for(pool, tasks.size(), 1, [&](size_t from, size_t to) {
+            Finder<Acc> fd;
+            for(size_t t = from; t < to; ++t) {
+                pairs_in_block(d, removed, f, blocks[tasks[t].first], tasks[t].second, fd);
+            }
+            merge(fd);
+        });
+    } else if(!members.empty()) {
+        Splits sp;
+        splits_build(d, removed, f, sp);
+        pool_for(pool, members.size(), PAIR_GRAIN, [&](size_t from, size_t to) {
+            Finder<Acc> fd;
+            fd.limit = &limit;
+            fd.shift = d.shift;
+            for(size_t i = from; i < to; ++i) {
+                int x = members[i];
+                pairs_split(d, f, sp, blocks[block_of[f.block[x]]], x, fd);
+            }
+            merge(fd);
+        });
+        pool_for(pool, tasks.size(), PAIR_GRAIN, [&](size_t from, size_t to) {
+            Finder<Acc> fd;
+            fd.limit = &limit;
+            fd.shift = d.shift;
+            for(size_t t = from; t < to; ++t) {
+                pairs_whole(f, blocks[tasks[t].first], tasks[t].second, fd);
+            }
+            merge(fd);
+        });
+    }
+
+    //2. Пары из разных блоков; при отсечении - по возрастанию нижних границ
+    std::vector<Acc> s(n);
+    std::vector<Acc> e(n);
+    std::vector<int> order;
+    for(int x : f.at) {
+        s[x] = single(d, f, x);
+        Acc part = f.rest[x];
+        for(int k = f.kid_first[x]; k < f.kid_first[x + 1]; ++k) {
+            if(f.sep[f.kids[k]]) {
+                part = std::max(part, f.sub[f.kids[k]]);
+            }
+        }
+        e[x] = f.weight[f.comp[x]] - part;
+        order.push_back(x);
+    }
+    std::vector<bound_t> lo(n);
+    std::vector<int> by_s(order);
+    if(d.bounded) {
+        apart_bounds(f, order, s, e, lo);
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            return lo[a] != lo[b] ? lo[a] < lo[b] : a < b;
+        });
+        std::sort(by_s.begin(), by_s.end(), [&](int a, int b) {
+            return s[a] != s[b] ? s[a] < s[b] : a < b;
+        });
+    }
+    std::vector<int> rank(n);
+    for(size_t i = 0; i < order.size(); ++i) {
+        rank[order[i]] = i;
+    }
+    pool_for(pool, order.size(), PAIR_GRAIN, [&](size_t from, size_t to) {
+        Finder<Acc> fd;
+        fd.limit = d.bounded ? &limit : nullptr;
+        fd.shift = d.shift;
+        pairs_apart(f, order, rank, by_s, s, e, lo, fd, from, to);
+        merge(fd);
+    });
+    return best;
+}
+
+//Лучший набор из k узлов графа без удалённых; k не больше числа оставшихся узлов
+template<typename Acc>
+static KSet<Acc> best_kset(const Dense<Acc> &d, std::vector<char> &removed, size_t k, Pool *pool) {
+    if(k == 2) {
+        return best_pair(d, removed, pool);
+    }
+    size_t n = d.w.size();
+    if(k == 1) {
+        Forest<Acc> f;
+        forest_build(d, removed, f);
+        KSet<Acc> best;
+        for(int x : f.at) {
+            KSet<Acc> s;
+            s.vitality = single(d, f, x);
+            s.ids = {x};
+            if(better(s, best)) {
+                best = std::move(s);
+            }
+        }
+        return best;
+    }
+    //Первый узел перебирается полностью, остальные ищутся без него
+    std::mutex lock;
+    KSet<Acc> best;
+    pool_for(pool, n, 1, [&](size_t from, size_t to) {
+        std::vector<char> mask(removed);
+        for(size_t u = from; u < to; ++u) {
+            if(mask[u]) {
+                continue;
+            }
+            mask[u] = 1;
+            KSet<Acc> s = best_kset(d, mask, k - 1, nullptr);
+            mask[u] = 0;
+            s.vitality += d.w[u];
+            s.ids.insert(std::lower_bound(s.ids.begin(), s.ids.end(), (int)u), u);
+            std::lock_guard<std::mutex> guard(lock);
+            if(better(s, best)) {
+                best = std::move(s);
+            }
+        }
+    });
+    return best;
+}
+
+template<typename Acc, typename L>
+static void kset(std::ostream &out, const L &l, Values &v, const Options &opts, Pool *pool) {
+    Dense<Acc> d;
+    dense_build(l, v, d);
+    size_t n = d.w.size();
+    KSet<Acc> best;
+    if(opts.remove >= n) {
+        //Удаляются все узлы: остаются только их веса
+        best.vitality = 0;
+        for(size_t x = 0; x < n; ++x) {
+            best.ids.push_back(x);
+            best.vitality += d.w[x];
+        }
+    } else {
+        std::vector<char> removed(n);
+        best = best_kset(d, removed, opts.remove, pool);
+    }
+
+    out << "[";
+    if(!best.ids.empty()) {
+        out << "(";
+        for(size_t i = 0; i < best.ids.size(); ++i) {
+            out << (i ? ", " : "") << "\'" << *d.names[best.ids[i]] << "\'";
+        }
+        if(opts.top || opts.all) {
+            out << ", " << best.vitality;
+        }
+        out << ")";
+    }
+    out << "]" << std::endl;
+}
+
+void print_kset(std::ostream &out, const Links &l, Values &v, const Options &opts, Pool *pool,
+        bool wide) {
+    if(wide) {
+        kset<wide_t>(out, l, v, opts, pool);
+    } else {
+        kset<value_t>(out, l, v, opts, pool);
+    }
+}
+
+void print_kset(std::ostream &out, const PackedLinks &l, Values &v, const Options &opts, Pool *pool,
+        bool wide) {
+    if(wide) {
+        kset<wide_t>(out, l, v, opts, pool);
+    } else {
+        kset<value_t>(out, l, v, opts, pool);
+    }
+}
+
+void print_kset(std::ostream &out, const MappedLinks &l, Values &v, const Options &opts, Pool *pool,
+        bool wide) {
+    if(wide) {
+        kset<wide_t>(out, l, v, opts, pool);
+    } else {
+        kset<value_t>(out, l, v, opts, pool);
+    }
+}
@@ -0,0 +1,260 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <sys/stat.h>
+
+#include "mgt.h"
+#include "pool.h"
+
+//Вывод строки в формате JSON (с экранированием)
+void print_json_str(std::ostream &out, const std::string &s) {
+    out << '"';
+    for(char c : s) {
+        if(c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if(static_cast<unsigned char>(c) < 0x20) {
+            out << ' ';
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+//Вывод отчёта о профилировании одного файла в виде одной строки JSON
+void print_profile(std::ostream &out, const std::string &file, const Profile &prof) {
+    out << "{\"file\":";
+    print_json_str(out, file);
+    out << ",\"nodes\":" << prof.nodes
+        << ",\"edges\":" << prof.edges
+        << ",\"components\":" << prof.components
+        << ",\"cutpoints\":" << prof.cutpoints
+        << ",\"largest_component\":" << prof.largest_component
+        << ",\"id_bits\":" << prof.id_bits
+        << ",\"sum_bits\":" << prof.sum_bits
+        << ",\"stages\":{";
+    for(int i = 0; i < Profile::STAGES; ++i) {
+        out << (i ? "," : "") << '"' << Profile::stage_names[i] << "\":{"
+            << "\"wall_ms\":" << prof.stages[i].wall_ms
+            << ",\"cpu_ms\":" << prof.stages[i].cpu_ms
+            << ",\"rss_kb\":" << prof.stages[i].rss_kb << "}";
+    }
+    out << "}}" << std::endl;
+}
+
+/**
+ * Обработка одного файла
+ * Параметры:
+ *   const char *name : имя файла
+ *   bool profile : вывести профиль обработки в err
+ *   const Options &opts : параметры запроса по умолчанию
+ *   const std::vector<Weights> *scenarios : если не nullptr - оценить
+ *                                          сценарии весов вместо весов из файла
+ *   std::ostream &out : поток для результата
+ *   std::ostream &err : поток для профиля
+ */
+void run_file(const char *name, bool profile, const Options &opts,
+        const std::vector<Weights> *scenarios, std::ostream &out, std::ostream &err) {
+    //Отладка
+    out <<name <<": ";
+
+    std::ifstream in(name);
+    if(!in.is_open()) {
+        out <<"can't open file" <<std::endl;
+        return;
+    }
+
+    if(scenarios) {
+        //Граф разбирается и анализируется один раз на все сценарии
+        Model m;
+        if(model_build(m, in, out) == 0) {
+            Topology t;
+            topology_build(m, t);
+            what_if(t, *scenarios, out);
+        }
+        return;
+    }
+
+    Profile prof;
+    process(in, out, profile ? &prof : nullptr, opts);
+    if(profile) {
+        print_profile(err, name, prof);
+    }
+}
+
+/**
+ * Задание пакетной обработки одного файла
+ *   char *name : имя файла
+ *   off_t size : размер файла (для порядка постановки в пул)
+ *   std::string out, err : результат и профиль
+ *   bool done : обработка завершена
+ */
+struct Job {
+    char *name{};
+    off_t size{};
+    std::string out;
+    std::string err;
+    bool done{};
+};
+
+/**
+ * Параллельная обработка файлов пулом из threads потоков.
+ * Файлы ставятся в пул от большего к меньшему, чтобы крупные
+ * не оказались в хвосте, а результаты выводятся в порядке аргументов
+ * по мере готовности.
+ */
+void run_parallel(char *names[], int count, bool profile, const Options &opts,
+        const std::vector<Weights> *scenarios, unsigned threads) {
+    std::vector<Job> jobs(count);
+    std::vector<int> order(count);
+    for(int i = 0; i < count; ++i) {
+        struct stat st;
+        jobs[i].name = names[i];
+        jobs[i].size = ::stat(names[i], &st) == 0 ? st.st_size : 0;
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return jobs[a].size > jobs[b].size;
+    });
+
+    std::mutex lock;
+    std::condition_variable finished;
+    Pool pool;
+    pool_start(pool, threads);
+    //Компоненты графов обрабатываются на том же пуле
+    set_engine_pool(&pool);
+    for(int i : order) {
+        pool_submit(pool, [&, i]() {
+            std::ostringstream out, err;
+            run_file(jobs[i].name, profile, opts, scenarios, out, err);
+            std::lock_guard<std::mutex> guard(lock);
+            jobs[i].out = out.str();
+            jobs[i].err = err.str();
+            jobs[i].done = true;
+            finished.notify_all();
+        });
+    }
+
+    for(auto &job : jobs) {
+        std::string out, err;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            finished.wait(guard, [&]() { return job.done; });
+            out.swap(job.out);
+            err.swap(job.err);
+        }
+        std::cout <<out <<std::flush;
+        std::cerr <<err;
+    }
+    set_engine_pool(nullptr);
+    pool_stop(pool);
+}
+
+/**
+ * Параметры:
+ *   --profile - для каждого файла вывести в stderr строку JSON
+ *               с затратами времени и памяти по этапам и статистикой графа
+ *   -j N - обрабатывать файлы и компоненты связности графов параллельно
+ *          в N потоках (0 - по числу процессоров),
+ *          результаты выводятся в порядке аргументов
+ *   --top K - вывести K лучших узлов с оценками
+ *   --all - вывести оценки всех узлов по возрастанию
+ *           (параметры 'top'/'all' во входных данных важнее)
+ *   --edges - оценивать удаление связей-мостов вместо узлов
+ *   --remove K - найти K узлов, совместное удаление которых лучше всего
+ *   --order ORDER - перенумеровать узлы перед анализом для локальности
+ *                   обращений к памяти: none (по умолчанию), bfs, rcm, degree
+ *   --packed - хранить связи в сжатом виде: для очень больших графов,
+ *              вместе с --order bfs или rcm (кроме --scenarios)
+ *   --external MB - внешний режим для графов больше памяти: связи -
+ *                   во временных файлах, сортировка порциями
+ *                   по MB мегабайт (кроме --scenarios)
+ *   --scenarios FILE - вместо весов из файлов оценить наборы весов
+ *                      [{'A':1,...},{...}] из FILE и вывести лучшие узлы
+ *                      каждого набора одной строкой на файл
+ *   argv[...] - имена файлов с исходными данными
+ */
+int main(int argc, char *argv[]) {
+    bool profile = false;
+    Options opts;
+    int jobs = 1;
+    int first = 1;
+    const char *scenario_file = nullptr;
+    while(first < argc) {
+        if(::strcmp(argv[first], "--profile") == 0) {
+            profile = true;
+            ++first;
+        } else if(::strcmp(argv[first], "--remove") == 0 && first + 1 < argc) {
+            opts.remove = std::max(0, std::atoi(argv[first + 1]));
+            first += 2;
+        } else if(::strcmp(argv[first], "--edges") == 0) {
+            opts.edges = true;
+            ++first;
+        } else if(::strcmp(argv[first], "--all") == 0) {
+            opts.all = true;
+            ++first;
+        } else if(::strcmp(argv[first], "--top") == 0 && first + 1 < argc) {
+            opts.top = std::max(0, std::atoi(argv[first + 1]));
+            first += 2;
+        } else if(::strcmp(argv[first], "--order") == 0 && first + 1 < argc) {
+            if(parse_order(argv[first + 1], opts.order) != 0) {
+                std::cout << "unknown order " << argv[first + 1] << std::endl;
+                return EXIT_FAILURE;
+            }
+            first += 2;
+        } else if(::strcmp(argv[first], "--external") == 0 && first + 1 < argc) {
+            opts.external = std::max(1, std::atoi(argv[first + 1]));
+            first += 2;
+        } else if(::strcmp(argv[first], "--packed") == 0) {
+            opts.packed = true;
+            ++first;
+        } else if(::strcmp(argv[first], "--scenarios") == 0 && first + 1 < argc) {
+            scenario_file = argv[first + 1];
+            first += 2;
+        } else if(::strcmp(argv[first], "-j") == 0 && first + 1 < argc) {
+            jobs = std::max(0, std::atoi(argv[first + 1]));
+            first += 2;
+        } else if(::strncmp(argv[first], "-j", 2) == 0 && argv[first][2]) {
+            jobs = std::max(0, std::atoi(argv[first] + 2));
+            ++first;
+        } else {
+            break;
+        }
+    }
+    if(argc <= first) {
+        std::cout << "Usage: mgt [--profile] [-j N] [--order ORDER] [--packed | --external MB] [--edges | --remove K]"
+                     " [--top K | --all | --scenarios FILE]"
+                     " file1 [file2 [...]]"
+                        << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Weights> scenarios;
+    if(scenario_file) {
+        std::ifstream in(scenario_file);
+        if(!in.is_open()) {
+            std::cout << scenario_file << ": can't open file" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if(ser_in_scenarios(in, scenarios, std::cout) != 0) {
+            std::cout << scenario_file << ": can't parse scenarios" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(jobs != 1) {
+        run_parallel(&argv[first], argc - first, profile, opts,
+                scenario_file ? &scenarios : nullptr, jobs);
+        return 0;
+    }
+    for(int i = first; i < argc; ++i) {
+        run_file(argv[i], profile, opts, scenario_file ? &scenarios : nullptr,
+                std::cout, std::cerr);
+    }
+    return 0;
+}
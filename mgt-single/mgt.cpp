@@ -1,20 +1,18 @@
 #include <iostream>
 #include <limits>
-#include <map>
 #include <set>
-#include <list>
 #include <string>
 #include <fstream>
 #include <iterator>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <ctime>
+#include <cstring>
+#include <sys/resource.h>
 
 #include "mgt.h"
-
-//Разбор входного потока и преобразование его во внутренние структуры данных.
-void parse(Graph &graph, Values &values, std::istream &stream, std::ostream &out) {
-    if(ser_in(stream, graph, values, out)) {
-        return ;
-    }
-}
+#include "pool.h"
 
 template<typename Container>
 void print_cont(Container c) {
@@ -24,109 +22,451 @@ void print_cont(Container c) {
     }
 }
 
-//Поиск точек сочленения, точек, лежащих в одной компоненте связности, суммы по одной компоненте связности.
-value_t dfs (
-        Graph &g,
-        std::set<std::string> &used,
-        Values& v,
-        std::set<std::string> &cutpoints,
-        std::string node,
-        int comp_id,
-        std::string parent = {}
-        ) {
-    v[node].comp_id = comp_id;
-    static std::map<std::string, int> tin;
-    static std::map<std::string, int> fup;
-    static int timer;
-    value_t value = 0;
-    used.insert(node);
-    tin[node] = fup[node] = timer++;
-    int children = 0;
-    for (auto to = g[node].begin(); to != g[node].end(); ++to) {
-        if (*to == parent) {
+Values::Values(const allocator_type &a) : BasicNodes(a), index(a), names(a) {}
+
+//Имена узлов - ключи index: после копирования или переноса index они указывают на старые ключи
+static void values_relink(Values &v) {
+    for(auto &[name, id] : v.index) {
+        v.names[id] = &name;
+    }
+}
+
+Values::Values(const Values &v, const allocator_type &a)
+    : BasicNodes(v, a), index(v.index, a), names(v.names, a) {
+    values_relink(*this);
+}
+
+Values &Values::operator=(const Values &v) {
+    return *this = Values(v, get_allocator());
+}
+
+Values &Values::operator=(Values &&v) {
+    BasicNodes::operator=(std::move(v));
+    index = std::move(v.index);
+    names = std::move(v.names);
+    //При разных аллокаторах ключи index переносятся поэлементно
+    values_relink(*this);
+    return *this;
+}
+
+int node_add(Values &v, const Name &name, value_t value) {
+    auto [it, added] = v.index.insert({name, (int)v.names.size()});
+    if(!added) {
+        return it->second;
+    }
+    v.names.push_back(&it->first);
+    v.value.push_back(value);
+    v.comp_id.push_back(-1);
+    v.flags.push_back(0);
+    v.tin.push_back(-1);
+    v.low.push_back(0);
+    v.sub.push_back(0);
+    v.local.push_back(0);
+    v.up.push_back(-1);
+    v.cut.push_back(0);
+    v.squares.push_back(0);
+    return it->second;
+}
+
+/**
+ * Связи узлов для обходов: доступ к спискам имён в Graph такой же, как
+ * к спискам номеров в Links и PackedLinks
+ *   of(id) : начало и конец списка связей узла id
+ *   to(it) : номер узла, на который указывает элемент списка
+ */
+struct GraphLinks {
+    using iterator = std::pmr::set<Name>::const_iterator;
+    Graph &g;
+    const Values &v;
+    std::pair<iterator, iterator> of(int id) const {
+        //Только find(): контейнеры общие для параллельно обрабатываемых компонент
+        auto &links = g.find(*v.names[id])->second;
+        return {links.cbegin(), links.cend()};
+    }
+    int to(iterator it) const {
+        return v.index.find(*it)->second;
+    }
+};
+
+void links_build(Graph &g, Values &v, Links &l) {
+    for(auto &[name, links] : g) {
+        node_add(v, name);
+    }
+    size_t n = v.size();
+    l.first.assign(n + 1, 0);
+    for(size_t id = 0; id < n; ++id) {
+        auto it = g.find(*v.names[id]);
+        l.first[id + 1] = l.first[id] + (it == g.end() ? 0 : it->second.size());
+    }
+    l.adj.resize(l.first[n]);
+    for(size_t id = 0; id < n; ++id) {
+        auto it = g.find(*v.names[id]);
+        if(it == g.end()) {
+            continue;
+        }
+        size_t k = l.first[id];
+        for(auto &to : it->second) {
+            l.adj[k++] = v.index.find(to)->second;
+        }
+    }
+}
+
+void links_build(const Edges &e, size_t n, Links &l) {
+    l.first.assign(n + 1, 0);
+    for(auto [a, b] : e) {
+        ++l.first[a + 1];
+        if(a != b) {
+            ++l.first[b + 1];
+        }
+    }
+    for(size_t id = 0; id < n; ++id) {
+        l.first[id + 1] += l.first[id];
+    }
+    l.adj.resize(l.first[n]);
+    std::pmr::vector<size_t> pos(l.first.begin(), l.first.end() - 1, l.first.get_allocator());
+    for(auto [a, b] : e) {
+        l.adj[pos[a]++] = b;
+        if(a != b) {
+            l.adj[pos[b]++] = a;
+        }
+    }
+
+    //Повторные рёбра отбрасываются, списки сдвигаются к началу
+    size_t k = 0;
+    size_t from = 0;
+    for(size_t id = 0; id < n; ++id) {
+        size_t to = l.first[id + 1];
+        int *begin = l.adj.data() + from;
+        std::sort(begin, l.adj.data() + to);
+        int *end = std::unique(begin, l.adj.data() + to);
+        l.first[id] = k;
+        k = std::move(begin, end, l.adj.data() + k) - l.adj.data();
+        from = to;
+    }
+    l.first[n] = k;
+    l.adj.resize(k);
+}
+
+//Число переменной длины: по 7 бит в байте, старший бит - продолжение
+static void put_varint(std::pmr::vector<unsigned char> &bytes, size_t x) {
+    for(; x >= 0x80; x >>= 7) {
+        bytes.push_back((unsigned char)(x | 0x80));
+    }
+    bytes.push_back((unsigned char)x);
+}
+
+void links_pack(const Links &l, PackedLinks &p) {
+    size_t n = l.first.size() - 1;
+    p.first.resize(n + 1);
+    p.bytes.clear();
+    //Обычно хватает байта на связь и двух на узел
+    p.bytes.reserve(l.adj.size() + 2 * n);
+    for(size_t id = 0; id < n; ++id) {
+        p.first[id] = p.bytes.size();
+        size_t from = l.first[id];
+        size_t to = l.first[id + 1];
+        put_varint(p.bytes, to - from);
+        if(from == to) {
             continue;
         }
-        if (used.find(*to) != used.end()) {
-            fup[node] = std::min(fup[node], tin[*to]);
+        long long d = (long long)l.adj[from] - (long long)id;
+        put_varint(p.bytes, d < 0 ? (size_t(-d) << 1) | 1 : size_t(d) << 1);
+        for(size_t k = from + 1; k < to; ++k) {
+            put_varint(p.bytes, l.adj[k] - l.adj[k - 1]);
         }
-        else {
-            value += dfs(g, used, v, cutpoints, *to, comp_id, node);
-            fup[node] = std::min(fup[node], fup[*to]);
-            if (fup[*to] >= tin[node] && !parent.empty()) {
-                cutpoints.insert(node);
-                v[node].is_cutp = true;
+    }
+    p.first[n] = p.bytes.size();
+}
+
+//Перестановка массива: элемент i нового массива - элемент order[i] старого
+template<typename T>
+static void permute(std::pmr::vector<T> &a, const std::vector<int> &order) {
+    std::pmr::vector<T> b(a.get_allocator());
+    b.reserve(a.size());
+    for(int old : order) {
+        b.push_back(a[old]);
+    }
+    a.swap(b);
+}
+
+int parse_order(const char *name, Order &order) {
+    static const char *const names[] = {"none", "bfs", "rcm", "degree"};
+    for(int i = 0; i < 4; ++i) {
+        if(::strcmp(name, names[i]) == 0) {
+            order = Order(i);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void reorder(Values &v, Links &l, Order order) {
+    size_t n = v.size();
+    if(order == ORDER_NONE || n == 0) {
+        return;
+    }
+    auto degree = [&](int id) { return l.first[id + 1] - l.first[id]; };
+
+    //seq[i] - старый номер узла, получающего номер i
+    std::vector<int> seq;
+    seq.reserve(n);
+    if(order == ORDER_DEGREE) {
+        for(size_t id = 0; id < n; ++id) {
+            seq.push_back(id);
+        }
+        std::stable_sort(seq.begin(), seq.end(), [&](int a, int b) { return degree(a) > degree(b); });
+    } else {
+        //Обход в ширину каждой компоненты; для RCM - от узлов наименьшей степени
+        //с просмотром соседей по возрастанию степени и обращением порядка в конце
+        std::vector<int> starts(n);
+        for(size_t id = 0; id < n; ++id) {
+            starts[id] = id;
+        }
+        if(order == ORDER_RCM) {
+            std::stable_sort(starts.begin(), starts.end(), [&](int a, int b) { return degree(a) < degree(b); });
+        }
+        std::vector<char> seen(n);
+        std::vector<int> next;
+        for(int start : starts) {
+            if(seen[start]) {
+                continue;
             }
-            ++children;
+            seen[start] = true;
+            size_t tail = seq.size();
+            seq.push_back(start);
+            for(; tail < seq.size(); ++tail) {
+                int cur = seq[tail];
+                next.clear();
+                for(size_t k = l.first[cur]; k < l.first[cur + 1]; ++k) {
+                    int to = l.adj[k];
+                    if(!seen[to]) {
+                        seen[to] = true;
+                        next.push_back(to);
+                    }
+                }
+                if(order == ORDER_RCM) {
+                    std::stable_sort(next.begin(), next.end(), [&](int a, int b) { return degree(a) < degree(b); });
+                }
+                seq.insert(seq.end(), next.begin(), next.end());
+            }
+        }
+        if(order == ORDER_RCM) {
+            std::reverse(seq.begin(), seq.end());
         }
     }
-    if (parent.empty() && children > 1) {
-        cutpoints.insert(node);
-        v[node].is_cutp = true;
+
+    std::vector<int> pos(n);
+    for(size_t i = 0; i < n; ++i) {
+        pos[seq[i]] = i;
+    }
+    Links moved(l.first.get_allocator());
+    moved.first.assign(n + 1, 0);
+    moved.adj.resize(l.adj.size());
+    for(size_t i = 0; i < n; ++i) {
+        size_t from = l.first[seq[i]];
+        size_t to = l.first[seq[i] + 1];
+        moved.first[i + 1] = moved.first[i] + (to - from);
+        int *out = moved.adj.data() + moved.first[i];
+        for(size_t k = from; k < to; ++k) {
+            *out++ = pos[l.adj[k]];
+        }
+        std::sort(moved.adj.data() + moved.first[i], out);
+    }
+    l = std::move(moved);
+
+    for(auto &[name, id] : v.index) {
+        id = pos[id];
     }
-    return v[node].value + value;
+    permute(v.names, seq);
+    permute(v.value, seq);
+    permute(v.comp_id, seq);
+    permute(v.flags, seq);
+    permute(v.tin, seq);
+    permute(v.low, seq);
+    permute(v.sub, seq);
+    permute(v.local, seq);
+    permute(v.up, seq);
+    permute(v.cut, seq);
+    permute(v.squares, seq);
 }
 
-//Разделение исходного графа на компоненты связности
-void make_components(Graph &g, Values &v, Components &comps) {
-    for(auto &[name, links] : g) {
-        if(v[name].comp_id == -1) {
-            Component c;
-            int comp_id = 0;
-            c.value = dfs(g, c.names, v, c.cutpoints, name, comp_id);
-            ++comp_id;
-            comps.push_back(c);
-        }
-    }
-}
-
-//Объединение смежных вершин, не являющихся точками сочленения, в одну.
-void reduce_comp(Graph &g, Values &v, Component &c, std::string predator) {
-    value_t value = 0;
-    
-    std::list<std::string> to_check(g[predator].begin(), g[predator].end());
-
-    for(auto it = to_check.begin(); it != to_check.end();) {
-        auto victim = *it;
-        auto next = std::next(it);
-        if(!v[victim].is_cutp && !v[victim].is_reduced) {
-            value += v[victim].value;
-            for(auto future_victim : g[victim]) {
-                if(future_victim != predator) {
-                    g[predator].insert(future_victim);
-                    to_check.push_back(future_victim);
-                    g[future_victim].erase(victim);
-                    g[future_victim].insert(predator);
+//Разделение графа на компоненты связности обходом узлов по номерам
+template<typename L, typename Id, typename Acc>
+static void split_components(const L &links, BasicNodes<Id, Acc> &v, BasicComponents<Id, Acc> &comps) {
+    std::vector<int> stack;
+    for(size_t root = 0; root < v.value.size(); ++root) {
+        if(v.comp_id[root] != Id(-1)) {
+            continue;
+        }
+        BasicComponent<Id, Acc> c(comps.get_allocator());
+        Id comp_id = comps.size();
+        v.comp_id[root] = comp_id;
+        stack.push_back(root);
+        while(!stack.empty()) {
+            int cur = stack.back();
+            stack.pop_back();
+            c.nodes.push_back(cur);
+            c.value += v.value[cur];
+            auto [it, end] = links.of(cur);
+            for(; it != end; ++it) {
+                int next = links.to(it);
+                if(v.comp_id[next] == Id(-1)) {
+                    v.comp_id[next] = comp_id;
+                    stack.push_back(next);
                 }
             }
-            g[predator].erase(victim);
-            g.erase(victim);
-            v[victim].is_reduced = true;
         }
-        it = next;
+        comps.push_back(std::move(c));
     }
-    v[predator].sum = v[predator].value + value;
 }
 
-//Объединение всех групп смежных точек, не являющихся точками сочленения в одну (на каждую группу)
-void reduce(Graph &g, Values &v, Component &c) {
-    for(auto name : c.names) {
-        if(!v[name].is_cutp && !v[name].is_reduced) {
-            reduce_comp(g, v, c, name);
+//Внешний режим: компоненты собраны при разборе (MappedLinks::comp);
+//представитель - наименьший номер компоненты, на нём она и заводится,
+//он же - корень обхода
+template<typename Id, typename Acc>
+static void split_components(const MappedLinks &l, BasicNodes<Id, Acc> &v, BasicComponents<Id, Acc> &comps) {
+    for(size_t id = 0; id < v.value.size(); ++id) {
+        int root = l.comp[id];
+        if(root == int(id)) {
+            v.comp_id[id] = comps.size();
+            comps.push_back(BasicComponent<Id, Acc>(comps.get_allocator()));
+        } else {
+            v.comp_id[id] = v.comp_id[root];
         }
+        auto &c = comps[v.comp_id[id]];
+        c.nodes.push_back(id);
+        c.value += v.value[id];
     }
 }
 
-//Подсчет эффективности подсети
-value_t count_graph(Graph &g, Values &v, Component &c, std::set<std::string> &used,
-        std::string name) {
-    value_t counter = 0;
-    used.insert(name);
-    for(auto link : g[name]) {
-        if(used.find(link) == used.end()) {
-            counter += count_graph(g, v, c, used, link);
+//Разделение исходного графа на компоненты связности
+void make_components(Graph &g, Values &v, Components &comps) {
+    //Узлы без связей, но с весом, - отдельные компоненты
+    for(size_t id = 0; id < v.size(); ++id) {
+        g[*v.names[id]];
+    }
+    for(auto &[name, links] : g) {
+        node_add(v, name);
+    }
+    split_components(GraphLinks{g, v}, v, comps);
+}
+
+void make_components(const Links &l, Values &v, Components &comps) {
+    split_components(l, v, comps);
+}
+
+void make_components(const PackedLinks &l, Values &v, Components &comps) {
+    split_components(l, v, comps);
+}
+
+void make_components(const MappedLinks &l, Values &v, Components &comps) {
+    split_components(l, v, comps);
+}
+
+/**
+ * Кадр обхода в глубину
+ *   Id node : узел
+ *   Id parent : родитель в дереве обхода (Id(-1) - корень)
+ *   link, end : следующая непросмотренная связь и конец списка связей
+ *   Acc cut : суммарный вес поддеревьев, отделяемых узлом
+ *   Acc squares : сумма квадратов весов этих поддеревьев
+ *   int children : количество потомков в дереве обхода
+ *   int separated : количество поддеревьев, отделяемых узлом
+ */
+template<typename Iterator, typename Id, typename Acc>
+struct Frame {
+    Id node;
+    Id parent;
+    Iterator link;
+    Iterator end;
+    Acc cut{};
+    Acc squares{};
+    int children{};
+    int separated{};
+};
+
+//Сумма квадратов весов частей компоненты веса w_comp без узла id плюс вес узла
+template<typename Id, typename Acc>
+static Acc node_local(const BasicNodes<Id, Acc> &v, int id, Acc w_comp) {
+    //Остаток компоненты - часть, в которой лежит родитель
+    Acc rest = w_comp - v.value[id] - v.cut[id];
+    return v.squares[id] + rest * rest + v.value[id];
+}
+
+//Поиск точек сочленения компоненты и частей, на которые она распадается при удалении узла
+template<typename L, typename Id, typename Acc>
+static void dfs_comp(const L &links, BasicNodes<Id, Acc> &v, BasicComponent<Id, Acc> &c) {
+    //Обход без рекурсии: глубина дерева обхода может достигать размера компоненты
+    Id timer = 0;
+    std::vector<Frame<typename L::iterator, Id, Acc>> stack;
+    auto enter = [&](Id id, Id parent) {
+        v.tin[id] = v.low[id] = timer++;
+        v.sub[id] = v.value[id];
+        auto [begin, end] = links.of(id);
+        stack.push_back({id, parent, begin, end});
+    };
+    enter(c.nodes[0], Id(-1));
+    while(!stack.empty()) {
+        auto &f = stack.back();
+        if(f.link != f.end) {
+            int to = links.to(f.link++);
+            if(Id(to) == f.node || Id(to) == f.parent) {
+                continue;
+            }
+            if(v.tin[to] != Id(-1)) {
+                v.low[f.node] = std::min(v.low[f.node], v.tin[to]);
+            } else {
+                ++f.children;
+                enter(to, f.node);
+            }
+            continue;
+        }
+
+        //Все связи узла просмотрены
+        Id id = f.node;
+        v.cut[id] = f.cut;
+        v.squares[id] = f.squares;
+        v.local[id] = node_local(v, id, c.value);
+        unsigned char flags = (f.parent != Id(-1) ? f.separated > 0 : f.children > 1) ? NODE_CUTP : 0;
+        if(flags & NODE_CUTP) {
+            c.cutpoints.push_back(id);
         }
+        stack.pop_back();
+        if(!stack.empty()) {
+            auto &p = stack.back();
+            v.sub[p.node] += v.sub[id];
+            v.low[p.node] = std::min(v.low[p.node], v.low[id]);
+            v.up[id] = p.node;
+            //Поддерево узла не связано с предками родителя в обход родителя
+            if(v.low[id] >= v.tin[p.node]) {
+                flags |= NODE_SEP;
+                ++p.separated;
+                p.cut += v.sub[id];
+                p.squares += v.sub[id] * v.sub[id];
+            }
+            //Связь с родителем - мост: из поддерева нет связей выше самого узла
+            if(v.low[id] > v.tin[p.node]) {
+                c.bridges.push_back({p.node, id});
+            }
+        }
+        v.flags[id] = flags;
     }
-    return counter + v[name].sum;
+}
+
+void analyze_comp(Graph &g, Values &v, Component &c) {
+    dfs_comp(GraphLinks{g, v}, v, c);
+}
+
+void analyze_comp(const Links &l, Values &v, Component &c) {
+    dfs_comp(l, v, c);
+}
+
+void analyze_comp(const PackedLinks &l, Values &v, Component &c) {
+    dfs_comp(l, v, c);
+}
+
+void analyze_comp(const MappedLinks &l, Values &v, Component &c) {
+    dfs_comp(l, v, c);
 }
 
 //Отладочная печать графа и вершин
@@ -140,18 +480,18 @@ void print_gnv(Graph &g, Values &v) {
         std::cout << std::endl;
     }
     std::cout << "Nodes:" << std::endl;
-    for(auto &[name, node] : v) {
-        std::cout << name << " - " << node.value << std::endl;
+    for(size_t id = 0; id < v.size(); ++id) {
+        std::cout << *v.names[id] << " - " << v.value[id] << std::endl;
     }
 }
 
 //Отладочная печать компонент связности
-void print_comps(Components &comps) {
+void print_comps(Components &comps, Values &v) {
     int i = 0;
-    for(auto comp : comps) {
+    for(auto &comp : comps) {
         std::cout << "comp " << i << ", value " << comp.value << ": ";
-        for(auto name : comp.names) {
-            std::cout << name << " ";
+        for(auto id : comp.nodes) {
+            std::cout << *v.names[id] << " ";
         }
         std::cout << std::endl;
         ++i;
@@ -161,98 +501,986 @@ void print_comps(Components &comps) {
 //Отладочная печать всех точек сочленения
 void print_cutps(Values &v) {
     std::cout << "cutpoints: ";
-    for(auto &[name, node] : v) {
-        if(node.is_cutp) {
-            std::cout << name << " ";
+    for(size_t id = 0; id < v.size(); ++id) {
+        if(v.flags[id] & NODE_CUTP) {
+            std::cout << *v.names[id] << " ";
         }
     }
     std::cout << std::endl;
 
 }
 
-int main(int argc, char *argv[]) {
-    if(argc < 2) {
-        std::cout << "Usage: mgt file1 [file2 [...]]"
-                        << std::endl;
-        return EXIT_FAILURE;
+//Пиковый объём резидентной памяти процесса, КБ
+long peak_rss_kb() {
+    rusage ru{};
+    ::getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+//Разность отметок времени в миллисекундах
+double elapsed_ms(const timespec &from, const timespec &to) {
+    return (to.tv_sec - from.tv_sec) * 1e3 + (to.tv_nsec - from.tv_nsec) / 1e6;
+}
+
+//Начать замер этапа
+StageMark stage_start() {
+    StageMark m;
+    ::clock_gettime(CLOCK_MONOTONIC, &m.wall);
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &m.cpu);
+    m.rss_kb = peak_rss_kb();
+    return m;
+}
+
+//Завершить замер этапа, начатого в точке m
+void stage_stop(const StageMark &m, Stage &s) {
+    timespec wall, cpu;
+    ::clock_gettime(CLOCK_MONOTONIC, &wall);
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    s.wall_ms = elapsed_ms(m.wall, wall);
+    s.cpu_ms = elapsed_ms(m.cpu, cpu);
+    s.rss_kb = peak_rss_kb() - m.rss_kb;
+}
+
+//Количество рёбер графа (петля считается одним ребром)
+size_t count_edges(Graph &g) {
+    size_t ends = 0;
+    size_t loops = 0;
+    for(auto &[name, links] : g) {
+        ends += links.size();
+        loops += links.count(name);
+    }
+    return (ends + loops) / 2;
+}
+
+template<typename L>
+static size_t count_links(const L &l) {
+    size_t n = l.first.size() - 1;
+    size_t loops = 0;
+    for(size_t id = 0; id < n; ++id) {
+        for(auto [it, end] = l.of(id); it != end; ++it) {
+            loops += l.to(it) == int(id);
+        }
     }
+    return (l.first[n] + loops) / 2;
+}
+
+size_t count_edges(const Links &l) {
+    return count_links(l);
+}
+
+size_t count_edges(const MappedLinks &l) {
+    return count_links(l);
+}
 
-    for(int i = 1; i < argc; ++i) {
-        Graph graph;
-        Values values;
-        std::map<std::string, value_t> variants;
-        auto min_vitality = std::numeric_limits<value_t>::max();
+const char *const Profile::stage_names[Profile::STAGES] = {"parse", "links", "components", "cutpoints", "score"};
 
-        //Отладка
-        std::cout <<argv[i] <<": ";
+//Пул для обработки компонент (nullptr - последовательно)
+static Pool *engine_pool = nullptr;
 
-        std::ifstream in(argv[i]);
-        if(!in.is_open()) {
-            std::cout <<"can't open file" <<std::endl;
+void set_engine_pool(Pool *pool) {
+    engine_pool = pool;
+}
+
+//Минимальное количество узлов в одной задаче: мелкие компоненты обрабатываются пачками
+static const size_t CHUNK_NODES = 4096;
+
+//Компоненты не меньше этого размера разбираются параллельно изнутри
+static const size_t PARALLEL_NODES = 100000;
+
+/**
+ * Разбиение компонент на пачки для задач пула
+ * Возвращаемое значение:
+ *   границы пачек: пачка k - компоненты с bounds[k] по bounds[k + 1] - 1
+ */
+template<typename Comps>
+static std::vector<size_t> make_chunks(const Comps &comps) {
+    std::vector<size_t> bounds{0};
+    size_t nodes = 0;
+    for(size_t i = 0; i < comps.size(); ++i) {
+        nodes += comps[i].nodes.size();
+        if(nodes >= CHUNK_NODES || i + 1 == comps.size()) {
+            bounds.push_back(i + 1);
+            nodes = 0;
+        }
+    }
+    return bounds;
+}
+
+/**
+ * Выполнение body(k, from, to) для каждой пачки компонент на пуле engine_pool
+ * и ожидание завершения всех пачек
+ */
+static void for_chunks(const std::vector<size_t> &bounds,
+        const std::function<void(size_t, size_t, size_t)> &body) {
+    size_t chunks = bounds.size() - 1;
+    if(!engine_pool || chunks < 2) {
+        for(size_t k = 0; k < chunks; ++k) {
+            body(k, bounds[k], bounds[k + 1]);
+        }
+        return;
+    }
+    TaskGroup group;
+    for(size_t k = 0; k < chunks; ++k) {
+        pool_submit(*engine_pool, [&, k]() { body(k, bounds[k], bounds[k + 1]); }, &group);
+    }
+    pool_wait(*engine_pool, group);
+}
+
+std::ostream &operator<<(std::ostream &out, wide_t x) {
+    char digits[40];
+    char *p = digits + sizeof(digits);
+    *--p = 0;
+    do {
+        *--p = '0' + int(x % 10);
+        x /= 10;
+    } while(x);
+    return out << p;
+}
+
+/**
+ * Оценка узла
+ *   Acc vitality : оценка
+ *   const Name *name : имя узла
+ */
+template<typename Acc>
+struct Score {
+    Acc vitality;
+    const Name *name;
+};
+
+//Порядок оценок: по возрастанию, при равенстве - по имени узла
+template<typename Acc>
+static bool operator<(const Score<Acc> &a, const Score<Acc> &b) {
+    return a.vitality != b.vitality ? a.vitality < b.vitality : *a.name < *b.name;
+}
+
+/**
+ * Лучшие результаты по пачке компонент
+ *   Acc vitality : минимальная оценка
+ *   std::vector<const Name *> names : узлы с этой оценкой
+ *   std::vector<Score<Acc>> ranked : оценки для вывода с параметрами top/all
+ *                                    (для top - куча из не более чем top лучших)
+ */
+template<typename Acc>
+struct Best {
+    Acc vitality = std::numeric_limits<Acc>::max();
+    std::vector<const Name *> names;
+    std::vector<Score<Acc>> ranked;
+};
+
+//Учесть оценку узла в лучших результатах
+template<typename Acc>
+static void keep_best(Best<Acc> &b, const Options &opts, Score<Acc> s) {
+    if(opts.all) {
+        b.ranked.push_back(s);
+    } else if(opts.top) {
+        //Куча с наихудшей из отобранных оценок в вершине
+        if(b.ranked.size() < opts.top) {
+            b.ranked.push_back(s);
+            std::push_heap(b.ranked.begin(), b.ranked.end());
+        } else if(s < b.ranked.front()) {
+            std::pop_heap(b.ranked.begin(), b.ranked.end());
+            b.ranked.back() = s;
+            std::push_heap(b.ranked.begin(), b.ranked.end());
+        }
+    } else {
+        if(s.vitality < b.vitality) {
+            b.vitality = s.vitality;
+            b.names.clear();
+        }
+        if(s.vitality == b.vitality) {
+            b.names.push_back(s.name);
+        }
+    }
+}
+
+/**
+ * Вывод элементов результата: узлы с наименьшей оценкой 'A', 'C' или,
+ * с параметрами top/all, узлы с оценками по возрастанию ('A', 12), ('C', 14)
+ */
+template<typename Acc>
+static void print_best(std::ostream &out, std::vector<Best<Acc>> &best, const Options &opts) {
+    if(opts.all || opts.top) {
+        std::vector<Score<Acc>> ranked;
+        for(auto &b : best) {
+            ranked.insert(ranked.end(), b.ranked.begin(), b.ranked.end());
+        }
+        size_t count = opts.all ? ranked.size() : std::min(opts.top, ranked.size());
+        std::nth_element(ranked.begin(), ranked.begin() + count, ranked.end());
+        std::sort(ranked.begin(), ranked.begin() + count);
+        for(size_t i = 0; i < count; ++i) {
+            out << (i ? ", " : "") << "(\'" << *ranked[i].name << "\', " << ranked[i].vitality << ")";
+        }
+        return;
+    }
+
+    Best<Acc> result;
+    for(auto &b : best) {
+        if(b.vitality < result.vitality) {
+            result.vitality = b.vitality;
+            result.names.clear();
+        }
+        if(b.vitality == result.vitality) {
+            result.names.insert(result.names.end(), b.names.begin(), b.names.end());
+        }
+    }
+    std::sort(result.names.begin(), result.names.end(),
+            [](const Name *a, const Name *b) { return *a < *b; });
+
+    bool is_only_answer = true;
+    for(auto name : result.names) {
+        if(is_only_answer) {
+            out << "\'" << *name << "\'";
+            is_only_answer = false;
+        } else {
+            out << ", \'" << *name << "\'";
+        }
+    }
+}
+
+/**
+ * Оценка связи - моста
+ *   Acc vitality : сумма квадратов весов компонент после удаления связи
+ *   const Name *a, *b : концы связи, a < b
+ */
+template<typename Acc>
+struct BridgeScore {
+    Acc vitality;
+    const Name *a;
+    const Name *b;
+};
+
+//Порядок оценок мостов: по возрастанию, при равенстве - по именам концов
+template<typename Acc>
+static bool operator<(const BridgeScore<Acc> &x, const BridgeScore<Acc> &y) {
+    if(x.vitality != y.vitality) {
+        return x.vitality < y.vitality;
+    }
+    return *x.a != *y.a ? *x.a < *y.a : *x.b < *y.b;
+}
+
+//Оценка мостов и вывод лучших, как print_best(): без скобок списка
+template<typename Id, typename Acc>
+static void print_bridges(std::ostream &out, BasicComponents<Id, Acc> &comps, BasicNodes<Id, Acc> &nodes,
+        const std::pmr::vector<const Name *> &names, Acc total, const Options &opts) {
+    //Мост делит компоненту на поддерево веса sub и остаток
+    std::vector<BridgeScore<Acc>> ranked;
+    for(auto &c : comps) {
+        Acc others = total - c.value * c.value;
+        for(auto &b : c.bridges) {
+            Acc sub = nodes.sub[b.to];
+            Acc rest = c.value - sub;
+            BridgeScore<Acc> s{others + sub * sub + rest * rest, names[b.from], names[b.to]};
+            if(*s.b < *s.a) {
+                std::swap(s.a, s.b);
+            }
+            ranked.push_back(s);
+        }
+    }
+
+    size_t count = ranked.size();
+    bool scores = opts.all || opts.top;
+    if(!scores && !ranked.empty()) {
+        Acc best = std::min_element(ranked.begin(), ranked.end())->vitality;
+        count = std::partition(ranked.begin(), ranked.end(),
+                [&](const BridgeScore<Acc> &s) { return s.vitality == best; }) - ranked.begin();
+    } else if(!opts.all) {
+        count = std::min(opts.top, count);
+    }
+    std::nth_element(ranked.begin(), ranked.begin() + count, ranked.end());
+    std::sort(ranked.begin(), ranked.begin() + count);
+    for(size_t i = 0; i < count; ++i) {
+        out << (i ? ", " : "") << "(\'" << *ranked[i].a << "\', \'" << *ranked[i].b << "\'";
+        if(scores) {
+            out << ", " << ranked[i].vitality;
+        }
+        out << ")";
+    }
+}
+
+/**
+ * Оценка всех узлов и вывод результата
+ * Параметры:
+ *   names : имена узлов
+ *   Acc total : сумма квадратов весов всех компонент
+ */
+template<typename Id, typename Acc>
+static void print_scores(std::ostream &out, BasicComponents<Id, Acc> &comps, BasicNodes<Id, Acc> &nodes,
+        const std::pmr::vector<const Name *> &names, Acc total, const Options &opts) {
+    if(opts.edges) {
+        out << "[";
+        print_bridges(out, comps, nodes, names, total, opts);
+        out << "]" << std::endl;
+        return;
+    }
+
+    //Оценка узла v из компоненты C:
+    //сумма квадратов весов остальных компонент + Values::local
+    std::vector<Acc> others(comps.size());
+    for(size_t i = 0; i < comps.size(); ++i) {
+        others[i] = total - comps[i].value * comps[i].value;
+    }
+    //Узлы обходятся подряд по номерам: читаются только comp_id и local
+    size_t n = names.size();
+    std::vector<Acc> score(n);
+    std::vector<Best<Acc>> best((n + CHUNK_NODES - 1) / CHUNK_NODES);
+    pool_for(engine_pool, n, CHUNK_NODES, [&](size_t from, size_t to) {
+        Best<Acc> &b = best[from / CHUNK_NODES];
+        const Id *comp_id = nodes.comp_id.data();
+        const Acc *local = nodes.local.data();
+        Acc min = b.vitality;
+        for(size_t i = from; i < to; ++i) {
+            score[i] = others[comp_id[i]] + local[i];
+            min = std::min(min, score[i]);
+        }
+        if(opts.all || opts.top) {
+            for(size_t i = from; i < to; ++i) {
+                keep_best(b, opts, Score<Acc>{score[i], names[i]});
+            }
+            return;
+        }
+        b.vitality = min;
+        for(size_t i = from; i < to; ++i) {
+            if(score[i] == min) {
+                b.names.push_back(names[i]);
+            }
+        }
+    });
+    out << "[";
+    print_best(out, best, opts);
+    out << "]" << std::endl;
+}
+
+void *ArenaHeap::do_allocate(size_t bytes, size_t align) {
+    taken += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+}
+
+void ArenaHeap::do_deallocate(void *p, size_t bytes, size_t align) {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+}
+
+bool ArenaHeap::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
+
+Arena::Arena(size_t size) : buffer(new char[size]), size(size) {
+    mem.emplace(buffer.get(), size, &heap);
+}
+
+std::pmr::memory_resource *arena_resource(Arena &a) {
+    return &*a.mem;
+}
+
+void arena_reset(Arena &a) {
+    a.mem->release();
+    if(a.heap.taken == 0) {
+        return;
+    }
+    //Запрос не уместился: следующий такой же обойдётся одним буфером
+    a.size += a.heap.taken;
+    a.heap.taken = 0;
+    a.mem.reset();
+    a.buffer.reset(new char[a.size]);
+    a.mem.emplace(a.buffer.get(), a.size, &a.heap);
+}
+
+/**
+ * Анализ графа со связями links и вывод результата: атрибуты узлов -
+ * в nodes (для специализации <int, value_t> - сами values), имена и веса -
+ * в values; затраты этапов - в stages, сводка по графу - в prof, если не nullptr
+ */
+template<typename L, typename Id, typename Acc>
+static void process_links(std::pmr::memory_resource *mem, const L &links, Values &values,
+        BasicNodes<Id, Acc> &nodes, std::ostream &out, const Options &opts, Stage *stages, Profile *prof) {
+    StageMark mark;
+    //Параллельная схема (bicon.cpp) работает с Values, набор узлов (kset.cpp) -
+    //со связями с номерами int и суммами ширины Acc
+    constexpr bool plain = std::is_same_v<BasicNodes<Id, Acc>, BasicNodes<int, value_t>>;
+
+    //Компоненты пополняются точками сочленения из потоков пула,
+    //а арена однопоточная: на пуле они берут память через синхронизированный пул
+    std::optional<std::pmr::synchronized_pool_resource> shared;
+    if(engine_pool) {
+        shared.emplace(mem);
+    }
+    BasicComponents<Id, Acc> comps(shared ? &*shared : mem);
+    mark = stage_start();
+    split_components(links, nodes, comps);
+    stage_stop(mark, stages[Profile::COMPONENTS]);
+
+    //Компоненты независимы: точки сочленения ищутся параллельно,
+    //а сумма квадратов весов компонент собирается из частичных сумм по пачкам
+    mark = stage_start();
+    auto chunks = make_chunks(comps);
+    std::vector<Acc> squares(chunks.size() - 1);
+    for_chunks(chunks, [&](size_t k, size_t from, size_t to) {
+        for(size_t i = from; i < to; ++i) {
+            bool parallel = plain && engine_pool && comps[i].nodes.size() >= PARALLEL_NODES;
+            if constexpr(plain) {
+                if(parallel) {
+                    analyze_comp_parallel(links, values, comps[i], engine_pool);
+                }
+            }
+            if(!parallel) {
+                dfs_comp(links, nodes, comps[i]);
+            }
+            squares[k] += comps[i].value * comps[i].value;
+        }
+    });
+    Acc total = 0;
+    for(auto s : squares) {
+        total += s;
+    }
+    stage_stop(mark, stages[Profile::CUTPOINTS]);
+
+    mark = stage_start();
+    if constexpr(std::is_same_v<Id, int>) {
+        if(opts.remove > 1) {
+            print_kset(out, links, values, opts, engine_pool, std::is_same_v<Acc, wide_t>);
+        }
+    }
+    if(opts.remove <= 1) {
+        print_scores(out, comps, nodes, values.names, total, opts);
+    }
+    stage_stop(mark, stages[Profile::SCORE]);
+
+    if(prof) {
+        prof->id_bits = sizeof(Id) * 8;
+        prof->sum_bits = sizeof(Acc) * 8;
+        prof->nodes = values.size();
+        prof->components = comps.size();
+        prof->cutpoints = 0;
+        prof->largest_component = 0;
+        for(auto &comp : comps) {
+            prof->cutpoints += comp.cutpoints.size();
+            prof->largest_component = std::max(prof->largest_component, comp.nodes.size());
+        }
+    }
+}
+
+/**
+ * Запуск анализа со специализацией ядра <Id, value_t> или, если wide,
+ * <Id, wide_t>; атрибуты узлов переносятся из values в массивы нужных типов
+ */
+template<typename Id, typename L>
+static void process_sized(std::pmr::memory_resource *mem, const L &links, Values &values, bool wide,
+        std::ostream &out, const Options &opts, Stage *stages, Profile *prof) {
+    if(wide) {
+        BasicNodes<Id, wide_t> nodes(mem);
+        nodes.reset(values.value);
+        process_links(mem, links, values, nodes, out, opts, stages, prof);
+    } else if constexpr(std::is_same_v<Id, int>) {
+        process_links(mem, links, values, values, out, opts, stages, prof);
+    } else {
+        BasicNodes<Id, value_t> nodes(mem);
+        nodes.reset(values.value);
+        process_links(mem, links, values, nodes, out, opts, stages, prof);
+    }
+}
+
+/**
+ * Нужны ли точные 128-битные суммы: оценка узла не больше квадрата суммы
+ * весов S, поэтому value_t хватает при S < 2^32. Отрицательные веса
+ * хранятся в value_t по модулю - с ними арифметика остаётся модульной.
+ */
+static bool needs_wide(const Values &v) {
+    wide_t sum = 0;
+    for(auto w : v.value) {
+        if(w > value_t(std::numeric_limits<int>::max())) {
+            return false;
+        }
+        sum += w;
+    }
+    return sum > std::numeric_limits<unsigned int>::max();
+}
+
+//Наибольшее число узлов для 16-битных номеров: Id(-1) - «нет узла»
+static const size_t NARROW_NODES = std::numeric_limits<uint16_t>::max();
+
+/**
+ * Обработка одного запроса; все контейнеры запроса - в памяти mem
+ */
+static int process_in(std::pmr::memory_resource *mem, std::istream &in, std::ostream &out,
+        Profile *prof, Options opts) {
+    Values values(mem);
+    Stage stages[Profile::STAGES];
+    StageMark mark;
+    int ret;
+    size_t edges = 0;
+    //Специализация ядра выбирается после разбора, по числу узлов и весам;
+    //набор узлов (--remove) считается в той же ширине сумм
+    auto wide = [&]() { return needs_wide(values); };
+
+    if(opts.external) {
+        //Рёбра в памяти не держатся: обход идёт по временному файлу
+        MappedLinks mapped(mem);
+        mapped.budget = opts.external * (size_t(1) << 20) / sizeof(int);
+        mark = stage_start();
+        ret = ser_in(in, mapped, values, out, &opts);
+        stage_stop(mark, stages[Profile::PARSE]);
+
+        mark = stage_start();
+        int err = links_map(mapped, values.size(), out);
+        stage_stop(mark, stages[Profile::LINKS]);
+        if(err != 0) {
+            return err;
+        }
+        edges = prof ? count_edges(mapped) : 0;
+        process_sized<int>(mem, mapped, values, wide(), out, opts, stages, prof);
+    } else {
+        //Граф с именами не строится: рёбра сразу разбираются в номера узлов
+        Links links(mem);
+        {
+            Edges list(mem);
+            mark = stage_start();
+            ret = ser_in(in, list, values, out, &opts);
+            stage_stop(mark, stages[Profile::PARSE]);
+
+            mark = stage_start();
+            links_build(list, values.size(), links);
+        }
+        reorder(values, links, opts.order);
+        edges = prof ? count_edges(links) : 0;
+        PackedLinks packed(mem);
+        if(opts.packed) {
+            links_pack(links, packed);
+            links = Links(mem);
+        }
+        stage_stop(mark, stages[Profile::LINKS]);
+
+        //Номера узлов малого графа - 16-битные: списки связей и массивы
+        //номеров вдвое короче. Сжатые связи и так компактны и нужны большим графам
+        if(opts.packed) {
+            process_sized<int>(mem, packed, values, wide(), out, opts, stages, prof);
+        } else if(values.size() < NARROW_NODES && opts.remove <= 1) {
+            BasicLinks<uint16_t> narrow(mem);
+            narrow.first = std::move(links.first);
+            narrow.adj.assign(links.adj.begin(), links.adj.end());
+            links = Links(mem);
+            process_sized<uint16_t>(mem, narrow, values, wide(), out, opts, stages, prof);
+        } else {
+            process_sized<int>(mem, links, values, wide(), out, opts, stages, prof);
+        }
+    }
+
+    if(prof) {
+        for(int i = 0; i < Profile::STAGES; ++i) {
+            prof->stages[i] = stages[i];
+        }
+        prof->edges = edges;
+    }
+    return ret;
+}
+
+int process(std::istream &in, std::ostream &out, Profile *prof, Options opts) {
+    //Арены обработчика переиспользуются от запроса к запросу. Поток,
+    //ожидающий пул, может взять задачу с другим запросом - ей нужна своя арена
+    static thread_local std::vector<std::unique_ptr<Arena>> arenas;
+    std::unique_ptr<Arena> arena;
+    if(arenas.empty()) {
+        arena.reset(new Arena);
+    } else {
+        arena = std::move(arenas.back());
+        arenas.pop_back();
+    }
+    //Сжатые связи и внешний режим - для графов, промежуточные данные
+    //которых не должны оставаться в арене: они возвращаются в кучу сразу
+    std::pmr::memory_resource *mem = opts.packed || opts.external ?
+            std::pmr::new_delete_resource() : arena_resource(*arena);
+    int ret = process_in(mem, in, out, prof, opts);
+    arena_reset(*arena);
+    arenas.push_back(std::move(arena));
+    return ret;
+}
+
+int model_build(Model &m, std::istream &in, std::ostream &out, Options *opts) {
+    int ret = ser_in(in, m.graph, m.values, out, opts);
+    if(ret != 0) {
+        return ret;
+    }
+    model_analyze(m);
+    return 0;
+}
+
+void model_analyze(Model &m) {
+    make_components(m.graph, m.values, m.comps);
+    m.total = 0;
+    for(auto &c : m.comps) {
+        analyze_comp(m.graph, m.values, c);
+        m.total += c.value * c.value;
+    }
+}
+
+int update_weights(Model &m, const Weights &changes) {
+    Values &v = m.values;
+    for(auto &[name, value] : changes) {
+        if(v.index.find(name) == v.index.end()) {
+            return -1;
+        }
+    }
+    std::vector<bool> dirty(m.comps.size());
+    for(auto &[name, value] : changes) {
+        int id = v.index.find(name)->second;
+        value_t delta = value - v.value[id];
+        if(delta == 0) {
             continue;
         }
+        v.value[id] = value;
+        //Вес меняется у всех поддеревьев, содержащих узел
+        for(int n = id; n != -1; n = v.up[n]) {
+            value_t old = v.sub[n];
+            v.sub[n] += delta;
+            int up = v.up[n];
+            if(up != -1 && (v.flags[n] & NODE_SEP)) {
+                v.cut[up] += delta;
+                v.squares[up] += v.sub[n] * v.sub[n] - old * old;
+            }
+        }
+        Component &c = m.comps[v.comp_id[id]];
+        m.total -= c.value * c.value;
+        c.value += delta;
+        m.total += c.value * c.value;
+        dirty[v.comp_id[id]] = true;
+    }
+    //Части, на которые распадается компонента, изменились для всех её узлов
+    for(size_t i = 0; i < m.comps.size(); ++i) {
+        if(dirty[i]) {
+            for(auto id : m.comps[i].nodes) {
+                v.local[id] = node_local(v, id, m.comps[i].value);
+            }
+        }
+    }
+    return 0;
+}
+
+//Повторный поиск точек сочленения и пересчёт оценок компоненты модели
+static void model_reanalyze(Model &m, int comp_id) {
+    Component &c = m.comps[comp_id];
+    c.cutpoints.clear();
+    c.bridges.clear();
+    for(auto id : c.nodes) {
+        m.values.tin[id] = -1;
+        m.values.up[id] = -1;
+    }
+    analyze_comp(m.graph, m.values, c);
+}
+
+//Исключение компоненты comp_id из модели: на её место встаёт последняя
+static void model_drop_comp(Model &m, int comp_id) {
+    int last = m.comps.size() - 1;
+    if(comp_id != last) {
+        m.comps[comp_id] = std::move(m.comps[last]);
+        for(auto id : m.comps[comp_id].nodes) {
+            m.values.comp_id[id] = comp_id;
+        }
+    }
+    m.comps.pop_back();
+}
 
-        parse(graph, values, in, std::cout);
+//Номер компоненты узла; отсутствующий узел создаётся отдельной компонентой
+static int model_node(Model &m, const Name &name) {
+    auto it = m.values.index.find(name);
+    if(it != m.values.index.end()) {
+        return m.values.comp_id[it->second];
+    }
+    int id = node_add(m.values, name);
+    m.graph[name];
+    int comp_id = m.comps.size();
+    m.values.comp_id[id] = comp_id;
+    m.comps.emplace_back();
+    m.comps.back().nodes.push_back(id);
+    model_reanalyze(m, comp_id);
+    return comp_id;
+}
+
+int add_edge(Model &m, const Name &a, const Name &b) {
+    int ca = model_node(m, a);
+    int cb = model_node(m, b);
+    if(!m.graph[a].insert(b).second) {
+        return 0;
+    }
+    m.graph[b].insert(a);
+    if(a == b) {
+        //Петля не меняет ни компонент, ни точек сочленения
+        return 0;
+    }
 
-        Components comps;
-        make_components(graph, values, comps);
-        
-        for(auto c : comps) {
-            reduce(graph, values, c);
+    if(ca != cb) {
+        //Слияние: узлы меньшей компоненты переходят в большую
+        if(m.comps[ca].nodes.size() < m.comps[cb].nodes.size()) {
+            std::swap(ca, cb);
+        }
+        Component &to = m.comps[ca];
+        Component &from = m.comps[cb];
+        m.total -= to.value * to.value + from.value * from.value;
+        for(auto id : from.nodes) {
+            m.values.comp_id[id] = ca;
+        }
+        to.nodes.insert(to.nodes.end(), from.nodes.begin(), from.nodes.end());
+        to.value += from.value;
+        m.total += to.value * to.value;
+        model_drop_comp(m, cb);
+        if(ca == (int)m.comps.size()) {
+            //Большая компонента была последней и переехала на место меньшей
+            ca = cb;
         }
+    }
+    model_reanalyze(m, ca);
+    return 0;
+}
 
-        for(auto &[name, links] : graph) {
-            if(values[name].is_cutp) {
-                values[name].sum = values[name].value;
+int remove_edge(Model &m, const Name &a, const Name &b) {
+    auto ia = m.graph.find(a);
+    if(ia == m.graph.end() || ia->second.erase(b) == 0) {
+        return -1;
+    }
+    m.graph.find(b)->second.erase(a);
+    if(a == b) {
+        return 0;
+    }
+
+    //Компоненту разделяет только мост: ребро дерева обхода (v, w),
+    //из поддерева w которого нет обратных рёбер выше w
+    Values &v = m.values;
+    int na = v.index.find(a)->second;
+    int nb = v.index.find(b)->second;
+    int ca = v.comp_id[na];
+    int side = -1;
+    if(v.up[nb] == na && v.low[nb] > v.tin[na]) {
+        side = nb;
+    } else if(v.up[na] == nb && v.low[na] > v.tin[nb]) {
+        side = na;
+    }
+    if(side != -1) {
+        //Узлы отделившегося поддерева сразу получают номер новой компоненты
+        int cb = m.comps.size();
+        Component part(m.comps.get_allocator());
+        std::vector<int> stack{side};
+        v.comp_id[side] = cb;
+        while(!stack.empty()) {
+            int cur = stack.back();
+            stack.pop_back();
+            part.nodes.push_back(cur);
+            part.value += v.value[cur];
+            for(auto &link : m.graph.find(*v.names[cur])->second) {
+                int to = v.index.find(link)->second;
+                if(v.comp_id[to] != cb) {
+                    v.comp_id[to] = cb;
+                    stack.push_back(to);
+                }
             }
         }
-        
-        for(auto &[name, node] : values) {
-            value_t vitality = 0;
-            int comp_id = 0;
-            for(auto comp : comps) {
-                if(comp_id == node.comp_id) {
-                    value_t result;
-                    if(!node.is_cutp) {
-                        result = comp.value - node.value;
-                        vitality += result * result;
-                    } else {
-                        std::set<std::string> used;
-                        used.insert(name);
-                        result = 0;
-                        for(auto link : graph[name]) {
-                            if(used.find(link) == used.end()) {
-                                result = count_graph(graph, values, comp, used, link);
-                                vitality += result * result;
-                            }
-                        }
+
+        //Компонента распалась: поддерево становится новой компонентой
+        Component &c = m.comps[ca];
+        m.total -= c.value * c.value;
+        c.nodes.erase(std::remove_if(c.nodes.begin(), c.nodes.end(),
+                [&](int id) { return v.comp_id[id] == cb; }), c.nodes.end());
+        c.value -= part.value;
+        m.total += c.value * c.value + part.value * part.value;
+        m.comps.push_back(std::move(part));
+        model_reanalyze(m, cb);
+    }
+    model_reanalyze(m, ca);
+    return 0;
+}
+
+void model_print(Model &m, std::ostream &out, const Options &opts) {
+    if(opts.remove > 1) {
+        Links links(m.comps.get_allocator());
+        links_build(m.graph, m.values, links);
+        print_kset(out, links, m.values, opts, engine_pool, needs_wide(m.values));
+        return;
+    }
+    if(needs_wide(m.values)) {
+        //Суммы модели - в value_t, оценки переполнились бы
+        out << "sum of weights exceeds 2^32: the model supports 64-bit scores only" << std::endl;
+        return;
+    }
+    print_scores(out, m.comps, m.values, m.values.names, m.total, opts);
+}
+
+void topology_build(Model &m, Topology &t) {
+    Values &v = m.values;
+    size_t n = v.size();
+    t = Topology();
+    t.comps = m.comps.size();
+    t.names.reserve(n);
+    t.index.reserve(n);
+    //В прямом порядке обхода предок раньше потомка, поэтому
+    //внутри компоненты узлы идут по убыванию времени входа
+    std::vector<int> ids;
+    std::vector<int> pos(n);
+    std::vector<std::pair<int, int>> order;
+    for(size_t c = 0; c < m.comps.size(); ++c) {
+        order.clear();
+        for(auto id : m.comps[c].nodes) {
+            order.push_back({v.tin[id], id});
+        }
+        std::sort(order.begin(), order.end(), std::greater<>());
+        for(auto &[tin, id] : order) {
+            pos[id] = t.names.size();
+            t.index[*v.names[id]] = t.names.size();
+            t.names.push_back(v.names[id]);
+            t.comp.push_back(c);
+            ids.push_back(id);
+        }
+    }
+    t.value.resize(n);
+    t.up.resize(n, -1);
+    t.sep.resize(n);
+    for(size_t i = 0; i < n; ++i) {
+        int id = ids[i];
+        t.value[i] = v.value[id];
+        t.sep[i] = (v.flags[id] & NODE_SEP) != 0;
+        if(v.up[id] != -1) {
+            t.up[i] = pos[v.up[id]];
+        }
+    }
+}
+
+//Количество сценариев, обрабатываемых вместе: веса одного узла
+//во всех сценариях пачки лежат подряд и складываются векторными командами
+static const size_t SCENARIO_BATCH = 8;
+
+/**
+ * Нужны ли what_if() суммы wide_t: как needs_wide() для весов хотя бы
+ * одного сценария
+ */
+static bool needs_wide(const Topology &t, const std::vector<Weights> &scenarios) {
+    const value_t limit = std::numeric_limits<int>::max();
+    wide_t base = 0;
+    size_t negative = 0;
+    for(auto w : t.value) {
+        base += w;
+        negative += w > limit;
+    }
+    for(auto &scenario : scenarios) {
+        wide_t sum = base;
+        size_t count = negative;
+        for(auto &[name, value] : scenario) {
+            value_t old = t.value[t.index.find(name)->second];
+            sum = sum + value - old;
+            count = count + (value > limit) - (old > limit);
+        }
+        if(count == 0 && sum > std::numeric_limits<unsigned int>::max()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Оценка сценариев и вывод с суммами ширины Acc
+template<typename Acc>
+static void what_if_sized(const Topology &t, const std::vector<Weights> &scenarios, std::ostream &out) {
+    const size_t B = SCENARIO_BATCH;
+    size_t n = t.names.size();
+    size_t batches = (scenarios.size() + B - 1) / B;
+    std::vector<Best<Acc>> best(scenarios.size());
+    pool_for(engine_pool, batches, 1, [&](size_t from, size_t to) {
+        //Матрицы узлы x сценарии пачки
+        std::vector<Acc> w(n * B);
+        std::vector<Acc> sub(n * B);
+        std::vector<Acc> cut(n * B);
+        std::vector<Acc> squares(n * B);
+        std::vector<Acc> comp(t.comps * B);
+        for(size_t k = from; k < to; ++k) {
+            size_t first = k * B;
+            size_t count = std::min(B, scenarios.size() - first);
+            for(size_t i = 0; i < n; ++i) {
+                for(size_t s = 0; s < B; ++s) {
+                    w[i * B + s] = t.value[i];
+                }
+            }
+            for(size_t s = 0; s < count; ++s) {
+                for(auto &[name, value] : scenarios[first + s]) {
+                    w[t.index.find(name)->second * B + s] = value;
+                }
+            }
+            sub = w;
+            std::fill(cut.begin(), cut.end(), 0);
+            std::fill(squares.begin(), squares.end(), 0);
+            std::fill(comp.begin(), comp.end(), 0);
+
+            //Веса поддеревьев и частей, отделяемых удалением родителя
+            for(size_t i = 0; i < n; ++i) {
+                const Acc *wi = &w[i * B];
+                const Acc *si = &sub[i * B];
+                Acc *wc = &comp[t.comp[i] * B];
+                for(size_t s = 0; s < B; ++s) {
+                    wc[s] += wi[s];
+                }
+                if(t.up[i] < 0) {
+                    continue;
+                }
+                Acc *sp = &sub[t.up[i] * B];
+                for(size_t s = 0; s < B; ++s) {
+                    sp[s] += si[s];
+                }
+                if(t.sep[i]) {
+                    Acc *cp = &cut[t.up[i] * B];
+                    Acc *qp = &squares[t.up[i] * B];
+                    for(size_t s = 0; s < B; ++s) {
+                        cp[s] += si[s];
+                        qp[s] += si[s] * si[s];
                     }
-                } else {
-                    vitality += comp.value * comp.value;
                 }
-                ++comp_id;
             }
-            vitality += values[name].value;
-            variants[name] = vitality;
-            if(vitality < min_vitality) {
-                min_vitality = vitality;
+            Acc total[B] = {};
+            for(size_t c = 0; c < t.comps; ++c) {
+                for(size_t s = 0; s < B; ++s) {
+                    total[s] += comp[c * B + s] * comp[c * B + s];
+                }
+            }
+
+            //Оценки узлов как в node_local()
+            Acc score[B];
+            for(size_t i = 0; i < n; ++i) {
+                const Acc *wc = &comp[t.comp[i] * B];
+                for(size_t s = 0; s < B; ++s) {
+                    Acc wi = w[i * B + s];
+                    Acc rest = wc[s] - wi - cut[i * B + s];
+                    score[s] = total[s] - wc[s] * wc[s] + squares[i * B + s] + rest * rest + wi;
+                }
+                for(size_t s = 0; s < count; ++s) {
+                    Best<Acc> &b = best[first + s];
+                    if(score[s] < b.vitality) {
+                        b.vitality = score[s];
+                        b.names.clear();
+                    }
+                    if(score[s] == b.vitality) {
+                        b.names.push_back(t.names[i]);
+                    }
+                }
             }
         }
+    });
 
+    out << "[";
+    for(size_t s = 0; s < best.size(); ++s) {
+        std::vector<Best<Acc>> one{std::move(best[s])};
+        out << (s ? ", [" : "[");
+        print_best(out, one, Options());
+        out << "]";
+    }
+    out << "]" << std::endl;
+}
 
-        std::cout << "[";
-        bool is_only_answer = true;
-        for(auto& [name, vitality] : variants) {
-            if(vitality == min_vitality) {
-                if(is_only_answer) {
-                    std::cout << "\'" << name << "\'";
-                    is_only_answer = false;
-                } else {
-                    std::cout << ", \'" << name << "\'";
-                }
+int what_if(const Topology &t, const std::vector<Weights> &scenarios, std::ostream &out) {
+    for(size_t s = 0; s < scenarios.size(); ++s) {
+        for(auto &[name, value] : scenarios[s]) {
+            if(t.index.find(name) == t.index.end()) {
+                out << "unknown node '" << name << "' in scenario " << s + 1 << std::endl;
+                return -1;
             }
         }
-        std::cout << "]" << std::endl;
+    }
+
+    if(needs_wide(t, scenarios)) {
+        what_if_sized<wide_t>(t, scenarios, out);
+    } else {
+        what_if_sized<value_t>(t, scenarios, out);
     }
     return 0;
 }
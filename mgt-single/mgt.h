@@ -5,13 +5,27 @@
 #include <unordered_set>
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <functional>
 #include <istream>
+#include <ostream>
+#include <ctime>
+#include <cstdio>
+
+/**
+ * Имя узла. Имена и контейнеры графа используют полиморфные аллокаторы:
+ * память одного запроса берётся из арены (см. Arena) и освобождается разом
+ */
+using Name = std::pmr::string;
 
 /**
  * Граф, сформированный из входного файла
  */
-using Graph = std::unordered_map<std::string, std::set<std::string>>;
+using Graph = std::pmr::unordered_map<Name, std::pmr::set<Name>>;
 
 /**
  * Тип данных для подсчёта квадратов сумм
@@ -19,44 +33,390 @@ using Graph = std::unordered_map<std::string, std::set<std::string>>;
 using value_t = unsigned long long;
 
 /**
- * Представление узла графа с дополнительными данными
- *   Node(value_t v = 0) : value(v) {}: конструктор с заданием собственного веса
- *   value_t value{}; //собственный исходный вес узла
- *   int comp_id = -1; //Индекс в векторе компонент связности графа
- *   value_t sum{}; //Сумма весов узла после редуцирования графа
- *   bool is_cutp{}; // true = узел является точкой сочленения
- *   bool is_reduced{};
+ * Тип данных для точного подсчёта квадратов сумм, не помещающихся в value_t
+ */
+using wide_t = unsigned __int128;
+
+/**
+ * Вывод 128-битной суммы: стандартные потоки выводят не больше 64 бит
+ */
+std::ostream &operator<<(std::ostream &out, wide_t x);
+
+/**
+ * Признаки узла, упакованные битами в один байт
+ *   NODE_CUTP : узел является точкой сочленения
+ *   NODE_SEP : при удалении родителя в дереве обхода поддерево узла отделяется
+ */
+enum : unsigned char {
+    NODE_CUTP = 1,
+    NODE_SEP = 2,
+};
+
+/**
+ * Атрибуты узлов графа - параллельные плотные массивы, индексированные
+ * номером узла: проход по одному атрибуту читает память подряд и не
+ * затрагивает остальные. Ядро анализа параметризовано типом номера узла Id
+ * (знаковый или беззнаковый, Id(-1) - «нет узла») и типом сумм весов Acc:
+ * для малых графов номера занимают вдвое меньше места, для больших весов
+ * суммы считаются точно (см. process_in)
+ *   std::pmr::vector<Acc> value : собственный исходный вес узла
+ *   std::pmr::vector<Id> comp_id : индекс в векторе компонент связности графа
+ *                                  (Id(-1) - не определён)
+ *   std::pmr::vector<unsigned char> flags : признаки узла NODE_*
+ *   std::pmr::vector<Id> tin : время входа при обходе в глубину (Id(-1) = узел не посещён)
+ *   std::pmr::vector<Id> low : наименьшее время входа, достижимое из поддерева узла
+ *   std::pmr::vector<Acc> sub : суммарный вес поддерева узла в дереве обхода
+ *   std::pmr::vector<Acc> local : сумма квадратов весов частей компоненты, на которые
+ *                                 она распадается при удалении узла, плюс вес узла
+ * Для пересчёта оценок после изменения весов (заполняет analyze_comp):
+ *   std::pmr::vector<Id> up : родитель в дереве обхода (Id(-1) - корень)
+ *   std::pmr::vector<Acc> cut : суммарный вес отделяемых поддеревьев детей
+ *   std::pmr::vector<Acc> squares : сумма квадратов весов этих поддеревьев
  */
-struct Node {
-    Node(value_t v = 0) : value(v) {}
-    value_t value{};
-    int comp_id = -1;
-    value_t sum{};
-    bool is_cutp{};
-    bool is_reduced{};
+template<typename Id, typename Acc>
+struct BasicNodes {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    explicit BasicNodes(const allocator_type &a = {})
+        : value(a), comp_id(a), flags(a), tin(a), low(a), sub(a), local(a), up(a), cut(a), squares(a) {}
+    BasicNodes(const BasicNodes &v, const allocator_type &a = {})
+        : value(v.value, a), comp_id(v.comp_id, a), flags(v.flags, a), tin(v.tin, a), low(v.low, a),
+          sub(v.sub, a), local(v.local, a), up(v.up, a), cut(v.cut, a), squares(v.squares, a) {}
+    BasicNodes(BasicNodes &&) = default;
+    BasicNodes &operator=(const BasicNodes &) = default;
+    BasicNodes &operator=(BasicNodes &&) = default;
+    //n узлов с весами value, остальные атрибуты - как у только что добавленного узла
+    template<typename Weight>
+    void reset(const std::pmr::vector<Weight> &weights) {
+        size_t n = weights.size();
+        value.assign(weights.begin(), weights.end());
+        comp_id.assign(n, Id(-1));
+        flags.assign(n, 0);
+        tin.assign(n, Id(-1));
+        low.assign(n, 0);
+        sub.assign(n, 0);
+        local.assign(n, 0);
+        up.assign(n, Id(-1));
+        cut.assign(n, 0);
+        squares.assign(n, 0);
+    }
+    std::pmr::vector<Acc> value;
+    std::pmr::vector<Id> comp_id;
+    std::pmr::vector<unsigned char> flags;
+    std::pmr::vector<Id> tin;
+    std::pmr::vector<Id> low;
+    std::pmr::vector<Acc> sub;
+    std::pmr::vector<Acc> local;
+    std::pmr::vector<Id> up;
+    std::pmr::vector<Acc> cut;
+    std::pmr::vector<Acc> squares;
 };
 
 /**
- * Тип данных для массива узлов
+ * Узлы графа: имена и атрибуты с номером узла int и суммами value_t
+ * (их использует всё, кроме специализированного ядра process())
+ *   std::pmr::unordered_map<Name, int> index : номер узла по имени
+ *   std::pmr::vector<const Name *> names : имя узла (ключ в index)
+ * При копировании и присваивании names перестраивается по ключам нового index.
  */
-using Values = std::unordered_map<std::string, Node>;
+struct Values : BasicNodes<int, value_t> {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    explicit Values(const allocator_type &a = {});
+    Values(const Values &v, const allocator_type &a = {});
+    Values(Values &&) = default;
+    Values &operator=(const Values &v);
+    Values &operator=(Values &&v);
+    allocator_type get_allocator() const { return index.get_allocator(); }
+    size_t size() const { return names.size(); }
+    std::pmr::unordered_map<Name, int> index;
+    std::pmr::vector<const Name *> names;
+};
+
+/**
+ * Номер узла name; отсутствующий узел добавляется с весом value
+ * (вес уже имеющегося узла не меняется)
+ */
+int node_add(Values &v, const Name &name, value_t value = 0);
+
+/**
+ * Веса узлов по именам: новые веса и сценарии весов
+ */
+using Weights = std::pmr::unordered_map<Name, value_t>;
+
+/**
+ * Связи графа списками номеров узлов, уложенными подряд (CSR):
+ * связи узла id - adj[first[id]] .. adj[first[id + 1] - 1]
+ *   std::pmr::vector<size_t> first : начало списка связей узла в adj
+ *   std::pmr::vector<Id> adj : списки связей подряд
+ */
+template<typename Id>
+struct BasicLinks {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    explicit BasicLinks(const allocator_type &a = {}) : first(a), adj(a) {}
+    BasicLinks(const BasicLinks &l, const allocator_type &a = {}) : first(l.first, a), adj(l.adj, a) {}
+    BasicLinks(BasicLinks &&) = default;
+    BasicLinks &operator=(const BasicLinks &) = default;
+    BasicLinks &operator=(BasicLinks &&) = default;
+    using iterator = const Id *;
+    std::pair<iterator, iterator> of(int id) const {
+        return {adj.data() + first[id], adj.data() + first[id + 1]};
+    }
+    static int to(iterator it) { return *it; }
+    size_t degree(int id) const { return first[id + 1] - first[id]; }
+    std::pmr::vector<size_t> first;
+    std::pmr::vector<Id> adj;
+};
+
+using Links = BasicLinks<int>;
+
+/**
+ * Связи графа в сжатом виде - для очень больших графов: список связей узла
+ * id начинается с байта bytes[first[id]] и состоит из чисел переменной
+ * длины (по 7 бит в байте, старший бит - признак продолжения): число
+ * связей, разность первого номера и id (знак - в младшем бите), затем
+ * приращения номеров по возрастанию. Списки разворачиваются по ходу обхода;
+ * после перенумерации (Order) соседи близки по номерам, и связь чаще всего
+ * занимает один байт вместо четырёх
+ *   std::pmr::vector<size_t> first : начало списка связей узла в bytes
+ *   std::pmr::vector<unsigned char> bytes : списки связей подряд
+ */
+struct PackedLinks {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    explicit PackedLinks(const allocator_type &a = {}) : first(a), bytes(a) {}
+    PackedLinks(const PackedLinks &l, const allocator_type &a = {}) : first(l.first, a), bytes(l.bytes, a) {}
+    PackedLinks(PackedLinks &&) = default;
+    PackedLinks &operator=(const PackedLinks &) = default;
+    PackedLinks &operator=(PackedLinks &&) = default;
+    static size_t get(const unsigned char *&p) {
+        size_t x = *p & 0x7f;
+        for(int shift = 7; *p++ & 0x80; shift += 7) {
+            x |= size_t(*p & 0x7f) << shift;
+        }
+        return x;
+    }
+    /**
+     * Позиция в списке связей: текущий узел, следующий байт и число
+     * оставшихся связей (конец списка - left == 0)
+     */
+    struct iterator {
+        const unsigned char *p;
+        int cur;
+        size_t left;
+        bool operator!=(const iterator &i) const { return left != i.left; }
+        iterator &operator++() {
+            if(--left) {
+                cur += int(get(p));
+            }
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator old = *this;
+            ++*this;
+            return old;
+        }
+    };
+    std::pair<iterator, iterator> of(int id) const {
+        const unsigned char *p = bytes.data() + first[id];
+        size_t n = get(p);
+        int cur = 0;
+        if(n) {
+            size_t z = get(p);
+            cur = id + ((z & 1) ? -int(z >> 1) : int(z >> 1));
+        }
+        return {{p, cur, n}, {nullptr, 0, 0}};
+    }
+    static int to(iterator it) { return it.cur; }
+    size_t degree(int id) const {
+        const unsigned char *p = bytes.data() + first[id];
+        return get(p);
+    }
+    std::pmr::vector<size_t> first;
+    std::pmr::vector<unsigned char> bytes;
+};
+
+/**
+ * Связи графа во временном файле, отображённом в память (внешний режим,
+ * см. external.cpp): в памяти процесса - только first и comp, O(V), а
+ * страницы списков связей подгружает и вытесняет система
+ *   std::pmr::vector<size_t> first : начало списка связей узла в adj
+ *   std::pmr::vector<int> comp : представитель компоненты связности узла
+ *                                (система непересекающихся множеств)
+ *   const int *adj : списки связей подряд, как в Links
+ *   FILE *edges : рёбра в порядке входных данных до построения списков
+ *   FILE *file : файл списков связей
+ *   size_t budget : сколько концов рёбер сортировать в памяти за раз
+ * Не копируется: владеет временными файлами и отображением.
+ */
+struct MappedLinks {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    explicit MappedLinks(const allocator_type &a = {}) : first(a), comp(a) {}
+    MappedLinks(const MappedLinks &) = delete;
+    MappedLinks &operator=(const MappedLinks &) = delete;
+    ~MappedLinks();
+    using iterator = const int *;
+    std::pair<iterator, iterator> of(int id) const {
+        return {adj + first[id], adj + first[id + 1]};
+    }
+    static int to(iterator it) { return *it; }
+    size_t degree(int id) const { return first[id + 1] - first[id]; }
+    std::pmr::vector<size_t> first;
+    std::pmr::vector<int> comp;
+    const int *adj{};
+    size_t mapped{};
+    FILE *edges{};
+    FILE *file{};
+    size_t budget{};
+};
+
+/**
+ * Рёбра графа парами номеров концов, в порядке входных данных
+ * (повторы и петли допускаются)
+ */
+using Edges = std::pmr::vector<std::pair<int, int>>;
+
+/**
+ * Получатель рёбер при потоковом разборе: номера концов ребра
+ */
+using EdgeSink = std::function<void(int, int)>;
+
+/**
+ * Порядок номеров узлов при анализе
+ *   ORDER_NONE : порядок появления узлов во входных данных
+ *   ORDER_BFS : обход в ширину - соседи получают близкие номера
+ *   ORDER_RCM : обратный порядок Катхилла - Макки (обход в ширину от узла
+ *               наименьшей степени, соседи - по возрастанию степени)
+ *   ORDER_DEGREE : по убыванию степени - связи концентрируются у первых узлов
+ */
+enum Order {
+    ORDER_NONE,
+    ORDER_BFS,
+    ORDER_RCM,
+    ORDER_DEGREE,
+};
+
+/**
+ * Мост - связь, при удалении которой компонента распадается на две части
+ *   Id from : конец связи со стороны корня дерева обхода
+ *   Id to : конец связи, поддерево которого отделяется
+ *           (вес отделяемой части - BasicNodes::sub[to])
+ */
+template<typename Id>
+struct BasicBridge {
+    Id from;
+    Id to;
+};
 
 /**
  * Структула, описывающая компоненту связности графа
- *   std::set<std::string> names : перечень узлов
- *   std::set<std::string> cutpoints : перечень точек сочленения
- *   value_t value{} : суммарный вес компоненты связности
+ *   std::pmr::vector<Id> nodes : номера узлов, первый - корень обхода
+ *   std::pmr::vector<Id> cutpoints : номера точек сочленения
+ *   Acc value{} : суммарный вес компоненты связности
+ *   std::pmr::vector<BasicBridge<Id>> bridges : мосты компоненты
+ * Конструкторы с аллокатором нужны, чтобы компоненты в Components
+ * размещали свои перечни в памяти самого массива.
  */
-struct Component {
-    std::set<std::string> names;
-    std::set<std::string> cutpoints;
-    value_t value{};
+template<typename Id, typename Acc>
+struct BasicComponent {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    explicit BasicComponent(const allocator_type &a = {}) : nodes(a), cutpoints(a), bridges(a) {}
+    BasicComponent(const BasicComponent &c, const allocator_type &a)
+        : nodes(c.nodes, a), cutpoints(c.cutpoints, a), value(c.value), bridges(c.bridges, a) {}
+    BasicComponent(BasicComponent &&c, const allocator_type &a)
+        : nodes(std::move(c.nodes), a), cutpoints(std::move(c.cutpoints), a), value(c.value),
+          bridges(std::move(c.bridges), a) {}
+    BasicComponent(const BasicComponent &) = default;
+    BasicComponent(BasicComponent &&) = default;
+    BasicComponent &operator=(const BasicComponent &) = default;
+    BasicComponent &operator=(BasicComponent &&) = default;
+    std::pmr::vector<Id> nodes;
+    std::pmr::vector<Id> cutpoints;
+    Acc value{};
+    std::pmr::vector<BasicBridge<Id>> bridges;
 };
 
+/**
+ * Мост и компонента связности для узлов Values
+ */
+using Bridge = BasicBridge<int>;
+using Component = BasicComponent<int, value_t>;
+
 /**
  * Тип данных для массива компонентов связности
  */
-using Components = std::vector<Component>;
+template<typename Id, typename Acc>
+using BasicComponents = std::pmr::vector<BasicComponent<Id, Acc>>;
+using Components = BasicComponents<int, value_t>;
+
+/**
+ * Память арены сверх её буфера: обычная куча с подсчётом выданного
+ *   size_t taken : выдано байт с последнего сброса арены
+ */
+struct ArenaHeap : std::pmr::memory_resource {
+    size_t taken{};
+    void *do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void *p, size_t bytes, size_t align) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+};
+
+/**
+ * Арена для контейнеров одного запроса: память выдаётся подряд из буфера,
+ * освобождение отдельных объектов ничего не стоит, а вся память
+ * освобождается разом при сбросе. Буфер сохраняется между запросами и
+ * растёт до пикового объёма запроса, поэтому в установившемся режиме
+ * запрос не обращается к куче. Арена однопоточная: у каждого обработчика своя.
+ *   std::unique_ptr<char[]> buffer : буфер
+ *   size_t size : размер буфера, байт
+ *   ArenaHeap heap : память, взятая сверх буфера
+ *   std::optional<std::pmr::monotonic_buffer_resource> mem : выделение из буфера
+ */
+struct Arena {
+    explicit Arena(size_t size = 256 * 1024);
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    std::unique_ptr<char[]> buffer;
+    size_t size;
+    ArenaHeap heap;
+    std::optional<std::pmr::monotonic_buffer_resource> mem;
+};
+
+/**
+ * Источник памяти арены для контейнеров
+ */
+std::pmr::memory_resource *arena_resource(Arena &a);
+
+/**
+ * Сброс арены: вся выделенная из неё память освобождается, а если запрос
+ * не уместился в буфер, буфер увеличивается на недостающий объём.
+ * Контейнеры на арене к этому моменту должны быть уничтожены.
+ */
+void arena_reset(Arena &a);
+
+/**
+ * Параметры запроса: необязательный третий раздел входных данных,
+ * например {[...],{...},{'top':5}}
+ *   size_t top : вывести top лучших узлов с оценками
+ *                (0 - только узлы с наименьшей оценкой, без оценок)
+ *   bool all : вывести оценки всех узлов
+ *   bool edges : оценивать удаление связей-мостов вместо узлов
+ *                (сумма квадратов весов компонент после удаления связи)
+ *   size_t remove : искать лучший набор из remove узлов, удаляемых
+ *                   вместе (0, 1 - оценка отдельных узлов)
+ *   Order order : перенумерация узлов перед анализом
+ *                 (задаётся только вызывающим, не входными данными)
+ *   bool packed : хранить связи в сжатом виде (PackedLinks) - для очень
+ *                 больших графов (задаётся только вызывающим)
+ *   size_t external : не 0 - внешний режим для графов больше памяти:
+ *                     связи - во временных файлах, сортировка порциями по
+ *                     external МБ (задаётся только вызывающим)
+ */
+struct Options {
+    size_t top{};
+    bool all{};
+    bool edges{};
+    size_t remove{};
+    Order order{};
+    bool packed{};
+    size_t external{};
+};
 
 /**
  * Разбор входного потока и формирование контейнеров графа и
@@ -66,10 +426,331 @@ using Components = std::vector<Component>;
  *   Graph& g : сформированный граф
  *   Values& v : сформированный массив узлов графа
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ *   Options *opts : если не nullptr - параметры запроса из входных данных
  * Возвращаемое значение:
  *   0 - успешно
  *   не 0 - ошибка
  */
-int ser_in(std::istream& in, Graph& g, Values& v, std::ostream& out);
+int ser_in(std::istream& in, Graph& g, Values& v, std::ostream& out, Options *opts = nullptr);
+
+/**
+ * Разбор входного потока в список рёбер по номерам узлов - без графа с
+ * именами (вариант с EdgeSink передаёт рёбра по одному, не накапливая);
+ * параметры и результат - как у ser_in для Graph
+ */
+int ser_in(std::istream& in, Edges& edges, Values& v, std::ostream& out, Options *opts = nullptr);
+int ser_in(std::istream& in, const EdgeSink& edge, Values& v, std::ostream& out, Options *opts = nullptr);
+
+/**
+ * Разбор списка сценариев - наборов весов узлов [{'A':1,...},{...}]
+ * Параметры:
+ *   std::istream& in : входной поток
+ *   std::vector<Weights> &scenarios : сценарии
+ *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка
+ */
+int ser_in_scenarios(std::istream& in, std::vector<Weights> &scenarios, std::ostream& out);
+
+/**
+ * Построение списков связей по номерам узлов. Узлы графа, которых
+ * нет в v, добавляются с нулевым весом, узлы v без связей - без связей.
+ */
+void links_build(Graph &g, Values &v, Links &l);
+
+/**
+ * Построение списков связей из списка рёбер для n узлов: связи каждого
+ * узла упорядочены по номерам, повторные рёбра отбрасываются
+ */
+void links_build(const Edges &e, size_t n, Links &l);
+
+/**
+ * Сжатие списков связей l в p (l после этого можно освободить)
+ */
+void links_pack(const Links &l, PackedLinks &p);
+
+/**
+ * Внешний режим (external.cpp). Разбор входного потока: рёбра по мере
+ * разбора пишутся во временный файл l.edges, компоненты связности
+ * собираются в l.comp; параметры и результат - как у ser_in
+ */
+int ser_in(std::istream& in, MappedLinks& l, Values& v, std::ostream& out, Options *opts = nullptr);
+
+/**
+ * Внешний режим: построение упорядоченных списков связей без повторов
+ * для n узлов из l.edges порциями по l.budget концов рёбер, запись их в
+ * файл и отображение файла в память
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка записи временных файлов (сообщение - в out)
+ */
+int links_map(MappedLinks &l, size_t n, std::ostream &out);
+
+/**
+ * Перенумерация узлов в порядке order: переставляются массивы v и
+ * списки связей l, связи каждого узла сортируются по номерам.
+ * Выполняется до поиска компонент: их перечни ссылаются на номера узлов.
+ */
+void reorder(Values &v, Links &l, Order order);
+
+/**
+ * Порядок узлов по имени: none, bfs, rcm, degree
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - неизвестное имя
+ */
+int parse_order(const char *name, Order &order);
+
+/**
+ * Разделение графа на компоненты связности: заполняются перечни узлов,
+ * суммарные веса компонент и номера компонент в узлах
+ */
+void make_components(Graph &g, Values &v, Components &comps);
+void make_components(const Links &l, Values &v, Components &comps);
+void make_components(const PackedLinks &l, Values &v, Components &comps);
+void make_components(const MappedLinks &l, Values &v, Components &comps);
+
+/**
+ * Поиск точек сочленения компоненты c и расчёт Values::local для каждого
+ * её узла одним обходом в глубину. Затрагивает только узлы компоненты c,
+ * поэтому разные компоненты можно обрабатывать параллельно.
+ * Вариант с Graph - для модели, связи которой меняются между запросами.
+ */
+void analyze_comp(Graph &g, Values &v, Component &c);
+void analyze_comp(const Links &l, Values &v, Component &c);
+void analyze_comp(const PackedLinks &l, Values &v, Component &c);
+void analyze_comp(const MappedLinks &l, Values &v, Component &c);
+
+struct Pool;
+
+/**
+ * То же, что analyze_comp(), но параллельно внутри одной компоненты
+ * (схема Тарьяна - Вишкина, см. bicon.cpp). Имеет смысл для компонент
+ * из сотен тысяч узлов.
+ * Параметры:
+ *   Pool *pool : пул потоков (nullptr - выполнять в вызывающем потоке)
+ */
+void analyze_comp_parallel(const Links &l, Values &v, Component &c, Pool *pool);
+void analyze_comp_parallel(const PackedLinks &l, Values &v, Component &c, Pool *pool);
+void analyze_comp_parallel(const MappedLinks &l, Values &v, Component &c, Pool *pool);
+
+/**
+ * Граф, сохраняемый между запросами вместе с результатами анализа:
+ * после изменения весов узлов оценки пересчитываются без повторного
+ * разбора и поиска точек сочленения.
+ * Не копируется: узлы ссылаются друг на друга указателями.
+ *   Model(std::pmr::memory_resource *mem) : конструктор с источником
+ *                                           памяти всех контейнеров модели
+ *   Graph graph : граф
+ *   Values values : узлы
+ *   Components comps : компоненты связности
+ *   value_t total : сумма квадратов весов компонент
+ */
+struct Model {
+    explicit Model(std::pmr::memory_resource *mem = std::pmr::get_default_resource())
+        : graph(mem), values(mem), comps(mem) {}
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+    Graph graph;
+    Values values;
+    Components comps;
+    value_t total{};
+};
+
+/**
+ * Разбор входного потока и анализ графа с сохранением в модели
+ * Параметры:
+ *   Model &m : модель (должна быть пустой)
+ *   std::istream &in : входной поток
+ *   std::ostream &out : выходной поток для вывода ошибок
+ *   Options *opts : если не nullptr - параметры запроса из входных данных
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка разбора
+ */
+int model_build(Model &m, std::istream &in, std::ostream &out, Options *opts = nullptr);
+
+/**
+ * Анализ графа, уже разобранного в m.graph и m.values
+ */
+void model_analyze(Model &m);
+
+/**
+ * Изменение весов узлов модели. Для каждого изменённого узла
+ * пересчитываются веса поддеревьев на пути к корню дерева обхода,
+ * затем - оценки узлов затронутых компонент.
+ * Параметры:
+ *   Model &m : модель
+ *   const Weights &changes : новые веса узлов
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - в модели нет какого-то из узлов, веса не изменены
+ */
+int update_weights(Model &m, const Weights &changes);
+
+/**
+ * Добавление связи между узлами a и b модели (отсутствующие узлы
+ * создаются с нулевым весом). Связь разных компонент сливает их:
+ * узлы меньшей получают номер большей. Точки сочленения и оценки
+ * пересчитываются только для получившейся компоненты.
+ * Возвращаемое значение:
+ *   0 - успешно (в том числе если связь уже была)
+ */
+int add_edge(Model &m, const Name &a, const Name &b);
+
+/**
+ * Удаление связи между узлами a и b модели. Пересчитывается только
+ * компонента, которой принадлежала связь; если она распалась,
+ * отделившаяся часть становится новой компонентой.
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - такой связи нет
+ */
+int remove_edge(Model &m, const Name &a, const Name &b);
+
+/**
+ * Вывод результата по модели в формате process()
+ */
+void model_print(Model &m, std::ostream &out, const Options &opts);
+
+/**
+ * Топология модели, подготовленная для оценки многих наборов весов
+ * (сценариев) на одном графе. Узлы пронумерованы так, что в дереве
+ * обхода потомки идут раньше предков: веса поддеревьев считаются
+ * одним проходом по номерам. Имена ссылаются на узлы модели,
+ * поэтому модель должна жить дольше топологии.
+ *   std::vector<const Name *> names : имена узлов
+ *   std::unordered_map<std::string_view, int> index : номер узла по имени
+ *   std::vector<value_t> value : собственные веса узлов в модели
+ *   std::vector<int> up : номер родителя в дереве обхода (-1 - корень)
+ *   std::vector<char> sep : поддерево узла - отдельная часть компоненты
+ *                           при удалении родителя
+ *   std::vector<int> comp : номер компоненты узла
+ *   size_t comps : количество компонент
+ */
+struct Topology {
+    std::vector<const Name *> names;
+    std::unordered_map<std::string_view, int> index;
+    std::vector<value_t> value;
+    std::vector<int> up;
+    std::vector<char> sep;
+    std::vector<int> comp;
+    size_t comps{};
+};
+
+/**
+ * Подготовка топологии по проанализированной модели
+ */
+void topology_build(Model &m, Topology &t);
+
+/**
+ * Оценка сценариев - наборов весов узлов (узлы, которых нет в наборе,
+ * сохраняют вес из модели) и вывод лучших узлов каждого сценария
+ * одной строкой: [['A'], ['B', 'C']]
+ * Параметры:
+ *   const Topology &t : топология графа
+ *   const std::vector<Weights> &scenarios : сценарии
+ *   std::ostream &out : выходной поток для вывода результата или ошибок
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - в сценарии есть узел, которого нет в графе
+ */
+int what_if(const Topology &t, const std::vector<Weights> &scenarios, std::ostream &out);
+
+/**
+ * Поиск и вывод набора из opts.remove узлов, совместное удаление которых
+ * даёт наименьшую сумму квадратов весов оставшихся компонент плюс веса
+ * удалённых узлов: [('A', 'B')], с параметрами top/all - [('A', 'B', 12)]
+ * Параметры:
+ *   const Links &l, Values &v : связи и узлы графа
+ *   const Options &opts : параметры запроса
+ *   Pool *pool : пул для перебора (nullptr - в вызывающем потоке)
+ *   bool wide : оценки в wide_t (needs_wide), иначе в value_t
+ */
+void print_kset(std::ostream &out, const Links &l, Values &v, const Options &opts, Pool *pool,
+        bool wide);
+void print_kset(std::ostream &out, const PackedLinks &l, Values &v, const Options &opts, Pool *pool,
+        bool wide);
+void print_kset(std::ostream &out, const MappedLinks &l, Values &v, const Options &opts, Pool *pool,
+        bool wide);
+
+/**
+ * Количество рёбер графа (петля считается одним ребром)
+ */
+size_t count_edges(Graph &g);
+size_t count_edges(const Links &l);
+size_t count_edges(const MappedLinks &l);
+
+/**
+ * Затраты ресурсов на один этап обработки
+ *   double wall_ms - астрономическое время, мс
+ *   double cpu_ms - процессорное время потока, мс
+ *   long rss_kb - прирост пикового объёма резидентной памяти, КБ
+ */
+struct Stage {
+    double wall_ms{};
+    double cpu_ms{};
+    long rss_kb{};
+};
+
+/**
+ * Отметка времени и памяти в начале этапа
+ */
+struct StageMark {
+    timespec wall{};
+    timespec cpu{};
+    long rss_kb{};
+};
+
+/**
+ * Начать замер этапа
+ */
+StageMark stage_start();
+
+/**
+ * Завершить замер этапа, начатого в точке m, и записать результат в s
+ */
+void stage_stop(const StageMark &m, Stage &s);
+
+/**
+ * Профиль обработки одного входного потока: затраты по этапам
+ * (LINKS - построение связей по номерам узлов и перенумерация),
+ * статистика графа и разрядность номера узла и сумм весов
+ * в выбранной специализации ядра
+ */
+struct Profile {
+    enum { PARSE, LINKS, COMPONENTS, CUTPOINTS, SCORE, STAGES };
+    static const char *const stage_names[STAGES];
+    Stage stages[STAGES];
+    size_t nodes{};
+    size_t edges{};
+    size_t components{};
+    size_t cutpoints{};
+    size_t largest_component{};
+    int id_bits{};
+    int sum_bits{};
+};
+
+/**
+ * Задать пул потоков, на котором process() обрабатывает компоненты
+ * связности графа (nullptr - обрабатывать в вызывающем потоке)
+ */
+void set_engine_pool(Pool *pool);
+
+/**
+ * Разбор входного потока данных,
+ * построение графа, расчёт по графу, вывод результатов
+ * Параметры:
+ *   std::istream& in : входной поток
+ *   std::ostream& out : выходной поток для вывода результата или ошибок
+ *   Profile *prof : если не nullptr - заполнить профиль обработки
+ *   Options opts : параметры запроса по умолчанию
+ *                  (параметры из входных данных их заменяют)
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка разбора (расчёт всё равно выполняется по прочитанной части)
+ */
+int process(std::istream &in, std::ostream &out, Profile *prof = nullptr, Options opts = {});
 
 #endif
@@ -12,11 +12,11 @@
 /**
  * Хранение последнего символа,
  * подсчёт количества обработанных строк и символов
- * Не кошерно, но пока так
+ * Не кошерно, но пока так: у каждого потока свои счётчики (mgt -j)
  */
-static int ser_last_char = 0; //Последний считанный не пробельный символ
-static int line_num; //Количество обработанных строк на одном блоке данных
-static int char_num; //Количество обработанных символов на одном блоке данных
+static thread_local int ser_last_char = 0; //Последний считанный не пробельный символ
+static thread_local int line_num; //Количество обработанных строк на одном блоке данных
+static thread_local int char_num; //Количество обработанных символов на одном блоке данных
 
 /**
  * Обнулить счётчики строк ибайтов
@@ -138,7 +138,7 @@ ser_expect_char(
  * символов-ограничителей. Игнорируются символы "пробел" и "табуляция".
  * Параметры:
  *   std::istream& in - входной поток
- *   std::string& s, - строка для накопления данных
+ *   Name& s, - строка для накопления данных
  *   const char *stop_symbols, - массив символов - ограничителеё
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
@@ -148,7 +148,7 @@ ser_expect_char(
 int
 ser_read_until(
     std::istream& in,
-    std::string& s,
+    Name& s,
     const char *stop_symbols,
     std::ostream& out
 ) {
@@ -189,7 +189,7 @@ ser_read_until(
  * Считывание имени, залючённого в одинарные кавычки, например, 'A'
  * Параметры:
  *   std::istream& in - входной поток
- *   std::string& name - строка для сохранения имени
+ *   Name& name - строка для сохранения имени
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
  *   0 - успешно
@@ -198,7 +198,7 @@ ser_read_until(
 int
 ser_get_name(
     std::istream& in,
-    std::string& name,
+    Name& name,
     std::ostream& out
 ) {
     OK(ser_expect_char(in, "\'", out, true));
@@ -224,8 +224,8 @@ ser_get_graph(
     std::ostream& out
 ) {
     do {
-        std::string n1;
-        std::string n2;
+        Name n1(graph.get_allocator());
+        Name n2(graph.get_allocator());
         OK(ser_expect_char(in, "[", out, true));
         OK(ser_get_name(in, n1, out));
         OK(ser_expect_char(in, ",", out, true));
@@ -239,6 +239,42 @@ ser_get_graph(
 }
 
 
+/**
+ * Считывание массива ссылок вида ['A' = 'B'] в рёбра по номерам узлов
+ * (узлы добавляются в v по мере появления)
+ * Параметры:
+ *   std::istream& in : входной поток
+ *   const EdgeSink& edge : получатель рёбер в порядке входных данных
+ *   Values& v : узлы графа
+ *   std::ostream& out : выходной поток для вывода ошибок, если будут
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка
+ */
+int
+ser_get_edges(
+    std::istream& in,
+    const EdgeSink& edge,
+    Values& v,
+    std::ostream& out
+) {
+    Name n1(v.get_allocator());
+    Name n2(v.get_allocator());
+    do {
+        n1.clear();
+        n2.clear();
+        OK(ser_expect_char(in, "[", out, true));
+        OK(ser_get_name(in, n1, out));
+        OK(ser_expect_char(in, ",", out, true));
+        OK(ser_get_name(in, n2, out));
+        OK(ser_expect_char(in, "]", out, true));
+        int from = node_add(v, n1);
+        edge(from, node_add(v, n2));
+    } while(ser_expect_char(in, ",", out, false) == 0);
+    return 0;
+}
+
+
 /**
  * Считывание значения вида :dd
  * Параметры:
@@ -256,10 +292,10 @@ ser_get_val(
     std::ostream& out
 ) {
     OK(ser_expect_char(in, ":", out, true));
-    std::string valstr;
+    Name valstr;
     OK(ser_read_until(in, valstr, ",}] \t\n", out));
     size_t pos = 0;
-    int v = std::stoi(valstr, &pos);
+    int v = std::stoi(std::string(valstr), &pos);
     if(pos != valstr.size()) {
         out <<ser_err()
             <<"value "
@@ -273,11 +309,38 @@ ser_get_val(
 }
 
 /**
- * Считывание массива значений вида 'A':dd и формирование контейнера
+ * Считывание пары вида 'A':dd
+ * Параметры:
+ *   std::istream& in - входной поток
+ *   Name& name - строка для сохранения имени
+ *   int& value - ссылка для возврата значения
+ *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка
+ */
+int
+ser_get_weight(
+    std::istream& in,
+    Name& name,
+    int& value,
+    std::ostream& out
+) {
+    OK(ser_get_name(in, name, out));
+    OK(ser_get_val(in, value, out));
+    if(isspace(ser_last_char)) {
+        ser_expect_char(in, ",", out, false);
+    }
+    return 0;
+}
+
+/**
+ * Считывание массива значений вида 'A':dd и формирование массива узлов
  * считывание продолжается пока после значения стоит запятая
  * Параметры:
  *   std::istream& in - входной поток
- *   Value& values - контейнер для хранения значений
+ *   Values& values - массив узлов (повторный вес узла не учитывается;
+ *                    узлам, добавленным раньше из связей, вес назначается)
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
  *   0 - успешно
@@ -289,41 +352,100 @@ ser_get_values(
     Values &values,
     std::ostream& out
 ) {
+    size_t known = values.size();
+    std::vector<bool> valued(known);
     do {
-        std::string name;
-        OK(ser_get_name(in, name, out));
+        Name name(values.get_allocator());
         int value;
-        OK(ser_get_val(in, value, out));
-        values.insert({name, Node(value)});
-        if(isspace(ser_last_char)) {
-            ser_expect_char(in, ",", out, false);
+        OK(ser_get_weight(in, name, value, out));
+        size_t id = node_add(values, name, value);
+        if(id < known && !valued[id]) {
+            values.value[id] = value;
+            valued[id] = true;
         }
     } while(ser_last_char == ',');
     return 0;
 }
 
 /**
- * Разбор входного потока и формирование контейнеров графа и
- * массива узлов графа
+ * Считывание массива значений вида 'A':dd в набор весов
  * Параметры:
- *   std::istream& in : входной поток
- *   Graph& g : сформированный граф
- *   Values& v : сформированный массив узлов графа
+ *   std::istream& in - входной поток
+ *   Weights& weights - веса узлов (повторный вес узла не учитывается)
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
  *   0 - успешно
  *   не 0 - ошибка
  */
 int
-ser_in(
+ser_get_weights(
     std::istream& in,
-    Graph &g,
-    Values &v,
+    Weights &weights,
     std::ostream& out
 ) {
-    ser_zero_counters();
-    OK(ser_expect_char(in, "{[", out, true));
-    OK(ser_get_graph(in, g, out));
+    do {
+        Name name(weights.get_allocator());
+        int value;
+        OK(ser_get_weight(in, name, value, out));
+        weights.insert({name, value_t(value)});
+    } while(ser_last_char == ',');
+    return 0;
+}
+
+/**
+ * Считывание параметров запроса вида 'top':5, 'all':1
+ * считывание продолжается пока после значения стоит запятая
+ * Параметры:
+ *   std::istream& in - входной поток
+ *   Options &opts - параметры запроса
+ *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка
+ */
+int
+ser_get_options(
+    std::istream& in,
+    Options &opts,
+    std::ostream& out
+) {
+    do {
+        Name name;
+        OK(ser_get_name(in, name, out));
+        int value;
+        OK(ser_get_val(in, value, out));
+        if(name == "top") {
+            opts.top = value > 0 ? value : 0;
+        } else if(name == "all") {
+            opts.all = value != 0;
+        } else if(name == "edges") {
+            opts.edges = value != 0;
+        } else if(name == "remove") {
+            opts.remove = value > 0 ? value : 0;
+        } else {
+            out <<ser_err()
+                <<"unknown option "
+                <<name
+                <<std::endl;
+            return -1;
+        }
+        if(isspace(ser_last_char)) {
+            ser_expect_char(in, ",", out, false);
+        }
+    } while(ser_last_char == ',');
+    return 0;
+}
+
+/**
+ * Разбор разделов входных данных после списка связей: ],{...}[,{...}]}
+ */
+static int
+ser_in_tail(
+    std::istream& in,
+    Values &v,
+    std::ostream& out,
+    Options *opts
+) {
     if(ser_last_char != ']') {
         std::string prefix = ser_err();
         out <<prefix
@@ -340,16 +462,124 @@ ser_in(
             <<std::endl;
         return -1;
     }
-    OK(ser_expect_char(in, "}", out, true));
-    for(auto value : v) {
-        g[value.first];
+    //Необязательный раздел параметров запроса
+    int next = ser_expect_char(in, "}", out, false);
+    if(next == ',') {
+        Options ignored;
+        OK(ser_expect_char(in, "{", out, true));
+        OK(ser_get_options(in, opts ? *opts : ignored, out));
+        if(ser_last_char != '}') {
+            std::string prefix = ser_err();
+            out <<prefix
+                <<"expected char } after option list"
+                <<std::endl;
+            return -1;
+        }
+        OK(ser_expect_char(in, "}", out, true));
+    } else if(next > 0) {
+        out <<ser_err()
+            <<"expected char } but found "
+            <<char(next)
+            <<std::endl;
+        return next;
+    } else if(next != 0) {
+        return next;
+    }
+    return 0;
+}
+
+/**
+ * Разбор входного потока и формирование контейнеров графа и
+ * массива узлов графа
+ * Параметры:
+ *   std::istream& in : входной поток
+ *   Graph& g : сформированный граф
+ *   Values& v : сформированный массив узлов графа
+ *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ *   Options *opts : если не nullptr - параметры запроса из входных данных
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка
+ */
+int
+ser_in(
+    std::istream& in,
+    Graph &g,
+    Values &v,
+    std::ostream& out,
+    Options *opts
+) {
+    ser_zero_counters();
+    OK(ser_expect_char(in, "{[", out, true));
+    OK(ser_get_graph(in, g, out));
+    OK(ser_in_tail(in, v, out, opts));
+    for(size_t id = 0; id < v.size(); ++id) {
+        g[*v.names[id]];
     }
     for(auto &[from, tos] : g) {
-        v[from];
-        for(auto to : tos) {
-            v[to];
-        }
+        node_add(v, from);
     }
 
     return 0;
 }
+
+/**
+ * Разбор входного потока в рёбра по номерам узлов - без графа
+ * с именами, для обработки одного запроса
+ */
+int
+ser_in(
+    std::istream& in,
+    const EdgeSink &edge,
+    Values &v,
+    std::ostream& out,
+    Options *opts
+) {
+    ser_zero_counters();
+    OK(ser_expect_char(in, "{[", out, true));
+    OK(ser_get_edges(in, edge, v, out));
+    return ser_in_tail(in, v, out, opts);
+}
+
+int
+ser_in(
+    std::istream& in,
+    Edges &edges,
+    Values &v,
+    std::ostream& out,
+    Options *opts
+) {
+    return ser_in(in, [&](int from, int to) { edges.push_back({from, to}); }, v, out, opts);
+}
+
+int
+ser_in_scenarios(
+    std::istream& in,
+    std::vector<Weights> &scenarios,
+    std::ostream& out
+) {
+    ser_zero_counters();
+    OK(ser_expect_char(in, "[{", out, true));
+    while(true) {
+        scenarios.emplace_back();
+        OK(ser_get_weights(in, scenarios.back(), out));
+        if(ser_last_char != '}') {
+            out <<ser_err()
+                <<"expected char } after value list"
+                <<std::endl;
+            return -1;
+        }
+        int next = ser_expect_char(in, ",", out, false);
+        if(next == ']') {
+            return 0;
+        } else if(next < 0) {
+            return next;
+        } else if(next != 0) {
+            out <<ser_err()
+                <<"expected char ] after scenario list"
+                <<std::endl;
+            return -1;
+        }
+        OK(ser_expect_char(in, "{", out, true));
+    }
+}
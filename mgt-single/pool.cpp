@@ -0,0 +1,129 @@
+#include <algorithm>
+
+#include "pool.h"
+
+//Пул, которому принадлежит текущий поток, и номер потока в нём
+static thread_local Pool *current_pool = nullptr;
+static thread_local unsigned current_worker = 0;
+
+//Взять задачу из очереди с номером from или украсть из другой очереди;
+//если group не nullptr - только задачу этой группы
+static bool pool_take(Pool &pool, unsigned from, Task &task, const TaskGroup *group = nullptr) {
+    unsigned n = pool.queues.size();
+    for(unsigned i = 0; i < n; ++i) {
+        TaskQueue &q = pool.queues[(from + i) % n];
+        std::lock_guard<std::mutex> guard(q.lock);
+        auto it = q.tasks.begin();
+        if(group) {
+            it = std::find_if(q.tasks.begin(), q.tasks.end(),
+                    [group](const QueuedTask &t) { return t.group == group; });
+        }
+        if(it != q.tasks.end()) {
+            task = std::move(it->run);
+            q.tasks.erase(it);
+            std::lock_guard<std::mutex> pool_guard(pool.lock);
+            --pool.queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void pool_worker(Pool &pool, unsigned id) {
+    current_pool = &pool;
+    current_worker = id;
+    Task task;
+    while(true) {
+        if(pool_take(pool, id, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(pool.lock);
+        pool.changed.wait(guard, [&]() { return pool.queued > 0 || pool.stop; });
+        if(pool.queued <= 0 && pool.stop) {
+            break;
+        }
+    }
+}
+
+void pool_start(Pool &pool, unsigned n) {
+    if(n == 0) {
+        n = std::max(1u, std::thread::hardware_concurrency());
+    }
+    pool.queues = std::vector<TaskQueue>(n);
+    for(unsigned i = 0; i < n; ++i) {
+        pool.threads.emplace_back(pool_worker, std::ref(pool), i);
+    }
+}
+
+void pool_submit(Pool &pool, Task task, TaskGroup *group) {
+    if(group) {
+        ++group->left;
+        task = [task = std::move(task), group, &pool]() {
+            task();
+            if(--group->left == 0) {
+                std::lock_guard<std::mutex> guard(pool.lock);
+                pool.finished.notify_all();
+            }
+        };
+    }
+    unsigned to;
+    if(current_pool == &pool) {
+        to = current_worker;
+    } else {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        to = pool.next++ % pool.queues.size();
+    }
+    {
+        std::lock_guard<std::mutex> guard(pool.queues[to].lock);
+        pool.queues[to].tasks.push_back({std::move(task), group});
+    }
+    std::lock_guard<std::mutex> guard(pool.lock);
+    ++pool.queued;
+    pool.changed.notify_one();
+}
+
+void pool_wait(Pool &pool, TaskGroup &group) {
+    Task task;
+    unsigned from = current_pool == &pool ? current_worker : 0;
+    while(group.left > 0) {
+        if(pool_take(pool, from, task, &group)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        //Оставшиеся задачи группы выполняются другими потоками
+        std::unique_lock<std::mutex> guard(pool.lock);
+        pool.finished.wait(guard, [&]() { return group.left == 0; });
+    }
+}
+
+void pool_for(Pool *pool, size_t n, size_t grain,
+        const std::function<void(size_t, size_t)> &body) {
+    grain = std::max<size_t>(grain, 1);
+    if(!pool || n <= grain) {
+        for(size_t from = 0; from < n; from += grain) {
+            body(from, std::min(n, from + grain));
+        }
+        return;
+    }
+    TaskGroup group;
+    for(size_t from = 0; from < n; from += grain) {
+        size_t to = std::min(n, from + grain);
+        pool_submit(*pool, [&body, from, to]() { body(from, to); }, &group);
+    }
+    pool_wait(*pool, group);
+}
+
+void pool_stop(Pool &pool) {
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        pool.stop = true;
+    }
+    pool.changed.notify_all();
+    for(auto &t : pool.threads) {
+        t.join();
+    }
+    pool.threads.clear();
+}
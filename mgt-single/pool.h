@@ -0,0 +1,114 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/**
+ * Пул потоков с перехватом задач (work stealing).
+ * У каждого рабочего потока своя очередь. Задачи, поставленные из рабочего
+ * потока, попадают в его очередь, задачи извне - по очереди во все.
+ * Поток берёт задачи из начала своей очереди, а когда она пуста -
+ * из начала чужой, так что первыми выполняются раньше поставленные задачи.
+ */
+
+/**
+ * Задача пула
+ */
+using Task = std::function<void()>;
+
+struct TaskGroup;
+
+/**
+ * Задача в очереди
+ *   Task run : задача
+ *   TaskGroup *group : группа задачи (nullptr - без группы)
+ */
+struct QueuedTask {
+    Task run;
+    TaskGroup *group;
+};
+
+/**
+ * Очередь задач одного рабочего потока
+ */
+struct TaskQueue {
+    std::mutex lock;
+    std::deque<QueuedTask> tasks;
+};
+
+/**
+ * Пул потоков
+ *   std::vector<std::thread> threads : рабочие потоки
+ *   std::vector<TaskQueue> queues : очереди задач, по одной на поток
+ *   long queued : количество задач во всех очередях
+ *   unsigned next : очередь для следующей задачи, поставленной извне
+ *   bool stop : признак завершения работы пула
+ *   changed : появились задачи или пул останавливается
+ *   finished : завершилась последняя задача какой-то группы
+ */
+struct Pool {
+    std::vector<std::thread> threads;
+    std::vector<TaskQueue> queues;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::condition_variable finished;
+    long queued{};
+    unsigned next{};
+    bool stop{};
+};
+
+/**
+ * Группа задач, завершения которых можно дождаться
+ *   std::atomic<long> left : количество невыполненных задач группы
+ */
+struct TaskGroup {
+    std::atomic<long> left{0};
+};
+
+/**
+ * Запуск рабочих потоков
+ * Параметры:
+ *   Pool &pool : пул
+ *   unsigned n : количество потоков (0 - по числу процессоров)
+ */
+void pool_start(Pool &pool, unsigned n);
+
+/**
+ * Постановка задачи в пул
+ * Параметры:
+ *   Pool &pool : пул
+ *   Task task : задача
+ *   TaskGroup *group : если не nullptr - группа, к которой относится задача
+ */
+void pool_submit(Pool &pool, Task task, TaskGroup *group = nullptr);
+
+/**
+ * Ожидание завершения всех задач группы. Во время ожидания вызывающий
+ * поток сам выполняет задачи этой группы из очередей пула, но не чужие:
+ * иначе он мог бы взять долгую независимую задачу (например, другой файл)
+ * и задержать свою группу. Когда задач группы в очередях нет, поток спит
+ * до завершения группы. Задачи группы ставит в пул ожидающий поток
+ * до вызова pool_wait.
+ */
+void pool_wait(Pool &pool, TaskGroup &group);
+
+/**
+ * Выполнение body(from, to) для отрезков [0, n) длиной не больше grain
+ * на пуле pool (nullptr - в вызывающем потоке) с ожиданием завершения
+ */
+void pool_for(Pool *pool, size_t n, size_t grain,
+        const std::function<void(size_t, size_t)> &body);
+
+/**
+ * Завершение работы пула: ожидание выполнения всех поставленных задач
+ * и остановка рабочих потоков
+ */
+void pool_stop(Pool &pool);
+
+#endif
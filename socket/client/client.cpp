@@ -5,6 +5,15 @@
 #include <unistd.h>
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
 
 enum {
     DEFAULT_PORT = 12347,
@@ -90,21 +99,448 @@ sock_write_timeout(
 #include <string.h>
 #include <netdb.h> //gethostbyname
 
+/**
+ * Подключение к серверу с назначением таймаутов
+ * Параметры:
+ *   const sockaddr_in &serv_addr - адрес сервера
+ *   long read_timeout - таймаут чтения, мс
+ * Возвращаемое значение:
+ *   >=0 - сокет
+ *   <0 - ошибка
+ */
+int
+connect_server(
+    const sockaddr_in &serv_addr,
+    long read_timeout
+) {
+    int client_socket;
+    if((client_socket = ::socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+    if(::connect(client_socket, (const sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        ::close(client_socket);
+        return -1;
+    }
+    sock_read_timeout(client_socket, read_timeout);
+    sock_write_timeout(client_socket, DEFAULT_WRITE_TIMEOUT);
+    return client_socket;
+}
+
+/**
+ * Параметры нагрузочного теста
+ *   int conns - количество одновременных соединений
+ *   double rate - общая целевая частота запросов в секунду,
+ *                 0 - замкнутый цикл (следующий запрос сразу после ответа)
+ *   double duration - длительность теста, с
+ *   long timeout - таймаут ожидания ответа, мс
+ */
+struct LoadParams {
+    int conns = 1;
+    double rate = 0;
+    double duration = 0;
+    long timeout = DEFAULT_READ_TIMEOUT;
+};
+
+/**
+ * Результаты одного соединения нагрузочного теста
+ *   std::vector<double> latencies - задержки успешных запросов, мс
+ *   unsigned long ok - количество успешных ответов
+ *   unsigned long errors - ошибки соединения и ответы с @@ERROR
+ *   unsigned long timeouts - запросы без ответа за время таймаута
+ */
+struct LoadStats {
+    std::vector<double> latencies;
+    unsigned long ok = 0;
+    unsigned long errors = 0;
+    unsigned long timeouts = 0;
+};
+
+/**
+ * Отправка всего буфера в сокет
+ * Возвращаемое значение:
+ *   true - успешно
+ *   false - ошибка
+ */
+bool
+send_all(
+    int sockfd,
+    const std::string &data
+) {
+    size_t sent = 0;
+    while(sent < data.size()) {
+        ssize_t n = ::send(sockfd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+/**
+ * Чтение из сокета одной строки ответа.
+ * Непрочитанный остаток накапливается в buf до следующего вызова.
+ * Возвращаемое значение:
+ *   0 - строка прочитана
+ *   1 - истёк таймаут
+ *   -1 - ошибка или соединение закрыто
+ */
+int
+recv_line(
+    int sockfd,
+    std::string &buf,
+    std::string &line
+) {
+    size_t eol;
+    while((eol = buf.find('\n')) == std::string::npos) {
+        char chunk[4096];
+        ssize_t n = ::recv(sockfd, chunk, sizeof(chunk), 0);
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 1;
+        }
+        if(n <= 0) {
+            return -1;
+        }
+        buf.append(chunk, n);
+    }
+    line.assign(buf, 0, eol);
+    buf.erase(0, eol + 1);
+    return 0;
+}
+
+/**
+ * Чтение запросов из файла. Файл может содержать несколько запросов
+ * подряд (сеанс на одном соединении): запросы выделяются по внешним
+ * фигурным скобкам, скобки внутри имён в кавычках не учитываются.
+ * Каждый запрос дополняется переводом строки: сервер отвечает на него
+ * одной строкой.
+ * Параметры:
+ *   const char *name - имя файла
+ *   std::vector<std::string> &requests - запросы файла добавляются в конец
+ * Возвращаемое значение:
+ *   true - файл прочитан
+ *   false - файл не открыт
+ */
+bool
+read_requests(
+    const char *name,
+    std::vector<std::string> &requests
+) {
+    std::ifstream infile(name);
+    if(!infile.is_open()) {
+        return false;
+    }
+    std::ostringstream text;
+    text <<infile.rdbuf();
+    const std::string &s = text.str();
+    int depth = 0;
+    bool quoted = false;
+    size_t begin = 0;
+    for(size_t i = 0; i < s.size(); ++i) {
+        if(s[i] == '\'') {
+            quoted = !quoted;
+        } else if(quoted) {
+            continue;
+        } else if(s[i] == '{') {
+            if(depth++ == 0) {
+                begin = i;
+            }
+        } else if(s[i] == '}' && depth > 0 && --depth == 0) {
+            requests.push_back(s.substr(begin, i + 1 - begin) + '\n');
+        }
+    }
+    return true;
+}
+
+/**
+ * Одно соединение нагрузочного теста.
+ * При заданной частоте запросы отправляются по расписанию, и задержка
+ * отсчитывается от запланированного, а не фактического момента отправки
+ * (поправка на coordinated omission): если сервер задержал один ответ,
+ * задержка всех запросов, которые из-за этого ушли позже, тоже учитывается.
+ * Параметры:
+ *   const sockaddr_in &serv_addr - адрес сервера
+ *   const std::vector<std::string> &corpus - тексты запросов
+ *   const LoadParams &p - параметры теста
+ *   int index - номер соединения
+ *   std::chrono::steady_clock::time_point start - момент начала теста
+ *   LoadStats &st - результаты соединения
+ */
+void
+load_worker(
+    const sockaddr_in &serv_addr,
+    const std::vector<std::string> &corpus,
+    const LoadParams &p,
+    int index,
+    std::chrono::steady_clock::time_point start,
+    LoadStats &st
+) {
+    using clock = std::chrono::steady_clock;
+    auto deadline = start + std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(p.duration));
+    //Интервал между запросами одного соединения; соединения сдвинуты
+    //друг относительно друга, чтобы не отправлять запросы пачками
+    clock::duration interval{};
+    clock::time_point next = start;
+    if(p.rate > 0) {
+        interval = std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(p.conns / p.rate));
+        next += interval * index / p.conns;
+    }
+    int sockfd = -1;
+    std::string buf;
+    std::string line;
+    size_t k = index;
+    while(true) {
+        clock::time_point intended;
+        if(p.rate > 0) {
+            intended = next;
+            next += interval;
+            if(intended >= deadline) {
+                break;
+            }
+            std::this_thread::sleep_until(intended);
+        } else {
+            intended = clock::now();
+            if(intended >= deadline) {
+                break;
+            }
+        }
+        if(sockfd < 0) {
+            if((sockfd = connect_server(serv_addr, p.timeout)) < 0) {
+                ++st.errors;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            buf.clear();
+        }
+        int status = -1;
+        if(send_all(sockfd, corpus[k++ % corpus.size()])) {
+            status = recv_line(sockfd, buf, line);
+        }
+        if(status == 0 && line.find("@@ERROR") == std::string::npos) {
+            ++st.ok;
+            st.latencies.push_back(
+                    std::chrono::duration<double, std::milli>(clock::now() - intended).count());
+            continue;
+        }
+        if(status == 1) {
+            ++st.timeouts;
+        } else {
+            ++st.errors;
+        }
+        //После ошибки или таймаута ответы в соединении уже не сопоставить
+        //с запросами, поэтому оно открывается заново
+        if(status != 0) {
+            ::close(sockfd);
+            sockfd = -1;
+        }
+    }
+    if(sockfd >= 0) {
+        ::close(sockfd);
+    }
+}
+
+//Значение перцентиля q (0..1) по упорядоченной выборке
+double percentile(const std::vector<double> &sorted, double q) {
+    if(sorted.empty()) {
+        return 0;
+    }
+    size_t i = size_t(q * sorted.size());
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+/**
+ * Нагрузочный тест: p.conns соединений отправляют запросы из corpus
+ * по кругу в течение p.duration секунд. Итог выводится одной строкой JSON.
+ * Возвращаемое значение:
+ *   EXIT_SUCCESS - был хотя бы один успешный ответ
+ *   EXIT_FAILURE - иначе
+ */
+int
+load_test(
+    const sockaddr_in &serv_addr,
+    const std::vector<std::string> &corpus,
+    const LoadParams &p
+) {
+    std::vector<LoadStats> stats(p.conns);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < p.conns; ++i) {
+        workers.emplace_back(load_worker, std::cref(serv_addr), std::cref(corpus),
+                std::cref(p), i, start, std::ref(stats[i]));
+    }
+    for(auto &w : workers) {
+        w.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LoadStats total;
+    for(auto &st : stats) {
+        total.latencies.insert(total.latencies.end(), st.latencies.begin(), st.latencies.end());
+        total.ok += st.ok;
+        total.errors += st.errors;
+        total.timeouts += st.timeouts;
+    }
+    std::sort(total.latencies.begin(), total.latencies.end());
+    double mean = 0;
+    for(double l : total.latencies) {
+        mean += l;
+    }
+    if(!total.latencies.empty()) {
+        mean /= total.latencies.size();
+    }
+
+    std::cout << "{\"mode\":\"" << (p.rate > 0 ? "open" : "closed") << "\""
+              << ",\"connections\":" << p.conns
+              << ",\"rate\":" << p.rate
+              << ",\"duration_s\":" << elapsed
+              << ",\"requests\":" << total.ok + total.errors + total.timeouts
+              << ",\"ok\":" << total.ok
+              << ",\"errors\":" << total.errors
+              << ",\"timeouts\":" << total.timeouts
+              << ",\"throughput_rps\":" << total.ok / elapsed
+              << ",\"co_corrected\":" << (p.rate > 0 ? "true" : "false")
+              << ",\"latency_ms\":{"
+              << "\"mean\":" << mean
+              << ",\"p50\":" << percentile(total.latencies, 0.50)
+              << ",\"p90\":" << percentile(total.latencies, 0.90)
+              << ",\"p99\":" << percentile(total.latencies, 0.99)
+              << ",\"p999\":" << percentile(total.latencies, 0.999)
+              << ",\"max\":" << (total.latencies.empty() ? 0 : total.latencies.back())
+              << "}}" << std::endl;
+    return total.ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Конвейерная отправка запросов в одно соединение.
+ * Отдельный поток пишет запросы файлов в сокет один за другим, не дожидаясь
+ * ответов, а текущий поток читает ответы. Сервер отвечает строго по порядку,
+ * поэтому i-я строка ответа относится к i-му отправленному запросу.
+ * Параметры:
+ *   int sockfd - сокет соединения с сервером
+ *   char *files[] - имена файлов с запросами
+ *   int count - количество файлов
+ *   int window - максимальное количество запросов без ответа
+ * Возвращаемое значение:
+ *   EXIT_SUCCESS - получены ответы на все отправленные запросы
+ *   EXIT_FAILURE - ошибка отправки или приёма
+ */
+int
+pipeline(
+    int sockfd,
+    char *files[],
+    int count,
+    int window
+) {
+    std::mutex lock;
+    std::condition_variable changed;
+    int sent = 0; //Отправлено запросов
+    int received = 0; //Получено ответов
+    bool writer_done = false;
+    bool failed = false;
+
+    std::thread writer([&]() {
+        std::vector<std::string> requests;
+        for(int i = 0; i < count; i++) {
+            if(!read_requests(files[i], requests)) {
+                //Если открыть не получилось, идём дальше по списку
+                perror("open");
+            }
+        }
+        for(auto &text : requests) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&]() { return sent - received < window || failed; });
+                if(failed) {
+                    break;
+                }
+            }
+            if(!send_all(sockfd, text)) {
+                perror("Send error");
+                std::lock_guard<std::mutex> guard(lock);
+                failed = true;
+                break;
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            ++sent;
+            changed.notify_all();
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        writer_done = true;
+        changed.notify_all();
+    });
+
+    std::string buf;
+    std::string line;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return received < sent || writer_done || failed; });
+            if(failed || (writer_done && received == sent)) {
+                break;
+            }
+        }
+        //Считываем ответ - одну строку
+        if(recv_line(sockfd, buf, line) != 0) {
+            perror("Receive error");
+            std::lock_guard<std::mutex> guard(lock);
+            failed = true;
+            changed.notify_all();
+            break;
+        }
+        //Печатаем ответ
+        std::cout <<line <<std::endl;
+        std::lock_guard<std::mutex> guard(lock);
+        ++received;
+        changed.notify_all();
+    }
+    writer.join();
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 /**
  * Параметры
- *   argv[1] - имя хоста сервера в виде host:port
+ *   -c conns - нагрузочный тест: количество одновременных соединений
+ *   -r rate - нагрузочный тест: общая частота запросов в секунду
+ *             (по умолчанию - замкнутый цикл без пауз)
+ *   -d seconds - длительность нагрузочного теста; включает нагрузочный режим
+ *   -t msec - таймаут ожидания ответа
+ *   -p window - конвейерный режим: отправлять файлы подряд,
+ *             не дожидаясь ответов, но не более window запросов без ответа
+ *   host[:port] - имя хоста сервера
  *             port по умолчанию = 12347
  *             Имя сервера задавать обязательно.
- *   argv[2....n] - имена текстовых файлов, содержащих запросы
- *             Необходимо указать хотябы 1 файл
+ *   file1 [file2 [...]] - имена текстовых файлов, содержащих запросы
+ *             Необходимо указать хотябы 1 файл. Файл может содержать
+ *             несколько запросов подряд (см. read_requests): на каждый
+ *             выводится своя строка ответа.
+ *             В нагрузочном режиме - набор запросов, отправляемых по кругу
  */
 int main(int argc, char *argv[]) {
+    LoadParams load;
+    int window = 0;
+    int opt;
+    while((opt = ::getopt(argc, argv, "c:r:d:t:p:")) != -1) {
+        switch(opt) {
+            case 'c': load.conns = std::max(1, ::atoi(optarg)); break;
+            case 'r': load.rate = ::atof(optarg); break;
+            case 'd': load.duration = ::atof(optarg); break;
+            case 't': load.timeout = ::atol(optarg); break;
+            case 'p': window = std::max(1, ::atoi(optarg)); break;
+            default: optind = argc; break;
+        }
+    }
 
-    if(argc < 3) {
-        std::cout << "Usage: mgt-client host[:port] file1 [file2 [...]]"
+    if(argc - optind < 2) {
+        std::cout << "Usage: mgt-client [-c conns] [-r rate] [-d seconds] [-t msec] [-p window]"
+                     " host[:port] file1 [file2 [...]]"
                   << std::endl;
         return EXIT_FAILURE;
     }
+    //Дальше аргументы разбираются так же, как без ключей
+    argv += optind - 1;
+    argc -= optind - 1;
 
     in_port_t port = DEFAULT_PORT;
     {
@@ -142,6 +578,20 @@ int main(int argc, char *argv[]) {
         perror("Invalid address");
         return EXIT_FAILURE;
     }
+
+    if(load.duration > 0) {
+        //Загрузить набор запросов всех файлов
+        std::vector<std::string> corpus;
+        for(int i = 2; i < argc; i++) {
+            if(!read_requests(argv[i], corpus)) {
+                perror("open");
+            }
+        }
+        if(corpus.empty()) {
+            return EXIT_FAILURE;
+        }
+        return load_test(serv_addr, corpus, load);
+    }
    
     //Создать сокет
     int client_socket;
@@ -160,6 +610,12 @@ int main(int argc, char *argv[]) {
     sock_read_timeout(client_socket, DEFAULT_READ_TIMEOUT);
     sock_write_timeout(client_socket, DEFAULT_WRITE_TIMEOUT);
 
+    if(window > 0) {
+        int status = pipeline(client_socket, &argv[2], argc - 2, window);
+        ::close(client_socket);
+        return status;
+    }
+
     //Создать поток для чтения данных из сокета
     __gnu_cxx::stdio_filebuf<char> inbuf(client_socket, std::ios::in);
     std::istream in(&inbuf);
@@ -174,24 +630,27 @@ int main(int argc, char *argv[]) {
         //std::flush(std::cout);
 
         //Попробовать открыьт файл
-        std::ifstream infile(argv[i]);
-        if(!infile.is_open()) {
+        std::vector<std::string> requests;
+        if(!read_requests(argv[i], requests)) {
             //Если открыть не получилось, идём дальше по списку
             perror("open");
             continue;
         }
-        //Есть файл, отправляем его весь по строкам
-        std::string buf;
-        while(std::getline(infile, buf)) {
-            if(!(out <<buf <<std::endl)) {
+        //Есть файл, отправляем запросы по одному, дожидаясь ответа на каждый
+        for(auto &request : requests) {
+            if(!(out <<request <<std::flush)) {
                 perror("Send error");
                 return EXIT_FAILURE;
             }
+            //Считываем ответ - одну строку
+            std::string buf;
+            if(!std::getline(in, buf)) {
+                perror("Receive error");
+                return EXIT_FAILURE;
+            }
+            //Печатаем ответ
+            std::cout <<buf <<std::endl;
         }
-        //Считываем ответ - одну строку
-        std::getline(in, buf);
-        //Печатаем ответ
-        std::cout <<buf <<std::endl;
     }
 
     //Закрыть клиентский сокет
@@ -0,0 +1,65 @@
+#include <atomic>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+
+#include "mgt.h"
+
+/**
+ * Подсчёт обращений к куче: глобальные operator new заменены обёртками
+ * над malloc со счётчиком. Остальные формы operator new стандартной
+ * библиотеки вызывают эти две. Счётчик читает проверка --alloc-check
+ * сервера: запрос после разогрева не должен обращаться к куче.
+ */
+static std::atomic<size_t> allocations;
+
+size_t alloc_count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+static void *alloc(size_t size, size_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if(size == 0) {
+        size = 1;
+    }
+    for(;;) {
+        void *p = nullptr;
+        if(align <= alignof(std::max_align_t)) {
+            p = std::malloc(size);
+        } else if(::posix_memalign(&p, align, size) != 0) {
+            p = nullptr;
+        }
+        if(p) {
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if(!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void *operator new(size_t size) {
+    return alloc(size, alignof(std::max_align_t));
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+    return alloc(size, size_t(align));
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
@@ -2,10 +2,15 @@
 #include <limits>
 #include <map>
 #include <set>
-#include <list>
+#include <vector>
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <iterator>
+#include <sstream>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
 
 #include "mgt.h"
 
@@ -17,109 +22,191 @@ void print_cont(Container c) {
     }
 }
 
-//Поиск точек сочленения, точек, лежащих в одной компоненте связности, суммы по одной компоненте связности.
-value_t dfs (
-        Graph &g,
-        std::set<std::string> &used,
-        Values& v,
-        std::set<std::string> &cutpoints,
-        std::string node,
-        int comp_id,
-        std::string parent = {}
-        ) {
-    v[node].comp_id = comp_id;
-    static std::map<std::string, int> tin;
-    static std::map<std::string, int> fup;
-    static int timer;
-    value_t value = 0;
-    used.insert(node);
-    tin[node] = fup[node] = timer++;
-    int children = 0;
-    for (auto to = g[node].begin(); to != g[node].end(); ++to) {
-        if (*to == parent) {
-            continue;
-        }
-        if (used.find(*to) != used.end()) {
-            fup[node] = std::min(fup[node], tin[*to]);
-        }
-        else {
-            value += dfs(g, used, v, cutpoints, *to, comp_id, node);
-            fup[node] = std::min(fup[node], fup[*to]);
-            if (fup[*to] >= tin[node] && !parent.empty()) {
-                cutpoints.insert(node);
-                v[node].is_cutp = true;
-            }
-            ++children;
-        }
+Values::Values(const allocator_type &a)
+    : index(a), names(a), value(a), comp_id(a), flags(a), tin(a), low(a), sub(a), up(a),
+      cut(a) {}
+
+//Имена узлов - ключи index: после копирования или переноса index они указывают на старые ключи
+static void values_relink(Values &v) {
+    for(auto &[name, id] : v.index) {
+        v.names[id] = &name;
     }
-    if (parent.empty() && children > 1) {
-        cutpoints.insert(node);
-        v[node].is_cutp = true;
+}
+
+Values::Values(const Values &v, const allocator_type &a)
+    : index(v.index, a), names(v.names, a), value(v.value, a), comp_id(v.comp_id, a),
+      flags(v.flags, a), tin(v.tin, a), low(v.low, a), sub(v.sub, a), up(v.up, a),
+      cut(v.cut, a) {
+    values_relink(*this);
+}
+
+Values &Values::operator=(const Values &v) {
+    return *this = Values(v, get_allocator());
+}
+
+Values &Values::operator=(Values &&v) {
+    index = std::move(v.index);
+    names = std::move(v.names);
+    value = std::move(v.value);
+    comp_id = std::move(v.comp_id);
+    flags = std::move(v.flags);
+    tin = std::move(v.tin);
+    low = std::move(v.low);
+    sub = std::move(v.sub);
+    up = std::move(v.up);
+    cut = std::move(v.cut);
+    //При разных аллокаторах ключи index переносятся поэлементно
+    values_relink(*this);
+    return *this;
+}
+
+int node_add(Values &v, const Name &name, value_t value) {
+    auto [it, added] = v.index.insert({name, (int)v.names.size()});
+    if(!added) {
+        return it->second;
     }
-    return v[node].value + value;
+    v.names.push_back(&it->first);
+    v.value.push_back(value);
+    v.comp_id.push_back(-1);
+    v.flags.push_back(0);
+    v.tin.push_back(-1);
+    v.low.push_back(0);
+    v.sub.push_back(0);
+    v.up.push_back(-1);
+    v.cut.push_back(0);
+    return it->second;
 }
 
 //Разделение исходного графа на компоненты связности
 void make_components(Graph &g, Values &v, Components &comps) {
+    //Узлы без связей, но с весом, - отдельные компоненты
+    for(size_t id = 0; id < v.size(); ++id) {
+        g[*v.names[id]];
+    }
+    //Рабочие массивы - из памяти запроса: в установившемся режиме блоки
+    //прежних запросов соединения переиспользуются без обращения к куче
+    std::pmr::vector<int> stack(comps.get_allocator());
     for(auto &[name, links] : g) {
-        if(v[name].comp_id == -1) {
-            Component c;
-            int comp_id = 0;
-            c.value = dfs(g, c.names, v, c.cutpoints, name, comp_id);
-            ++comp_id;
-            comps.push_back(c);
-        }
-    }
-}
-
-//Объединение смежных вершин, не являющихся точками сочленения, в одну.
-void reduce_comp(Graph &g, Values &v, Component &c, std::string predator) {
-    value_t value = 0;
-    
-    std::list<std::string> to_check(g[predator].begin(), g[predator].end());
-
-    for(auto it = to_check.begin(); it != to_check.end();) {
-        auto victim = *it;
-        auto next = std::next(it);
-        if(!v[victim].is_cutp && !v[victim].is_reduced) {
-            value += v[victim].value;
-            for(auto future_victim : g[victim]) {
-                if(future_victim != predator) {
-                    g[predator].insert(future_victim);
-                    to_check.push_back(future_victim);
-                    g[future_victim].erase(victim);
-                    g[future_victim].insert(predator);
+        int root = node_add(v, name);
+        if(v.comp_id[root] != -1) {
+            continue;
+        }
+        Component c(comps.get_allocator());
+        int comp_id = comps.size();
+        v.comp_id[root] = comp_id;
+        stack.push_back(root);
+        while(!stack.empty()) {
+            int cur = stack.back();
+            stack.pop_back();
+            c.nodes.push_back(cur);
+            c.value += v.value[cur];
+            for(auto &to : g.find(*v.names[cur])->second) {
+                int next = node_add(v, to);
+                if(v.comp_id[next] == -1) {
+                    v.comp_id[next] = comp_id;
+                    stack.push_back(next);
                 }
             }
-            g[predator].erase(victim);
-            g.erase(victim);
-            v[victim].is_reduced = true;
         }
-        it = next;
+        comps.push_back(std::move(c));
     }
-    v[predator].sum = v[predator].value + value;
 }
 
-//Объединение всех групп смежных точек, не являющихся точками сочленения в одну (на каждую группу)
-void reduce(Graph &g, Values &v, Component &c) {
-    for(auto name : c.names) {
-        if(!v[name].is_cutp && !v[name].is_reduced) {
-            reduce_comp(g, v, c, name);
-        }
-    }
+/**
+ * Кадр обхода в глубину
+ *   int node : узел
+ *   int parent : родитель в дереве обхода (-1 - корень)
+ *   link, end : следующая непросмотренная связь и конец списка связей
+ *   value_t cut : суммарный вес поддеревьев, отделяемых узлом
+ *   Acc squares : сумма квадратов весов этих поддеревьев
+ *   int children : количество потомков в дереве обхода
+ *   int separated : количество поддеревьев, отделяемых узлом
+ */
+template<typename Acc>
+struct Frame {
+    int node;
+    int parent;
+    std::pmr::set<Name>::const_iterator link;
+    std::pmr::set<Name>::const_iterator end;
+    value_t cut{};
+    Acc squares{};
+    int children{};
+    int separated{};
+};
+
+//Квадрат веса в разрядности Acc
+template<typename Acc>
+static Acc square(value_t x) {
+    return Acc(x) * x;
+}
+
+//Сумма квадратов весов частей компоненты веса w_comp без узла id плюс вес узла
+template<typename Acc>
+static Acc node_local(const Values &v, const Squares<Acc> &sq, int id, value_t w_comp) {
+    //Остаток компоненты - часть, в которой лежит родитель
+    value_t rest = w_comp - v.value[id] - v.cut[id];
+    return sq.squares[id] + square<Acc>(rest) + v.value[id];
 }
 
-//Подсчет эффективности подсети
-value_t count_graph(Graph &g, Values &v, Component &c, std::set<std::string> &used,
-        std::string name) {
-    value_t counter = 0;
-    used.insert(name);
-    for(auto link : g[name]) {
-        if(used.find(link) == used.end()) {
-            counter += count_graph(g, v, c, used, link);
+//Поиск точек сочленения компоненты и частей, на которые она распадается при удалении узла
+template<typename Acc>
+static void analyze_comp(Graph &g, Values &v, Component &c, Squares<Acc> &sq) {
+    //Обход без рекурсии: глубина дерева обхода может достигать размера компоненты.
+    //Только find(): контейнеры общие для параллельно обрабатываемых компонент
+    int timer = 0;
+    std::pmr::vector<Frame<Acc>> stack(c.nodes.get_allocator());
+    auto enter = [&](int id, int parent) {
+        v.tin[id] = v.low[id] = timer++;
+        v.sub[id] = v.value[id];
+        auto &links = g.find(*v.names[id])->second;
+        stack.push_back({id, parent, links.cbegin(), links.cend()});
+    };
+    enter(c.nodes[0], -1);
+    while(!stack.empty()) {
+        Frame<Acc> &f = stack.back();
+        if(f.link != f.end) {
+            int to = v.index.find(*f.link++)->second;
+            if(to == f.node || to == f.parent) {
+                continue;
+            }
+            if(v.tin[to] != -1) {
+                v.low[f.node] = std::min(v.low[f.node], v.tin[to]);
+            } else {
+                ++f.children;
+                enter(to, f.node);
+            }
+            continue;
+        }
+
+        //Все связи узла просмотрены
+        int id = f.node;
+        v.cut[id] = f.cut;
+        sq.squares[id] = f.squares;
+        sq.local[id] = node_local(v, sq, id, c.value);
+        unsigned char flags = (f.parent != -1 ? f.separated > 0 : f.children > 1) ? NODE_CUTP : 0;
+        if(flags & NODE_CUTP) {
+            c.cutpoints.push_back(id);
         }
+        stack.pop_back();
+        if(!stack.empty()) {
+            Frame<Acc> &p = stack.back();
+            v.sub[p.node] += v.sub[id];
+            v.low[p.node] = std::min(v.low[p.node], v.low[id]);
+            v.up[id] = p.node;
+            //Поддерево узла не связано с предками родителя в обход родителя
+            if(v.low[id] >= v.tin[p.node]) {
+                flags |= NODE_SEP;
+                ++p.separated;
+                p.cut += v.sub[id];
+                p.squares += square<Acc>(v.sub[id]);
+            }
+            //Связь с родителем - мост: из поддерева нет связей выше самого узла
+            if(v.low[id] > v.tin[p.node]) {
+                c.bridges.push_back({p.node, id});
+            }
+        }
+        v.flags[id] = flags;
     }
-    return counter + v[name].sum;
 }
 
 //Отладочная печать графа и вершин
@@ -133,18 +220,18 @@ void print_gnv(Graph &g, Values &v) {
         std::cout << std::endl;
     }
     std::cout << "Nodes:" << std::endl;
-    for(auto &[name, node] : v) {
-        std::cout << name << " - " << node.value << std::endl;
+    for(size_t id = 0; id < v.size(); ++id) {
+        std::cout << *v.names[id] << " - " << v.value[id] << std::endl;
     }
 }
 
 //Отладочная печать компонент связности
-void print_comps(Components &comps) {
+void print_comps(Components &comps, Values &v) {
     int i = 0;
-    for(auto comp : comps) {
+    for(auto &comp : comps) {
         std::cout << "comp " << i << ", value " << comp.value << ": ";
-        for(auto name : comp.names) {
-            std::cout << name << " ";
+        for(auto id : comp.nodes) {
+            std::cout << *v.names[id] << " ";
         }
         std::cout << std::endl;
         ++i;
@@ -154,109 +241,705 @@ void print_comps(Components &comps) {
 //Отладочная печать всех точек сочленения
 void print_cutps(Values &v) {
     std::cout << "cutpoints: ";
-    for(auto &[name, node] : v) {
-        if(node.is_cutp) {
-            std::cout << name << " ";
+    for(size_t id = 0; id < v.size(); ++id) {
+        if(v.flags[id] & NODE_CUTP) {
+            std::cout << *v.names[id] << " ";
         }
     }
     std::cout << std::endl;
 
 }
 
+//Вывод 128-битного числа десятичными цифрами (в стандартной библиотеке его нет)
+static std::ostream &operator<<(std::ostream &out, wide_t x) {
+    char digits[40];
+    char *p = digits + sizeof(digits);
+    *--p = 0;
+    do {
+        *--p = '0' + int(x % 10);
+        x /= 10;
+    } while(x);
+    return out << p;
+}
+
+/**
+ * Оценка узла
+ *   Acc vitality : оценка
+ *   const Name *name : имя узла
+ */
+template<typename Acc>
+struct Score {
+    Acc vitality;
+    const Name *name;
+};
+
+//Порядок оценок: по возрастанию, при равенстве - по имени узла
+template<typename Acc>
+static bool operator<(const Score<Acc> &a, const Score<Acc> &b) {
+    return a.vitality != b.vitality ? a.vitality < b.vitality : *a.name < *b.name;
+}
+
+/**
+ * Лучшие результаты по пачке компонент
+ *   Acc vitality : минимальная оценка
+ *   std::pmr::vector<const Name *> names : узлы с этой оценкой
+ *   std::pmr::vector<Score<Acc>> ranked : оценки для вывода с параметрами top/all
+ *                                         (для top - куча из не более чем top лучших)
+ */
+template<typename Acc>
+struct Best {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    explicit Best(const allocator_type &a = {}) : names(a), ranked(a) {}
+    Acc vitality = std::numeric_limits<Acc>::max();
+    std::pmr::vector<const Name *> names;
+    std::pmr::vector<Score<Acc>> ranked;
+};
+
+//Учесть оценку узла в лучших результатах
+template<typename Acc>
+static void keep_best(Best<Acc> &b, const Options &opts, Score<Acc> s) {
+    if(opts.all) {
+        b.ranked.push_back(s);
+    } else if(opts.top) {
+        //Куча с наихудшей из отобранных оценок в вершине
+        if(b.ranked.size() < opts.top) {
+            b.ranked.push_back(s);
+            std::push_heap(b.ranked.begin(), b.ranked.end());
+        } else if(s < b.ranked.front()) {
+            std::pop_heap(b.ranked.begin(), b.ranked.end());
+            b.ranked.back() = s;
+            std::push_heap(b.ranked.begin(), b.ranked.end());
+        }
+    } else {
+        if(s.vitality < b.vitality) {
+            b.vitality = s.vitality;
+            b.names.clear();
+        }
+        if(s.vitality == b.vitality) {
+            b.names.push_back(s.name);
+        }
+    }
+}
+
+/**
+ * Вывод элементов результата: узлы с наименьшей оценкой 'A', 'C' или,
+ * с параметрами top/all, узлы с оценками по возрастанию ('A', 12), ('C', 14)
+ */
+template<typename Acc>
+static void print_best(std::ostream &out, std::pmr::vector<Best<Acc>> &best, const Options &opts) {
+    if(opts.all || opts.top) {
+        std::pmr::vector<Score<Acc>> ranked(best.get_allocator());
+        for(auto &b : best) {
+            ranked.insert(ranked.end(), b.ranked.begin(), b.ranked.end());
+        }
+        size_t count = opts.all ? ranked.size() : std::min(opts.top, ranked.size());
+        std::nth_element(ranked.begin(), ranked.begin() + count, ranked.end());
+        std::sort(ranked.begin(), ranked.begin() + count);
+        for(size_t i = 0; i < count; ++i) {
+            out << (i ? ", " : "") << "(\'" << *ranked[i].name << "\', " << ranked[i].vitality << ")";
+        }
+        return;
+    }
+
+    Best<Acc> result(best.get_allocator());
+    for(auto &b : best) {
+        if(b.vitality < result.vitality) {
+            result.vitality = b.vitality;
+            result.names.clear();
+        }
+        if(b.vitality == result.vitality) {
+            result.names.insert(result.names.end(), b.names.begin(), b.names.end());
+        }
+    }
+    std::sort(result.names.begin(), result.names.end(),
+            [](const Name *a, const Name *b) { return *a < *b; });
+
+    bool is_only_answer = true;
+    for(auto name : result.names) {
+        if(is_only_answer) {
+            out << "\'" << *name << "\'";
+            is_only_answer = false;
+        } else {
+            out << ", \'" << *name << "\'";
+        }
+    }
+}
+
 /**
- * Выполнить разбор данных и формирование графа
+ * Оценка связи - моста
+ *   Acc vitality : сумма квадратов весов компонент после удаления связи
+ *   const Name *a, *b : концы связи, a < b
+ */
+template<typename Acc>
+struct BridgeScore {
+    Acc vitality;
+    const Name *a;
+    const Name *b;
+};
+
+//Порядок оценок мостов: по возрастанию, при равенстве - по именам концов
+template<typename Acc>
+static bool operator<(const BridgeScore<Acc> &x, const BridgeScore<Acc> &y) {
+    if(x.vitality != y.vitality) {
+        return x.vitality < y.vitality;
+    }
+    return *x.a != *y.a ? *x.a < *y.a : *x.b < *y.b;
+}
+
+//Оценка мостов и вывод лучших, как print_best(): без скобок списка
+template<typename Acc>
+static void print_bridges(std::ostream &out, Components &comps, Values &values, Acc total,
+        const Options &opts) {
+    //Мост делит компоненту на поддерево веса sub и остаток
+    std::pmr::vector<BridgeScore<Acc>> ranked(comps.get_allocator());
+    for(auto &c : comps) {
+        Acc others = total - square<Acc>(c.value);
+        for(auto &b : c.bridges) {
+            value_t sub = values.sub[b.to];
+            value_t rest = c.value - sub;
+            BridgeScore<Acc> s{others + square<Acc>(sub) + square<Acc>(rest),
+                    values.names[b.from], values.names[b.to]};
+            if(*s.b < *s.a) {
+                std::swap(s.a, s.b);
+            }
+            ranked.push_back(s);
+        }
+    }
+
+    size_t count = ranked.size();
+    bool scores = opts.all || opts.top;
+    if(!scores && !ranked.empty()) {
+        Acc best = std::min_element(ranked.begin(), ranked.end())->vitality;
+        count = std::partition(ranked.begin(), ranked.end(),
+                [&](const BridgeScore<Acc> &s) { return s.vitality == best; }) - ranked.begin();
+    } else if(!opts.all) {
+        count = std::min(opts.top, count);
+    }
+    std::nth_element(ranked.begin(), ranked.begin() + count, ranked.end());
+    std::sort(ranked.begin(), ranked.begin() + count);
+    for(size_t i = 0; i < count; ++i) {
+        out << (i ? ", " : "") << "(\'" << *ranked[i].a << "\', \'" << *ranked[i].b << "\'";
+        if(scores) {
+            out << ", " << ranked[i].vitality;
+        }
+        out << ")";
+    }
+}
+
+/**
+ * Оценка всех узлов и вывод результата
  * Параметры:
- *   Graph &graph - граф связей
- *   Values &values - массив значений в узлах
- *   std::istream &in - входной поток
- *   std::ostream &out - выходной поток
- * Возвращаемое значение:
- *   0 - нет ошибок
- *   не 0 - ошибка
+ *   const Squares<Acc> &sq : суммы квадратов весов по узлам и всех компонент
  */
-int
-parse(
-    Graph &graph,
-    Values &values,
-    std::istream &in,
-    std::ostream &out
-) {
-    //...
-    //std::cout <<"Parsing ..." <<std::endl;
-    int ret = ser_in(in, graph, values, out);
-    //std::cout <<"Parsing done" <<std::endl;
-    return ret;
-}
-
-int process(std::istream &in, std::ostream &out) {
-    Graph graph;
-    Values values;
-    std::map<std::string, value_t> variants;
-    auto min_vitality = std::numeric_limits<value_t>::max();
+template<typename Acc>
+static void print_scores(std::ostream &out, Components &comps, Values &values,
+        const Squares<Acc> &sq, const Options &opts) {
+    if(opts.edges) {
+        print_bridges(out, comps, values, sq.total, opts);
+        out << "]" << std::endl;
+        return;
+    }
+
+    //Оценка узла v из компоненты C:
+    //сумма квадратов весов остальных компонент + Values::local
+    std::pmr::vector<Acc> others(comps.size(), comps.get_allocator());
+    for(size_t i = 0; i < comps.size(); ++i) {
+        others[i] = sq.total - square<Acc>(comps[i].value);
+    }
+    //Узлы обходятся подряд по номерам: читаются только comp_id и local
+    size_t n = values.size();
+    std::pmr::vector<Acc> score(n, comps.get_allocator());
+    std::pmr::vector<Best<Acc>> best(1, comps.get_allocator());
+    Best<Acc> &b = best[0];
+    for(size_t i = 0; i < n; ++i) {
+        score[i] = others[values.comp_id[i]] + sq.local[i];
+    }
+    if(opts.all || opts.top) {
+        for(size_t i = 0; i < n; ++i) {
+            keep_best(b, opts, {score[i], values.names[i]});
+        }
+    } else if(n) {
+        b.vitality = *std::min_element(score.begin(), score.end());
+        for(size_t i = 0; i < n; ++i) {
+            if(score[i] == b.vitality) {
+                b.names.push_back(values.names[i]);
+            }
+        }
+    }
+    print_best(out, best, opts);
+    out << "]" << std::endl;
+}
+
+void *ArenaHeap::do_allocate(size_t bytes, size_t align) {
+    taken += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+}
+
+void ArenaHeap::do_deallocate(void *p, size_t bytes, size_t align) {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+}
+
+bool ArenaHeap::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
+
+Arena::Arena(size_t size) : buffer(new char[size]), size(size) {
+    mem.emplace(buffer.get(), size, &heap);
+}
+
+std::pmr::memory_resource *arena_resource(Arena &a) {
+    return &*a.mem;
+}
+
+void arena_reset(Arena &a) {
+    a.mem->release();
+    if(a.heap.taken == 0) {
+        return;
+    }
+    //Запрос не уместился: следующий такой же обойдётся одним буфером
+    a.size += a.heap.taken;
+    a.heap.taken = 0;
+    a.mem.reset();
+    a.buffer.reset(new char[a.size]);
+    a.mem.emplace(a.buffer.get(), a.size, &a.heap);
+}
+
+//Вывод потока в строку, память которой сохраняется между запросами
+class StringSink : public std::streambuf {
+public:
+    explicit StringSink(std::pmr::string &text) : text(text) {}
+protected:
+    int_type overflow(int_type c) override {
+        if(!traits_type::eq_int_type(c, traits_type::eof())) {
+            text.push_back(traits_type::to_char_type(c));
+        }
+        return traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        text.append(s, n);
+        return n;
+    }
+private:
+    std::pmr::string &text;
+};
+
+int process(std::istream &in, std::ostream &out, Model &m, ResultCache *cache) {
+    //Данные запроса - в памяти модели: граф нового запроса переходит
+    //в модель без копирования, прежний возвращается в память соединения
+    std::pmr::memory_resource *mem = m.graph.get_allocator().resource();
+    Graph graph(mem);
+    Values values(mem);
+    Weights weights(mem);
+    Options opts;
+    Request kind = REQUEST_GRAPH;
 
     out <<"[";
-    if(parse(graph, values, in, out) != 0) {
+    if(ser_in_request(in, graph, values, weights, out, &opts, kind) != 0) {
         out << "]" <<std::endl;
         return -1;
     }
 
-    Components comps;
-    make_components(graph, values, comps);
-        
-    for(auto c : comps) {
-        reduce(graph, values, c);
-    }
-
-    for(auto &[name, links] : graph) {
-        if(values[name].is_cutp) {
-            values[name].sum = values[name].value;
-        }
-    }
-        
-    for(auto &[name, node] : values) {
-        value_t vitality = 0;
-        int comp_id = 0;
-        for(auto comp : comps) {
-            if(comp_id == node.comp_id) {
-                value_t result;
-                if(!node.is_cutp) {
-                    result = comp.value - node.value;
-                    vitality += result * result;
-                } else {
-                    std::set<std::string> used;
-                    used.insert(name);
-                    result = 0;
-                    for(auto link : graph[name]) {
-                        if(used.find(link) == used.end()) {
-                            result = count_graph(graph, values, comp, used, link);
-                            vitality += result * result;
-                        }
-                    }
+    if(kind == REQUEST_STATS) {
+        if(cache) {
+            cache_print(*cache, out);
+        } else {
+            cache_print(ResultCache(0), out);
+        }
+        out << "]" <<std::endl;
+        return 0;
+    }
+    if(kind != REQUEST_GRAPH && m.stale) {
+        //Граф предыдущего запроса принят без анализа: ответ был из кэша
+        model_analyze(m);
+        m.stale = false;
+    }
+
+    if(kind == REQUEST_WEIGHTS) {
+        //Только новые веса: граф и точки сочленения - из предыдущего запроса
+        if(update_weights(m, weights) != 0) {
+            out << "'@@ERROR':'weight update for unknown node'" << "]" <<std::endl;
+            return 0;
+        }
+    } else if(kind == REQUEST_REMOVE) {
+        //Сначала проверка всех связей, чтобы ошибка не меняла граф
+        for(auto &[a, links] : graph) {
+            auto it = m.graph.find(a);
+            for(auto &b : links) {
+                if(it == m.graph.end() || !it->second.count(b)) {
+                    out << "'@@ERROR':'removal of unknown link'" << "]" <<std::endl;
+                    return 0;
                 }
-            } else {
-                vitality += comp.value * comp.value;
             }
-            ++comp_id;
         }
-        vitality += values[name].value;
-        variants[name] = vitality;
-        if(vitality < min_vitality) {
-            min_vitality = vitality;
+        for(auto &[a, links] : graph) {
+            for(auto &b : links) {
+                if(a <= b) {
+                    remove_edge(m, a, b);
+                }
+            }
         }
+    } else if(kind == REQUEST_ADD) {
+        for(auto &[a, links] : graph) {
+            for(auto &b : links) {
+                if(a <= b) {
+                    add_edge(m, a, b);
+                }
+            }
+        }
+    } else {
+        m.graph = std::move(graph);
+        m.values = std::move(values);
+        m.comps.clear();
+        m.stale = false;
+        if(cache) {
+            //Тот же граф с теми же весами и параметрами уже считался
+            hash_t key = graph_hash(m.graph, m.values, opts);
+            if(cache_get(*cache, key, out)) {
+                //Ответ отправляется сразу: клиент ждёт его до следующего запроса
+                out << std::flush;
+                m.stale = true;
+                return 0;
+            }
+            model_analyze(m);
+            m.answer.clear();
+            StringSink sink(m.answer);
+            std::ostream text(&sink);
+            model_print(m, text, opts);
+            out << m.answer << std::flush;
+            cache_put(*cache, key, m.answer);
+            return 0;
+        }
+        model_analyze(m);
     }
+    model_print(m, out, opts);
 
-    bool is_only_answer = true;
-    for(auto& [name, vitality] : variants) {
-        if(vitality == min_vitality) {
-            if(is_only_answer) {
-                out << "\'" << name << "\'";
-                is_only_answer = false;
-            } else {
-                out << ", \'" << name << "\'";
+    return 0;
+}
+
+int model_build(Model &m, std::istream &in, std::ostream &out, Options *opts) {
+    int ret = ser_in(in, m.graph, m.values, out, opts);
+    if(ret != 0) {
+        return ret;
+    }
+    model_analyze(m);
+    return 0;
+}
+
+//Суммы квадратов модели в разрядности Acc
+template<typename Acc>
+static Squares<Acc> &model_squares(Model &m) {
+    if constexpr(std::is_same_v<Acc, wide_t>) {
+        return m.wide_squares;
+    } else {
+        return m.squares;
+    }
+}
+
+//Вызов f(sq) с суммами квадратов модели в её текущей разрядности
+template<typename F>
+static void with_squares(Model &m, F &&f) {
+    if(m.wide) {
+        f(m.wide_squares);
+    } else {
+        f(m.squares);
+    }
+}
+
+//Суммы квадратов по узлам - на все узлы модели (новые узлы - нулевые)
+template<typename Acc>
+static void squares_fit(const Model &m, Squares<Acc> &sq) {
+    sq.local.resize(m.values.size());
+    sq.squares.resize(m.values.size());
+}
+
+//Повторный поиск точек сочленения и пересчёт оценок компоненты модели
+template<typename Acc>
+static void model_reanalyze(Model &m, Squares<Acc> &sq, int comp_id) {
+    squares_fit(m, sq);
+    Component &c = m.comps[comp_id];
+    c.cutpoints.clear();
+    c.bridges.clear();
+    for(auto id : c.nodes) {
+        m.values.tin[id] = -1;
+        m.values.up[id] = -1;
+    }
+    analyze_comp(m.graph, m.values, c, sq);
+}
+
+//Пересчёт оценок всех компонент модели в разрядности Acc
+template<typename Acc>
+static void model_rescore(Model &m) {
+    Squares<Acc> &sq = model_squares<Acc>(m);
+    sq.total = 0;
+    for(size_t i = 0; i < m.comps.size(); ++i) {
+        Component &c = m.comps[i];
+        c.value = 0;
+        for(auto id : c.nodes) {
+            c.value += m.values.value[id];
+        }
+        model_reanalyze(m, sq, i);
+        sq.total += square<Acc>(c.value);
+    }
+}
+
+void model_analyze(Model &m) {
+    make_components(m.graph, m.values, m.comps);
+    //Разрядность сумм выбирается по весам, как в mgt-single
+    m.wide = needs_wide(m.values);
+    if(m.wide) {
+        model_rescore<wide_t>(m);
+    } else {
+        model_rescore<value_t>(m);
+    }
+}
+
+bool needs_wide(const Values &v, const Weights *changes) {
+    const value_t limit = std::numeric_limits<int>::max();
+    wide_t sum = 0;
+    size_t negative = 0;
+    for(auto w : v.value) {
+        sum += w;
+        negative += w > limit;
+    }
+    if(changes) {
+        for(auto &[name, value] : *changes) {
+            auto it = v.index.find(name);
+            if(it == v.index.end()) {
+                continue;
             }
+            value_t old = v.value[it->second];
+            sum = sum + value - old;
+            negative = negative + (value > limit) - (old > limit);
         }
     }
-    out << "]" << std::endl;
+    return negative == 0 && sum > std::numeric_limits<unsigned int>::max();
+}
 
+//Изменение весов с пересчётом только затронутых частей, разрядность не меняется
+template<typename Acc>
+static void update_weights_sized(Model &m, Squares<Acc> &sq, const Weights &changes) {
+    Values &v = m.values;
+    std::pmr::vector<bool> dirty(m.comps.size(), m.comps.get_allocator());
+    for(auto &[name, value] : changes) {
+        int id = v.index.find(name)->second;
+        value_t delta = value - v.value[id];
+        if(delta == 0) {
+            continue;
+        }
+        v.value[id] = value;
+        //Вес меняется у всех поддеревьев, содержащих узел
+        for(int n = id; n != -1; n = v.up[n]) {
+            value_t old = v.sub[n];
+            v.sub[n] += delta;
+            int up = v.up[n];
+            if(up != -1 && (v.flags[n] & NODE_SEP)) {
+                v.cut[up] += delta;
+                sq.squares[up] += square<Acc>(v.sub[n]) - square<Acc>(old);
+            }
+        }
+        Component &c = m.comps[v.comp_id[id]];
+        sq.total -= square<Acc>(c.value);
+        c.value += delta;
+        sq.total += square<Acc>(c.value);
+        dirty[v.comp_id[id]] = true;
+    }
+    //Части, на которые распадается компонента, изменились для всех её узлов
+    for(size_t i = 0; i < m.comps.size(); ++i) {
+        if(dirty[i]) {
+            for(auto id : m.comps[i].nodes) {
+                sq.local[id] = node_local(v, sq, id, m.comps[i].value);
+            }
+        }
+    }
+}
+
+int update_weights(Model &m, const Weights &changes) {
+    Values &v = m.values;
+    for(auto &[name, value] : changes) {
+        if(v.index.find(name) == v.index.end()) {
+            return -1;
+        }
+    }
+    bool wide = needs_wide(v, &changes);
+    if(wide != m.wide) {
+        //Суммы квадратов в другой разрядности: пересчёт всех компонент,
+        //сами компоненты и связи не меняются
+        for(auto &[name, value] : changes) {
+            v.value[v.index.find(name)->second] = value;
+        }
+        m.wide = wide;
+        if(wide) {
+            model_rescore<wide_t>(m);
+        } else {
+            model_rescore<value_t>(m);
+        }
+        return 0;
+    }
+    with_squares(m, [&](auto &sq) { update_weights_sized(m, sq, changes); });
+    return 0;
+}
+
+//Исключение компоненты comp_id из модели: на её место встаёт последняя
+static void model_drop_comp(Model &m, int comp_id) {
+    int last = m.comps.size() - 1;
+    if(comp_id != last) {
+        m.comps[comp_id] = std::move(m.comps[last]);
+        for(auto id : m.comps[comp_id].nodes) {
+            m.values.comp_id[id] = comp_id;
+        }
+    }
+    m.comps.pop_back();
+}
+
+//Номер компоненты узла; отсутствующий узел создаётся отдельной компонентой
+template<typename Acc>
+static int model_node(Model &m, Squares<Acc> &sq, const Name &name) {
+    auto it = m.values.index.find(name);
+    if(it != m.values.index.end()) {
+        return m.values.comp_id[it->second];
+    }
+    int id = node_add(m.values, name);
+    m.graph[name];
+    int comp_id = m.comps.size();
+    m.values.comp_id[id] = comp_id;
+    m.comps.emplace_back();
+    m.comps.back().nodes.push_back(id);
+    model_reanalyze(m, sq, comp_id);
+    return comp_id;
+}
+
+//Добавление связи; новые узлы без веса, поэтому разрядность не меняется
+template<typename Acc>
+static void add_edge_sized(Model &m, Squares<Acc> &sq, const Name &a, const Name &b) {
+    int ca = model_node(m, sq, a);
+    int cb = model_node(m, sq, b);
+    if(!m.graph[a].insert(b).second) {
+        return;
+    }
+    m.graph[b].insert(a);
+    if(a == b) {
+        //Петля не меняет ни компонент, ни точек сочленения
+        return;
+    }
+
+    if(ca != cb) {
+        //Слияние: узлы меньшей компоненты переходят в большую
+        if(m.comps[ca].nodes.size() < m.comps[cb].nodes.size()) {
+            std::swap(ca, cb);
+        }
+        Component &to = m.comps[ca];
+        Component &from = m.comps[cb];
+        sq.total -= square<Acc>(to.value) + square<Acc>(from.value);
+        for(auto id : from.nodes) {
+            m.values.comp_id[id] = ca;
+        }
+        to.nodes.insert(to.nodes.end(), from.nodes.begin(), from.nodes.end());
+        to.value += from.value;
+        sq.total += square<Acc>(to.value);
+        model_drop_comp(m, cb);
+        if(ca == (int)m.comps.size()) {
+            //Большая компонента была последней и переехала на место меньшей
+            ca = cb;
+        }
+    }
+    model_reanalyze(m, sq, ca);
+}
+
+int add_edge(Model &m, const Name &a, const Name &b) {
+    with_squares(m, [&](auto &sq) { add_edge_sized(m, sq, a, b); });
     return 0;
 }
+
+//Удаление связи, которая есть в графе; веса не меняются, разрядность - тоже
+template<typename Acc>
+static void remove_edge_sized(Model &m, Squares<Acc> &sq, const Name &a, const Name &b) {
+    //Компоненту разделяет только мост: ребро дерева обхода (v, w),
+    //из поддерева w которого нет обратных рёбер выше w
+    Values &v = m.values;
+    int na = v.index.find(a)->second;
+    int nb = v.index.find(b)->second;
+    int ca = v.comp_id[na];
+    int side = -1;
+    if(v.up[nb] == na && v.low[nb] > v.tin[na]) {
+        side = nb;
+    } else if(v.up[na] == nb && v.low[na] > v.tin[nb]) {
+        side = na;
+    }
+    if(side != -1) {
+        //Узлы отделившегося поддерева сразу получают номер новой компоненты
+        int cb = m.comps.size();
+        Component part(m.comps.get_allocator());
+        std::pmr::vector<int> stack({side}, m.comps.get_allocator());
+        v.comp_id[side] = cb;
+        while(!stack.empty()) {
+            int cur = stack.back();
+            stack.pop_back();
+            part.nodes.push_back(cur);
+            part.value += v.value[cur];
+            for(auto &link : m.graph.find(*v.names[cur])->second) {
+                int to = v.index.find(link)->second;
+                if(v.comp_id[to] != cb) {
+                    v.comp_id[to] = cb;
+                    stack.push_back(to);
+                }
+            }
+        }
+
+        //Компонента распалась: поддерево становится новой компонентой
+        Component &c = m.comps[ca];
+        sq.total -= square<Acc>(c.value);
+        c.nodes.erase(std::remove_if(c.nodes.begin(), c.nodes.end(),
+                [&](int id) { return v.comp_id[id] == cb; }), c.nodes.end());
+        c.value -= part.value;
+        sq.total += square<Acc>(c.value) + square<Acc>(part.value);
+        m.comps.push_back(std::move(part));
+        model_reanalyze(m, sq, cb);
+    }
+    model_reanalyze(m, sq, ca);
+}
+
+int remove_edge(Model &m, const Name &a, const Name &b) {
+    auto ia = m.graph.find(a);
+    if(ia == m.graph.end() || ia->second.erase(b) == 0) {
+        return -1;
+    }
+    m.graph.find(b)->second.erase(a);
+    if(a == b) {
+        return 0;
+    }
+    with_squares(m, [&](auto &sq) { remove_edge_sized(m, sq, a, b); });
+    return 0;
+}
+
+void model_print(Model &m, std::ostream &out, const Options &opts) {
+    with_squares(m, [&](auto &sq) { print_scores(out, m.comps, m.values, sq, opts); });
+}
+
+//Степень двойки, до которой округляется блок
+static int block_class(size_t bytes) {
+    int k = 0;
+    while((size_t(1) << k) < bytes) {
+        ++k;
+    }
+    return k;
+}
+
+void *BlockCache::do_allocate(size_t bytes, size_t align) {
+    int k = block_class(std::max(bytes, sizeof(void *)));
+    void *p = free[k];
+    if(p && reinterpret_cast<uintptr_t>(p) % align == 0) {
+        free[k] = *static_cast<void **>(p);
+        return p;
+    }
+    return upstream->allocate(size_t(1) << k, std::max(align, alignof(std::max_align_t)));
+}
+
+void BlockCache::do_deallocate(void *p, size_t bytes, size_t) {
+    int k = block_class(std::max(bytes, sizeof(void *)));
+    *static_cast<void **>(p) = free[k];
+    free[k] = p;
+}
+
+bool BlockCache::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+    return this == &other;
+}
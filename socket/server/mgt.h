@@ -3,15 +3,26 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <list>
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <istream>
 
+/**
+ * Имя узла. Имена и контейнеры графа используют полиморфные аллокаторы:
+ * память одного запроса берётся из арены (см. Arena) и освобождается разом
+ */
+using Name = std::pmr::string;
+
 /**
  * Граф, сформированный из входного файла
  */
-using Graph = std::unordered_map<std::string, std::set<std::string>>;
+using Graph = std::pmr::unordered_map<Name, std::pmr::set<Name>>;
 
 /**
  * Тип данных для подсчёта квадратов сумм
@@ -19,46 +30,205 @@ using Graph = std::unordered_map<std::string, std::set<std::string>>;
 using value_t = unsigned long long;
 
 /**
- * Представление узла графа с дополнительными данными
- *   Node(value_t v = 0) : value(v) {}: конструктор с заданием собственного веса
- *   value_t value{}; //собственный исходный вес узла
- *   int comp_id = -1; //Индекс в векторе компонент связности графа
- *   value_t sum{}; //Сумма весов узла после редуцирования графа
- *   bool is_cutp{}; // true = узел является точкой сочленения
- *   bool is_reduced{};
- *   std::vector<value_t> subtree_sums;
+ * Тип для квадратов сумм, когда сумма весов не помещается в 32 бита
+ * (см. needs_wide)
  */
-struct Node {
-    Node(value_t v = 0) : value(v) {}
-    value_t value{};
-    int comp_id = -1;
-    value_t sum{};
-    bool is_cutp{};
-    bool is_reduced{};
-    std::vector<value_t> subtree_sums;
+using wide_t = unsigned __int128;
+
+/**
+ * Признаки узла, упакованные битами в один байт
+ *   NODE_CUTP : узел является точкой сочленения
+ *   NODE_SEP : при удалении родителя в дереве обхода поддерево узла отделяется
+ */
+enum : unsigned char {
+    NODE_CUTP = 1,
+    NODE_SEP = 2,
+};
+
+/**
+ * Узлы графа. Атрибуты узлов хранятся параллельными плотными массивами,
+ * индексированными номером узла: проход по одному атрибуту читает память
+ * подряд и не затрагивает остальные.
+ *   std::pmr::unordered_map<Name, int> index : номер узла по имени
+ *   std::pmr::vector<const Name *> names : имя узла (ключ в index)
+ *   std::pmr::vector<value_t> value : собственный исходный вес узла
+ *   std::pmr::vector<int> comp_id : индекс в векторе компонент связности графа
+ *                                   (-1 - не определён)
+ *   std::pmr::vector<unsigned char> flags : признаки узла NODE_*
+ *   std::pmr::vector<int> tin : время входа при обходе в глубину (-1 = узел не посещён)
+ *   std::pmr::vector<int> low : наименьшее время входа, достижимое из поддерева узла
+ *   std::pmr::vector<value_t> sub : суммарный вес поддерева узла в дереве обхода
+ * Для пересчёта оценок после изменения весов (заполняет analyze_comp):
+ *   std::pmr::vector<int> up : родитель в дереве обхода (-1 - корень)
+ *   std::pmr::vector<value_t> cut : суммарный вес отделяемых поддеревьев детей
+ * Суммы квадратов весов - в Squares: их разрядность зависит от весов.
+ * При копировании и присваивании names перестраивается по ключам нового index.
+ */
+struct Values {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    explicit Values(const allocator_type &a = {});
+    Values(const Values &v, const allocator_type &a = {});
+    Values(Values &&) = default;
+    Values &operator=(const Values &v);
+    Values &operator=(Values &&v);
+    allocator_type get_allocator() const { return index.get_allocator(); }
+    size_t size() const { return names.size(); }
+    std::pmr::unordered_map<Name, int> index;
+    std::pmr::vector<const Name *> names;
+    std::pmr::vector<value_t> value;
+    std::pmr::vector<int> comp_id;
+    std::pmr::vector<unsigned char> flags;
+    std::pmr::vector<int> tin;
+    std::pmr::vector<int> low;
+    std::pmr::vector<value_t> sub;
+    std::pmr::vector<int> up;
+    std::pmr::vector<value_t> cut;
+};
+
+/**
+ * Суммы квадратов весов по узлам в разрядности Acc: value_t, либо wide_t,
+ * когда квадрат суммы весов не помещается в value_t (см. needs_wide)
+ *   std::pmr::vector<Acc> local : сумма квадратов весов частей компоненты, на которые
+ *                                 она распадается при удалении узла, плюс вес узла
+ *   std::pmr::vector<Acc> squares : сумма квадратов весов поддеревьев, отделяемых узлом
+ *   Acc total : сумма квадратов весов компонент
+ */
+template<typename Acc>
+struct Squares {
+    explicit Squares(std::pmr::memory_resource *mem) : local(mem), squares(mem) {}
+    std::pmr::vector<Acc> local;
+    std::pmr::vector<Acc> squares;
+    Acc total{};
 };
 
 /**
- * Тип данных для массива узлов
+ * Номер узла name; отсутствующий узел добавляется с весом value
+ * (вес уже имеющегося узла не меняется)
  */
-using Values = std::unordered_map<std::string, Node>;
+int node_add(Values &v, const Name &name, value_t value = 0);
+
+/**
+ * Веса узлов по именам: новые веса и сценарии весов
+ */
+using Weights = std::pmr::unordered_map<Name, value_t>;
+
+/**
+ * Мост - связь, при удалении которой компонента распадается на две части
+ *   int from : конец связи со стороны корня дерева обхода
+ *   int to : конец связи, поддерево которого отделяется
+ *            (вес отделяемой части - Values::sub[to])
+ */
+struct Bridge {
+    int from;
+    int to;
+};
 
 /**
  * Структула, описывающая компоненту связности графа
- *   std::set<std::string> names : перечень узлов
- *   std::set<std::string> cutpoints : перечень точек сочленения
+ *   std::pmr::vector<int> nodes : номера узлов, первый - корень обхода
+ *   std::pmr::vector<int> cutpoints : номера точек сочленения
  *   value_t value{} : суммарный вес компоненты связности
+ *   std::pmr::vector<Bridge> bridges : мосты компоненты
+ * Конструкторы с аллокатором нужны, чтобы компоненты в Components
+ * размещали свои перечни в памяти самого массива.
  */
 struct Component {
-    std::set<std::string> names;
-    std::set<std::string> cutpoints;
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    explicit Component(const allocator_type &a = {}) : nodes(a), cutpoints(a), bridges(a) {}
+    Component(const Component &c, const allocator_type &a)
+        : nodes(c.nodes, a), cutpoints(c.cutpoints, a), value(c.value), bridges(c.bridges, a) {}
+    Component(Component &&c, const allocator_type &a)
+        : nodes(std::move(c.nodes), a), cutpoints(std::move(c.cutpoints), a), value(c.value),
+          bridges(std::move(c.bridges), a) {}
+    Component(const Component &) = default;
+    Component(Component &&) = default;
+    Component &operator=(const Component &) = default;
+    Component &operator=(Component &&) = default;
+    std::pmr::vector<int> nodes;
+    std::pmr::vector<int> cutpoints;
     value_t value{};
+    std::pmr::vector<Bridge> bridges;
 };
 
 /**
  * Тип данных для массива компонентов связности
  */
-using Components = std::vector<Component>;
+using Components = std::pmr::vector<Component>;
+
+/**
+ * Память арены сверх её буфера: обычная куча с подсчётом выданного
+ *   size_t taken : выдано байт с последнего сброса арены
+ */
+struct ArenaHeap : std::pmr::memory_resource {
+    size_t taken{};
+    void *do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void *p, size_t bytes, size_t align) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+};
+
+/**
+ * Арена для контейнеров одного запроса: память выдаётся подряд из буфера,
+ * освобождение отдельных объектов ничего не стоит, а вся память
+ * освобождается разом при сбросе. Буфер сохраняется между запросами и
+ * растёт до пикового объёма запроса, поэтому в установившемся режиме
+ * запрос не обращается к куче. Арена однопоточная: у каждого обработчика своя.
+ *   std::unique_ptr<char[]> buffer : буфер
+ *   size_t size : размер буфера, байт
+ *   ArenaHeap heap : память, взятая сверх буфера
+ *   std::optional<std::pmr::monotonic_buffer_resource> mem : выделение из буфера
+ */
+struct Arena {
+    explicit Arena(size_t size = 256 * 1024);
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    std::unique_ptr<char[]> buffer;
+    size_t size;
+    ArenaHeap heap;
+    std::optional<std::pmr::monotonic_buffer_resource> mem;
+};
+
+/**
+ * Источник памяти арены для контейнеров
+ */
+std::pmr::memory_resource *arena_resource(Arena &a);
+
+/**
+ * Сброс арены: вся выделенная из неё память освобождается, а если запрос
+ * не уместился в буфер, буфер увеличивается на недостающий объём.
+ * Контейнеры на арене к этому моменту должны быть уничтожены.
+ */
+void arena_reset(Arena &a);
+
+/**
+ * Крупные блоки соединения поверх арены. Пул памяти соединения
+ * (std::pmr::unsynchronized_pool_resource) берёт блоки крупнее своих
+ * пулов прямо у источника, а арена освобождает память только при сбросе:
+ * без повторного использования каждый запрос с большим графом занимал бы
+ * новую память арены, а за её буфером - кучи. Размер блока округляется
+ * до степени двойки, освобождённый блок попадает в список своего размера
+ * (ссылка на следующий хранится в самом блоке) и выдаётся следующему
+ * запросу блока этого размера.
+ *   std::pmr::memory_resource *upstream : источник новых блоков (арена)
+ *   void *free[] : списки освобождённых блоков по степени двойки размера
+ */
+struct BlockCache : std::pmr::memory_resource {
+    explicit BlockCache(std::pmr::memory_resource *upstream) : upstream(upstream) {}
+    BlockCache(const BlockCache &) = delete;
+    BlockCache &operator=(const BlockCache &) = delete;
+    std::pmr::memory_resource *upstream;
+    void *free[64]{};
+    void *do_allocate(size_t bytes, size_t align) override;
+    void do_deallocate(void *p, size_t bytes, size_t align) override;
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+};
+
+/**
+ * Количество обращений к глобальному operator new с запуска процесса
+ * (alloc.cpp, компонуется только в server-check): по разнице до и после
+ * запроса проверяется, что запрос в установившемся режиме не обращается
+ * к куче
+ */
+size_t alloc_count();
 
 /**
  * Обнулить счётчики строк ибайтов
@@ -68,6 +238,21 @@ ser_zero_counters(
     void
 );
 
+/**
+ * Параметры запроса: необязательный третий раздел входных данных,
+ * например {[...],{...},{'top':5}}
+ *   size_t top : вывести top лучших узлов с оценками
+ *                (0 - только узлы с наименьшей оценкой, без оценок)
+ *   bool all : вывести оценки всех узлов
+ *   bool edges : оценивать удаление связей-мостов вместо узлов
+ *                (сумма квадратов весов компонент после удаления связи)
+ */
+struct Options {
+    size_t top{};
+    bool all{};
+    bool edges{};
+};
+
 /**
  * Разбор входного потока и формирование контейнеров графа и
  * массива узлов графа
@@ -76,6 +261,7 @@ ser_zero_counters(
  *   Graph& g : сформированный граф
  *   Values& v : сформированный массив узлов графа
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ *   Options *opts : если не nullptr - параметры запроса из входных данных
  * Возвращаемое значение:
  *   0 - успешно
  *   не 0 - ошибка
@@ -84,23 +270,242 @@ int ser_in(
     std::istream& in,
     Graph& g,
     Values& v,
-    std::ostream& out
+    std::ostream& out,
+    Options *opts = nullptr
+);
+
+/**
+ * Ключ кэша результатов: 128-битный хэш запроса
+ */
+using hash_t = unsigned __int128;
+
+/**
+ * Ключ кэша результатов по разобранному запросу: хэш графа (связи и веса
+ * узлов) и параметров запроса. Хэш узла считается по имени, весу и
+ * упорядоченному списку соседей, хэши узлов складываются - ключ не
+ * зависит от порядка связей и весов во входных данных.
+ */
+hash_t graph_hash(const Graph &g, const Values &v, const Options &opts);
+
+/**
+ * Запись кэша результатов
+ *   hash_t key : ключ запроса
+ *   std::string text : текст результата
+ */
+struct CacheEntry {
+    hash_t key;
+    std::string text;
+};
+
+/**
+ * Кэш результатов запросов с данными графа, общий для всех соединений
+ * сервера: повторно присланный граф получает сохранённый текст результата
+ * без поиска компонент, точек сочленения и оценок. Когда объём записей
+ * превышает capacity, вытесняются давно не использованные.
+ *   size_t capacity : наибольший объём записей, байт
+ *   size_t bytes : объём записей вместе с узлами списка и индекса
+ *   size_t hits : запросов, ответ на которые найден в кэше
+ *   size_t misses : запросов, ответ на которые пришлось считать
+ *   std::list<CacheEntry> lru : записи от недавно использованных к давним
+ *   std::unordered_map<hash_t, ...> index : запись по ключу
+ */
+struct ResultCache {
+    struct KeyHash {
+        size_t operator()(hash_t k) const { return size_t(k) ^ size_t(k >> 64); }
+    };
+    explicit ResultCache(size_t capacity) : capacity(capacity) {}
+    size_t capacity;
+    size_t bytes{};
+    size_t hits{};
+    size_t misses{};
+    std::list<CacheEntry> lru;
+    std::unordered_map<hash_t, std::list<CacheEntry>::iterator, KeyHash> index;
+};
+
+/**
+ * Поиск результата в кэше: найденный текст выводится в out,
+ * запись становится самой недавней
+ * Возвращаемое значение:
+ *   true - результат выведен (попадание)
+ *   false - результата нет (промах)
+ */
+bool cache_get(ResultCache &c, hash_t key, std::ostream &out);
+
+/**
+ * Сохранение результата в кэше с вытеснением давних записей
+ * (результат больше всего кэша не сохраняется, текст не копируется)
+ */
+void cache_put(ResultCache &c, hash_t key, std::string_view text);
+
+/**
+ * Вывод счётчиков кэша:
+ * {'hits': 3, 'misses': 5, 'entries': 5, 'bytes': 1234}
+ */
+void cache_print(const ResultCache &c, std::ostream &out);
+
+/**
+ * Граф, сохраняемый между запросами вместе с результатами анализа:
+ * после изменения весов узлов оценки пересчитываются без повторного
+ * разбора и поиска точек сочленения.
+ * Не копируется: узлы ссылаются друг на друга указателями.
+ *   Model(std::pmr::memory_resource *mem) : конструктор с источником
+ *                                           памяти всех контейнеров модели
+ *   Graph graph : граф
+ *   Values values : узлы
+ *   Components comps : компоненты связности
+ *   bool wide : суммы квадратов - в wide_squares, иначе - в squares
+ *   Squares<value_t> squares, Squares<wide_t> wide_squares : суммы квадратов
+ *                  весов; память неиспользуемой разрядности сохраняется
+ *   bool stale : граф не анализировался - результат взят из кэша;
+ *                анализ выполняется перед следующим изменением
+ *   std::pmr::string answer : текст последнего ответа для кэша;
+ *                             память переиспользуется между запросами
+ */
+struct Model {
+    explicit Model(std::pmr::memory_resource *mem = std::pmr::get_default_resource())
+        : graph(mem), values(mem), comps(mem), squares(mem), wide_squares(mem), answer(mem) {}
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+    Graph graph;
+    Values values;
+    Components comps;
+    bool wide{};
+    Squares<value_t> squares;
+    Squares<wide_t> wide_squares;
+    bool stale{};
+    std::pmr::string answer;
+};
+
+/**
+ * Разбор входного потока и анализ графа с сохранением в модели
+ * Параметры:
+ *   Model &m : модель (должна быть пустой)
+ *   std::istream &in : входной поток
+ *   std::ostream &out : выходной поток для вывода ошибок
+ *   Options *opts : если не nullptr - параметры запроса из входных данных
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка разбора
+ */
+int model_build(Model &m, std::istream &in, std::ostream &out, Options *opts = nullptr);
+
+/**
+ * Анализ графа, уже разобранного в m.graph и m.values
+ */
+void model_analyze(Model &m);
+
+/**
+ * Изменение весов узлов модели. Для каждого изменённого узла
+ * пересчитываются веса поддеревьев на пути к корню дерева обхода,
+ * затем - оценки узлов затронутых компонент. Если новые веса требуют
+ * другой разрядности сумм (см. needs_wide), оценки всех компонент
+ * пересчитываются в ней заново.
+ * Параметры:
+ *   Model &m : модель
+ *   const Weights &changes : новые веса узлов
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - в модели нет какого-то из узлов, веса не изменены
+ */
+int update_weights(Model &m, const Weights &changes);
+
+/**
+ * Нужны ли суммам квадратов 128 бит: оценка узла не больше S^2 + S,
+ * где S - сумма весов, поэтому value_t хватает при S < 2^32.
+ * Отрицательные веса (больше INT_MAX) хранятся по модулю - с ними
+ * арифметика остаётся модульной в value_t, как в mgt-single
+ * Параметры:
+ *   const Values &v : узлы и веса
+ *   const Weights *changes : если не nullptr - новые веса части узлов
+ */
+bool needs_wide(const Values &v, const Weights *changes = nullptr);
+
+/**
+ * Добавление связи между узлами a и b модели (отсутствующие узлы
+ * создаются с нулевым весом). Связь разных компонент сливает их:
+ * узлы меньшей получают номер большей. Точки сочленения и оценки
+ * пересчитываются только для получившейся компоненты.
+ * Возвращаемое значение:
+ *   0 - успешно (в том числе если связь уже была)
+ */
+int add_edge(Model &m, const Name &a, const Name &b);
+
+/**
+ * Удаление связи между узлами a и b модели. Пересчитывается только
+ * компонента, которой принадлежала связь; если она распалась,
+ * отделившаяся часть становится новой компонентой.
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - такой связи нет
+ */
+int remove_edge(Model &m, const Name &a, const Name &b);
+
+/**
+ * Вывод результата по модели в формате process()
+ * без открывающей скобки: process() выводит её до разбора запроса
+ */
+void model_print(Model &m, std::ostream &out, const Options &opts);
+
+/**
+ * Вид запроса на соединении
+ */
+enum Request {
+    REQUEST_GRAPH,   //данные графа
+    REQUEST_WEIGHTS, //только новые веса узлов
+    REQUEST_ADD,     //добавление связей
+    REQUEST_REMOVE,  //удаление связей
+    REQUEST_STATS,   //счётчики кэша результатов
+};
+
+/**
+ * Разбор запроса на соединении: данные графа {[...],{...}},
+ * только новые веса узлов {'A':1,...}, добавление {+[['A','B'],...]}
+ * или удаление {-[['A','B'],...]} связей графа из предыдущего запроса,
+ * либо запрос счётчиков кэша результатов {?}
+ * Параметры:
+ *   std::istream& in : входной поток
+ *   Graph& g : граф (запрос с данными графа) или изменяемые связи
+ *   Values& v : узлы графа (запрос с данными графа)
+ *   Weights& weights : новые веса узлов (запрос только с весами)
+ *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ *   Options *opts : если не nullptr - параметры запроса из входных данных
+ *   Request &kind : вид запроса
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка или конец потока
+ */
+int ser_in_request(
+    std::istream& in,
+    Graph& g,
+    Values& v,
+    Weights& weights,
+    std::ostream& out,
+    Options *opts,
+    Request &kind
 );
 
 /**
  * Разбор входного потока данных,
- * построение графа, рачёт по графу, вывод результатов
+ * построение графа, рачёт по графу, вывод результатов.
+ * Запрос только с весами узлов или с изменением связей пересчитывает
+ * результат по графу из предыдущего запроса на том же соединении.
  * Параметры:
  *   std::istream& in : входной поток
  *   std::ostream& out : выходной поток для вывода результата или ошибок
+ *   Model &m : граф предыдущего запроса на соединении
+ *   ResultCache *cache : если не nullptr - кэш результатов запросов
+ *                        с данными графа
  * Возвращаемое значение:
- *   0 - успешно
- *   не 0 - ошибка
+ *   0 - запрос обработан, можно продолжать сеанс; в том числе отклонённое
+ *       изменение ('@@ERROR' в ответе): модель остаётся прежней
+ *   не 0 - ошибка разбора или конец потока
  */
 int
 process(
     std::istream &in,
-    std::ostream &out
+    std::ostream &out,
+    Model &m,
+    ResultCache *cache = nullptr
 );
 
 #endif
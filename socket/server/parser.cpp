@@ -141,7 +141,7 @@ ser_expect_char(
  * символов-ограничителей
  * Параметры:
  *   std::istream& in - входной поток
- *   std::string& s, - строка для накопления данных
+ *   Name& s, - строка для накопления данных
  *   const char *stop_symbols, - массив символов - ограничителеё
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
@@ -151,7 +151,7 @@ ser_expect_char(
 int
 ser_read_until(
     std::istream& in,
-    std::string& s,
+    Name& s,
     const char *stop_symbols,
     std::ostream& out
 ) {
@@ -192,7 +192,7 @@ ser_read_until(
  * Считывание имени, залючённого в одинарные кавычки, например, 'A'
  * Параметры:
  *   std::istream& in - входной поток
- *   std::string& name - строка для сохранения имени
+ *   Name& name - строка для сохранения имени
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
  *   0 - успешно
@@ -201,7 +201,7 @@ ser_read_until(
 int
 ser_get_name(
     std::istream& in,
-    std::string& name,
+    Name& name,
     std::ostream& out
 ) {
     OK(ser_expect_char(in, "\'", out, true));
@@ -227,8 +227,8 @@ ser_get_graph(
     std::ostream& out
 ) {
     do {
-        std::string n1;
-        std::string n2;
+        Name n1(graph.get_allocator());
+        Name n2(graph.get_allocator());
         OK(ser_expect_char(in, "[", out, true));
         OK(ser_get_name(in, n1, out));
         OK(ser_expect_char(in, ",", out, true));
@@ -258,10 +258,10 @@ ser_get_val(
     std::ostream& out
 ) {
     OK(ser_expect_char(in, ":", out, true));
-    std::string valstr;
+    Name valstr;
     OK(ser_read_until(in, valstr, ",}] \t\n", out));
     size_t pos = 0;
-    int v = std::stoi(valstr, &pos);
+    int v = std::stoi(std::string(valstr), &pos);
     if(pos != valstr.size()) {
         out <<"'@@ERROR':'"
             <<ser_err()
@@ -279,7 +279,7 @@ ser_get_val(
  * считывание продолжается пока после значения стоит запятая
  * Параметры:
  *   std::istream& in - входной поток
- *   Value& values - контейнер для хранения значений
+ *   Values& values - массив узлов (повторный вес узла не учитывается)
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
  *   0 - успешно
@@ -292,11 +292,11 @@ ser_get_values(
     std::ostream& out
 ) {
     do {
-        std::string name;
+        Name name(values.get_allocator());
         OK(ser_get_name(in, name, out));
         int value;
         OK(ser_get_val(in, value, out));
-        values.insert({name, value});
+        node_add(values, name, value);
         if(isspace(ser_last_char)) {
             ser_expect_char(in, ",", out, false);
         }
@@ -305,26 +305,89 @@ ser_get_values(
 }
 
 /**
- * Разбор входного потока и формирование контейнеров связей и
- * весовых коэффициентов графа
+ * Считывание массива значений вида 'A':dd в набор весов
  * Параметры:
  *   std::istream& in - входной поток
- *   Links& l - контейнер связей
- *   Value& v - контейнер весовых коэффициентов
+ *   Weights& weights - веса узлов (повторный вес узла не учитывается)
  *   std::ostream& out - выходной поток для вывода ошибок, если будут
  * Возвращаемое значение:
  *   0 - успешно
  *   не 0 - ошибка
  */
 int
-ser_in(
+ser_get_weights(
+    std::istream& in,
+    Weights& weights,
+    std::ostream& out
+) {
+    do {
+        Name name(weights.get_allocator());
+        OK(ser_get_name(in, name, out));
+        int value;
+        OK(ser_get_val(in, value, out));
+        weights.insert({name, value_t(value)});
+        if(isspace(ser_last_char)) {
+            ser_expect_char(in, ",", out, false);
+        }
+    } while(ser_last_char == ',');
+    return 0;
+}
+
+/**
+ * Считывание параметров запроса вида 'top':5, 'all':1
+ * считывание продолжается пока после значения стоит запятая
+ * Параметры:
+ *   std::istream& in - входной поток
+ *   Options &opts - параметры запроса
+ *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка
+ */
+int
+ser_get_options(
+    std::istream& in,
+    Options &opts,
+    std::ostream& out
+) {
+    do {
+        Name name;
+        OK(ser_get_name(in, name, out));
+        int value;
+        OK(ser_get_val(in, value, out));
+        if(name == "top") {
+            opts.top = value > 0 ? value : 0;
+        } else if(name == "all") {
+            opts.all = value != 0;
+        } else if(name == "edges") {
+            opts.edges = value != 0;
+        } else {
+            out <<"'@@ERROR':'"
+                <<ser_err()
+                <<"unknown option "
+                <<name
+                <<"'";
+            return -1;
+        }
+        if(isspace(ser_last_char)) {
+            ser_expect_char(in, ",", out, false);
+        }
+    } while(ser_last_char == ',');
+    return 0;
+}
+
+/**
+ * Разбор данных графа после открывающей скобки: [...],{...}[,{...}]}
+ */
+static int
+ser_in_graph(
     std::istream& in,
     Graph& g,
     Values& v,
-    std::ostream& out
+    std::ostream& out,
+    Options *opts
 ) {
-    ser_zero_counters();
-    OK(ser_expect_char(in, "{[", out, true));
+    OK(ser_expect_char(in, "[", out, true));
     OK(ser_get_graph(in, g, out));
     if(ser_last_char != ']') {
         out <<"'@@ERROR':'"
@@ -342,17 +405,128 @@ ser_in(
             <<"expected char } after value list'";
         return -1;
     }
-    OK(ser_expect_char(in, "}", out, true));
-    for(auto value : v) {
-        g[value.first];
+    //Необязательный раздел параметров запроса
+    int next = ser_expect_char(in, "}", out, false);
+    if(next == ',') {
+        Options ignored;
+        OK(ser_expect_char(in, "{", out, true));
+        OK(ser_get_options(in, opts ? *opts : ignored, out));
+        if(ser_last_char == '\n') {
+            OK(ser_expect_char(in, "}", out, true));
+        } else if(ser_last_char != '}') {
+            out <<"'@@ERROR':'"
+                <<ser_err()
+                <<"expected char } after option list'";
+            return -1;
+        }
+        OK(ser_expect_char(in, "}", out, true));
+    } else if(next > 0) {
+        out <<"'@@ERROR':'"
+            <<ser_err()
+            <<"expected char } but found "
+            <<char(next)
+            <<"'";
+        return next;
+    } else if(next != 0) {
+        return next;
+    }
+    for(size_t id = 0; id < v.size(); ++id) {
+        g[*v.names[id]];
     }
     for(auto &[from, tos] : g) {
-        v[from];
-        for(auto to : tos) {
-            v[to];
-        }
+        node_add(v, from);
     }
 
 
     return 0;
 }
+
+/**
+ * Разбор входного потока и формирование контейнеров связей и
+ * весовых коэффициентов графа
+ * Параметры:
+ *   std::istream& in - входной поток
+ *   Links& l - контейнер связей
+ *   Value& v - контейнер весовых коэффициентов
+ *   std::ostream& out - выходной поток для вывода ошибок, если будут
+ *   Options *opts - если не nullptr - параметры запроса из входных данных
+ * Возвращаемое значение:
+ *   0 - успешно
+ *   не 0 - ошибка
+ */
+int
+ser_in(
+    std::istream& in,
+    Graph& g,
+    Values& v,
+    std::ostream& out,
+    Options *opts
+) {
+    ser_zero_counters();
+    OK(ser_expect_char(in, "{", out, true));
+    return ser_in_graph(in, g, v, out, opts);
+}
+
+/**
+ * Пропустить пробельные символы и вернуть следующий символ, не считывая его
+ */
+int
+ser_peek_char(
+    std::istream& in
+) {
+    while(std::isspace(in.peek())) {
+        ser_get_char(in);
+    }
+    return in.peek();
+}
+
+int
+ser_in_request(
+    std::istream& in,
+    Graph& g,
+    Values& v,
+    Weights& weights,
+    std::ostream& out,
+    Options *opts,
+    Request &kind
+) {
+    ser_zero_counters();
+    OK(ser_expect_char(in, "{", out, true));
+    int next = ser_peek_char(in);
+    if(next == '+' || next == '-') {
+        //Изменение связей: список связей в формате раздела графа
+        ser_get_char(in);
+        kind = next == '+' ? REQUEST_ADD : REQUEST_REMOVE;
+        OK(ser_expect_char(in, "[", out, true));
+        OK(ser_get_graph(in, g, out));
+        if(ser_last_char != ']') {
+            out <<"'@@ERROR':'"
+                <<ser_err()
+                <<"expected char ] after link list'";
+            return -1;
+        }
+        OK(ser_expect_char(in, "}", out, true));
+        return 0;
+    }
+    if(next == '?') {
+        ser_get_char(in);
+        kind = REQUEST_STATS;
+        OK(ser_expect_char(in, "}", out, true));
+        return 0;
+    }
+    if(next != '\'') {
+        kind = REQUEST_GRAPH;
+        return ser_in_graph(in, g, v, out, opts);
+    }
+    kind = REQUEST_WEIGHTS;
+    OK(ser_get_weights(in, weights, out));
+    if(ser_last_char == '\n') {
+        OK(ser_expect_char(in, "}", out, true));
+    } else if(ser_last_char != '}') {
+        out <<"'@@ERROR':'"
+            <<ser_err()
+            <<"expected char } after value list'";
+        return -1;
+    }
+    return 0;
+}
@@ -7,15 +7,22 @@
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
+#include <sstream>
 #include <csignal>
 #include <ctime>
+#include <fcntl.h>
 
 #include "mgt.h"
 
 enum {
     DEFAULT_PORT = 12347,
     DEFAULT_READ_TIMEOUT = 5000,
-    DEFAULT_WRITE_TIMEOUT = 5000
+    DEFAULT_WRITE_TIMEOUT = 5000,
+    DEFAULT_CACHE_MB = 64,
+#ifdef ALLOC_CHECK
+    ALLOC_CHECK_WARMUP = 3,
+    ALLOC_CHECK_ROUNDS = 3
+#endif
 };
 
 static volatile std::sig_atomic_t GotSigTerm;
@@ -117,21 +124,113 @@ sock_write_timeout(
     return status;
 }
 
+#ifdef ALLOC_CHECK
+/**
+ * Проверка установившегося режима (только в сборке server-check,
+ * где alloc.cpp подменяет глобальный operator new): запросы каждого файла выполняются
+ * на одном соединении ALLOC_CHECK_WARMUP раз для разогрева, затем ещё
+ * ALLOC_CHECK_ROUNDS раз с подсчётом обращений к куче. Ответы выводятся
+ * в /dev/null через такой же буфер, как у сокета. Каждый файл проверяется
+ * без кэша результатов и с кэшем размера по умолчанию, как в main().
+ * Параметры:
+ *   int files : количество файлов
+ *   char *names[] : имена файлов с запросами
+ * Возвращаемое значение:
+ *   EXIT_SUCCESS - после разогрева запросы не обращались к куче
+ *   EXIT_FAILURE - обращались, либо файл не прочитан
+ */
+int
+alloc_check(
+    int files,
+    char *names[]
+) {
+    int null_fd = ::open("/dev/null", O_WRONLY);
+    if(null_fd < 0) {
+        perror("/dev/null");
+        return EXIT_FAILURE;
+    }
+    __gnu_cxx::stdio_filebuf<char> outbuf(null_fd, std::ios::out);
+    std::ostream out(&outbuf);
+
+    Arena arena;
+    int status = EXIT_SUCCESS;
+    for(int i = 0; i < files; ++i) {
+        std::ifstream file(names[i]);
+        std::stringstream text;
+        if(!(text << file.rdbuf())) {
+            perror(names[i]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        std::istringstream in(text.str());
+
+        for(size_t cache_mb : {size_t(0), size_t(DEFAULT_CACHE_MB)}) {
+            ResultCache cache(cache_mb << 20);
+            size_t taken = 0;
+            {
+                //Память и модель - как у соединения в main()
+                BlockCache blocks(arena_resource(arena));
+                std::pmr::unsynchronized_pool_resource mem(&blocks);
+                Model model(&mem);
+                for(int round = 0; round < ALLOC_CHECK_WARMUP + ALLOC_CHECK_ROUNDS; ++round) {
+                    in.clear();
+                    in.seekg(0);
+                    size_t before = alloc_count();
+                    while(process(in, out, model, cache_mb ? &cache : nullptr) == 0) {
+                        ;
+                    }
+                    if(round >= ALLOC_CHECK_WARMUP) {
+                        taken += alloc_count() - before;
+                    }
+                }
+            }
+            arena_reset(arena);
+
+            std::cout << names[i] << " (cache " << cache_mb << " MB): "
+                      << taken << " allocations after warmup" << std::endl;
+            if(taken != 0) {
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+    return status;
+}
+#endif
+
 /**
  * Параметры:
  *   argv[1] - порт прослушивания сервера
  *             Задавать обязательно
+ *   argv[2] - объём кэша результатов, МБ
+ *             (по умолчанию DEFAULT_CACHE_MB, 0 - без кэша)
+ *   либо --alloc-check file... - проверка запросов из файлов
+ *             на обращения к куче после разогрева (см. alloc_check),
+ *             только в сборке server-check
  */
 int main(int argc, char *argv[]) {
     if(argc < 2) {
         std::cout <<
-        "Usage: mgt-server port" <<std::endl;
+        "Usage: mgt-server port [cache-mb]" <<std::endl
+#ifdef ALLOC_CHECK
+        <<
+        "       mgt-server --alloc-check file..." <<std::endl
+#endif
+        ;
         return EXIT_FAILURE;
     }
+#ifdef ALLOC_CHECK
+    if(std::string(argv[1]) == "--alloc-check") {
+        return alloc_check(argc - 2, argv + 2);
+    }
+#endif
 
     //Порт сервера
     in_port_t port = std::stoi(argv[1], NULL, 10);
 
+    //Кэш результатов, общий для всех соединений
+    size_t cache_mb = argc > 2 ? std::stoul(argv[2], NULL, 10) : DEFAULT_CACHE_MB;
+    ResultCache cache(cache_mb << 20);
+
     //Создание сокета
     int server_fd;
     if((server_fd = ::socket(AF_INET, SOCK_STREAM, 0)) == 0) {
@@ -190,6 +289,9 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
+    //Арена для моделей соединений: сбрасывается после каждого соединения
+    Arena arena;
+
     //Главный цикл сервера
     while(!GotSigTerm) {
         //Ждать подключения клиента
@@ -224,10 +326,23 @@ int main(int argc, char *argv[]) {
         //Создать поток вывода в клиентский сокет
         std::ostream out(&outbuf);
 
-        //Выполнять цикл обработки запросов
-        while(process(in, out) == 0) {
-            ;
+        {
+            //Память соединения: блоки освобождённых узлов, строк и
+            //массивов переиспользуются следующими запросами, а новая
+            //память берётся из арены, общей для всех соединений
+            BlockCache blocks(arena_resource(arena));
+            std::pmr::unsynchronized_pool_resource mem(&blocks);
+
+            //Граф последнего запроса: следующие запросы только с весами
+            //пересчитывают результат по нему
+            Model model(&mem);
+
+            //Выполнять цикл обработки запросов
+            while(process(in, out, model, cache_mb ? &cache : nullptr) == 0) {
+                ;
+            }
         }
+        arena_reset(arena);
 
         if(!GotSigPipe) {
             //Если клиентский сокет всё ещё живой,